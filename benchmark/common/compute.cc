@@ -3,38 +3,29 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include "command/init.hh"
+#include "common/alloc.hh"
 #include "common/compute.hh"
+#include "common/parallel.hh"
+#include "filter/enkf.hh"
 #include <benchmark/benchmark.h>
-#include <cstring>
-#include <gperftools/malloc_hook.h>
-
-benchmark::IterationCount g_num_new = 0;
-benchmark::IterationCount g_sum_size_new = 0;
-benchmark::IterationCount g_max_size_new = 0;
-benchmark::IterationCount g_min_size_new = -1;
-auto new_hook = [](const void *, std::size_t size) {
-  ++g_num_new;
-  g_sum_size_new += static_cast<benchmark::IterationCount>(size);
-  g_max_size_new = std::max(g_max_size_new, static_cast<benchmark::IterationCount>(size));
-  g_min_size_new = std::min(g_min_size_new, static_cast<benchmark::IterationCount>(size));
-};
+
+namespace alloc = douka::common::alloc;
 
 #define BEFORE_TEST                                                                                \
-  benchmark::IterationCount num_new = g_num_new;                                                   \
-  benchmark::IterationCount sum_size_new = g_sum_size_new;                                         \
-  g_max_size_new = 0;                                                                              \
-  g_min_size_new = -1;                                                                             \
-  MallocHook::AddNewHook(new_hook);
+  alloc::reset_peak();                                                                             \
+  const alloc::Stats alloc_before = alloc::stats();
 
 #define AFTER_TEST                                                                                 \
-  MallocHook::RemoveNewHook(new_hook);                                                             \
-  auto iter = state.iterations();                                                                  \
-  state.counters["#new"] = (g_num_new - num_new) / iter;                                           \
-  state.counters["sum_new"] = (g_sum_size_new - sum_size_new) / iter;                              \
-  state.counters["avg_new"] = (g_sum_size_new - sum_size_new) / (g_num_new - num_new);             \
-  state.counters["max_new"] = g_max_size_new;                                                      \
-  if (((benchmark::IterationCount) - 1) != g_min_size_new) {                                       \
-    state.counters["min_new"] = g_min_size_new;                                                    \
+  if (alloc::enabled()) {                                                                          \
+    const auto iter = static_cast<double>(state.iterations());                                     \
+    const auto allocs = alloc::stats() - alloc_before;                                             \
+    state.counters["#alloc"] = static_cast<double>(allocs.count) / iter;                           \
+    state.counters["sum_alloc"] = static_cast<double>(allocs.bytes) / iter;                        \
+    if (allocs.count != 0) {                                                                       \
+      state.counters["avg_alloc"] = static_cast<double>(allocs.bytes) / allocs.count;              \
+    }                                                                                              \
+    state.counters["peak_heap"] = static_cast<double>(allocs.peak - alloc_before.current);         \
   }
 
 static const Eigen::Index N = 8;
@@ -70,4 +61,157 @@ static void BM_kalman_gain_tall(benchmark::State &state) {
 }
 BENCHMARK(BM_kalman_gain_tall)->Iterations(10)->RangeMultiplier(16)->Range(2, 512);
 
+// Gram matrix S^T S of the N x N ensemble space system from a l x N observed anomaly,
+// as a general product and as a symmetric rank-k update of the lower triangle
+static void BM_gram_gemm(benchmark::State &state) {
+  const Eigen::Index N = state.range(0), l = state.range(1);
+  const Eigen::MatrixXd S = Eigen::MatrixXd::Random(l, N);
+  Eigen::MatrixXd Q(N, N);
+  for (auto _ : state) {
+    Q.setIdentity();
+    Q.noalias() += S.transpose() * S;
+    benchmark::DoNotOptimize(Q.data());
+  }
+}
+BENCHMARK(BM_gram_gemm)->Args({100, 10000})->Unit(benchmark::kMicrosecond);
+
+static void BM_gram_rank_update(benchmark::State &state) {
+  const Eigen::Index N = state.range(0), l = state.range(1);
+  const Eigen::MatrixXd S = Eigen::MatrixXd::Random(l, N);
+  Eigen::MatrixXd Q(N, N);
+  for (auto _ : state) {
+    Q.setIdentity();
+    douka::common::compute::rank_update(Q, S.transpose());
+    benchmark::DoNotOptimize(Q.data());
+  }
+}
+BENCHMARK(BM_gram_rank_update)->Args({100, 10000})->Unit(benchmark::kMicrosecond);
+
+// Solve of the N x N system with N right hand sides, general LU against Cholesky
+static void BM_solve_lu(benchmark::State &state) {
+  const Eigen::Index N = state.range(0), l = state.range(1);
+  const Eigen::MatrixXd S = Eigen::MatrixXd::Random(l, N);
+  const Eigen::MatrixXd Q = Eigen::MatrixXd::Identity(N, N) + S.transpose() * S;
+  Eigen::PartialPivLU<Eigen::MatrixXd> lu(N);
+  Eigen::MatrixXd M = Eigen::MatrixXd::Random(N, N);
+  for (auto _ : state) {
+    lu.compute(Q);
+    M = lu.solve(M);
+    benchmark::DoNotOptimize(M.data());
+  }
+}
+BENCHMARK(BM_solve_lu)->Args({100, 10000})->Unit(benchmark::kMicrosecond);
+
+static void BM_solve_llt(benchmark::State &state) {
+  const Eigen::Index N = state.range(0), l = state.range(1);
+  const Eigen::MatrixXd S = Eigen::MatrixXd::Random(l, N);
+  const Eigen::MatrixXd Q = Eigen::MatrixXd::Identity(N, N) + S.transpose() * S;
+  Eigen::LLT<Eigen::MatrixXd> llt(N);
+  Eigen::MatrixXd M = Eigen::MatrixXd::Random(N, N);
+  for (auto _ : state) {
+    llt.compute(Q);
+    llt.solveInPlace(M);
+    benchmark::DoNotOptimize(M.data());
+  }
+}
+BENCHMARK(BM_solve_llt)->Args({100, 10000})->Unit(benchmark::kMicrosecond);
+
+// Steady state of the analysis update through a reused workspace.
+// A cycle must not allocate once the workspace is sized. Eigen puts the blocking buffers of
+// its matrix products on the stack up to EIGEN_STACK_ALLOCATION_LIMIT, so the sizes are kept
+// below it.
+static void BM_enkf_workspace(benchmark::State &state) {
+  const Eigen::Index k = state.range(0), l = state.range(1);
+  const douka::filter::enkf::Param param{"bench", 0, N, k, l, std::vector<double>(l, 1.0), {}};
+  douka::filter::enkf::Workspace ws{param};
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random(k, N);
+  const Eigen::VectorXd y = Eigen::VectorXd::Random(l);
+  douka::filter::enkf::filter(ws, X, y);
+
+  // Count around the update only, the benchmark loop itself allocates
+  uint64_t num_alloc = 0;
+  for (auto _ : state) {
+    const auto before = alloc::stats();
+    douka::filter::enkf::filter(ws, X, y);
+    num_alloc += (alloc::stats() - before).count;
+  }
+  if (alloc::enabled()) {
+    state.counters["#alloc"] = static_cast<double>(num_alloc) / state.iterations();
+    if (num_alloc != 0) {
+      state.SkipWithError("heap allocation in the steady state");
+    }
+  }
+}
+BENCHMARK(BM_enkf_workspace)->Args({16, 4})->Args({64, 4})->Args({16, 16})->Args({64, 64});
+
+// Cycles of the update with many small blocks of a full R, each whitened by its own factor.
+// The blocks are run on the given number of compute threads, so that the cost of starting the
+// threads of each cycle shows against the small work of a block.
+static void BM_enkf_blocks(benchmark::State &state) {
+  const Eigen::Index k = 64, block_l = 4, blocks = state.range(0);
+  douka::common::set_compute_threads(state.range(1));
+  const Eigen::MatrixXd R_block = Eigen::MatrixXd::Identity(block_l, block_l) * 2.0;
+  douka::filter::enkf::Param param{"bench", 0, N, k, blocks * block_l, {}, {}};
+  param.gain = "ensemble";
+  param.blocks.assign(blocks, {block_l, {R_block.data(), R_block.data() + R_block.size()}, {}});
+  douka::filter::enkf::Workspace ws{param};
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random(k, N);
+  const Eigen::VectorXd y = Eigen::VectorXd::Random(param.l);
+
+  for (auto _ : state) {
+    douka::filter::enkf::filter(ws, X, y);
+    benchmark::DoNotOptimize(X.data());
+  }
+  douka::common::set_compute_threads(std::thread::hardware_concurrency());
+}
+BENCHMARK(BM_enkf_blocks)->ArgsProduct({{16}, {1, 4}})->Unit(benchmark::kMicrosecond);
+
+// Sweep of the gain formulations used to calibrate compute::gain_weights.
+// The counters give the flops of each kernel class, so that the measured time can be fitted by
+// the weighted sum with e.g. least squares over the sweep.
+static void BM_gain(benchmark::State &state) {
+  const auto gain = static_cast<douka::common::compute::Gain>(state.range(0));
+  const Eigen::Index N = state.range(1), k = state.range(2), l = state.range(3);
+  douka::filter::enkf::Param param{"bench", 0, N, k, l, std::vector<double>(l, 1.0), {}};
+  param.gain = douka::common::compute::gain_names[state.range(0)];
+  douka::filter::enkf::Workspace ws{param};
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random(k, N);
+  const Eigen::VectorXd y = Eigen::VectorXd::Random(l);
+
+  for (auto _ : state) {
+    douka::filter::enkf::filter(ws, X, y);
+    benchmark::DoNotOptimize(X.data());
+  }
+
+  const auto &cost = ws.costs[static_cast<int>(gain)];
+  state.SetLabel(std::string(douka::common::compute::gain_names[state.range(0)]));
+  state.counters["gemm"] = cost.flops.gemm;
+  state.counters["factor"] = cost.flops.factor;
+  state.counters["solve"] = cost.flops.solve;
+  state.counters["stream"] = cost.flops.stream;
+  state.counters["cost"] = cost.cost;
+  state.counters["selected"] = ws.gain == douka::common::compute::select_gain(ws.costs).gain;
+}
+BENCHMARK(BM_gain)
+    ->ArgsProduct({{0, 1, 2}, {8, 32, 128}, {64, 512}, {8, 64, 512}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_gain)->Args({2, 100, 10000, 10000})->Unit(benchmark::kMillisecond);
+
+// Initial ensemble of N members of size k, the threads are given by the third argument
+static void BM_init(benchmark::State &state) {
+  const auto N = state.range(0), k = state.range(1);
+  douka::common::set_compute_threads(state.range(2));
+  const douka::command::init::Param param = {"bench", 0, static_cast<uint64_t>(N),
+                                             static_cast<uint64_t>(k),
+                                             std::vector<double>(k, 0.0),
+                                             std::vector<double>(k, 1.0)};
+  Eigen::MatrixXd X(k, N);
+  for (auto _ : state) {
+    douka::command::init::init(X, param);
+    benchmark::DoNotOptimize(X.data());
+  }
+  state.SetItemsProcessed(state.iterations() * N * k);
+}
+BENCHMARK(BM_init)->ArgsProduct({{1000}, {10000}, {1, 4}})->Unit(benchmark::kMillisecond);
+
 BENCHMARK_MAIN();
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "common/json.hh"
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+static douka::io::State make_state(const int64_t k) {
+  std::default_random_engine engine{1};
+  std::normal_distribution<double> dist{0.0, 1.0};
+  douka::io::State state{"bench", 0, 1, 0, std::vector<double>(k)};
+  for (auto &x : state.x) {
+    x = dist(engine);
+  }
+  return state;
+}
+
+// Serialization of a state, style 0: compact, 1: pretty
+static void BM_to_text(benchmark::State &state) {
+  const auto style = static_cast<douka::io::JsonStyle>(state.range(0));
+  const auto member = make_state(state.range(1));
+  std::size_t size = 0;
+  for (auto _ : state) {
+    const auto text = douka::io::to_text(member, style);
+    size = text.size();
+    benchmark::DoNotOptimize(text.data());
+  }
+  state.counters["bytes"] = static_cast<double>(size);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_to_text)->ArgsProduct({{0, 1}, {1000, 100000}})->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
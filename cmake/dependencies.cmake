@@ -3,6 +3,16 @@
 
 find_package(Eigen3 REQUIRED)
 find_package(nlohmann_json 3.2.0 REQUIRED)
+find_package(Threads REQUIRED)
+
+# shm_open of the ensemble store lives in librt before glibc 2.34
+add_library(douka::rt INTERFACE IMPORTED)
+find_library(RT_LIBRARY rt)
+if(RT_LIBRARY)
+  set_property(
+    TARGET douka::rt PROPERTY
+    INTERFACE_LINK_LIBRARIES ${RT_LIBRARY})
+endif()
 
 add_library(douka::mkl INTERFACE IMPORTED)
 if(DOUKA_USE_MKL)
@@ -36,3 +46,15 @@ if(DOUKA_USE_BLAS)
     TARGET douka::blas PROPERTY
     INTERFACE_COMPILE_DEFINITIONS EIGEN_USE_BLAS EIGEN_USE_LAPACKE)
 endif()
+
+add_library(douka::uring INTERFACE IMPORTED)
+if(DOUKA_USE_IO_URING)
+  find_package(PkgConfig REQUIRED)
+  pkg_check_modules(URING REQUIRED IMPORTED_TARGET liburing)
+  set_property(
+    TARGET douka::uring PROPERTY
+    INTERFACE_LINK_LIBRARIES PkgConfig::URING)
+  set_property(
+    TARGET douka::uring PROPERTY
+    INTERFACE_COMPILE_DEFINITIONS DOUKA_USE_IO_URING)
+endif()
@@ -8,12 +8,18 @@
 
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <regex>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace douka::io {
@@ -146,86 +152,189 @@ inline bool write_json(const std::filesystem::path &filename, const nlohmann::js
   stream << std::setw(2) << json << std::endl;
   return true;
 }
+namespace detail {
+// Id of the digits, false unless they are all digits of an id in int64_t
+inline bool parse_id(const std::string_view &s, int64_t &id) {
+  if (s.empty() || !std::all_of(s.begin(), s.end(), [](const char c) {
+        return std::isdigit(static_cast<unsigned char>(c));
+      })) {
+    return false;
+  }
+  const auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), id);
+  return ec == std::errc{} && end == s.data() + s.size();
+}
 
-inline bool parse_filename(const std::string &input, std::vector<std::string> &files) {
-  const auto regex_match_count = [](const std::string &s, const std::regex &pattern) -> int64_t {
-    const auto begin = std::sregex_iterator(s.begin(), s.end(), pattern);
-    const auto end = std::sregex_iterator();
-    return std::distance(begin, end);
-  };
-  const int64_t max_ensemble = 10000;
-  const auto yield_filename = [](const std::string &s, const int64_t i, std::string &out) -> bool {
-    out.resize(s.size() + std::log10(max_ensemble) + 1);
-    const int rc = snprintf(out.data(), out.size(), s.c_str(), i);
-    if (rc < 0) {
-      std::clog << "snprintf status error " << rc << std::endl;
+/**
+ * @brief The id formatted by the placeholder %d, %Nd or %0Nd as printf does
+ */
+inline std::string format_id(const std::string_view &spec, const int64_t id) {
+  const bool zero = spec.size() > 2 && spec[1] == '0';
+  int64_t width = 0;
+  std::from_chars(spec.data() + 1, spec.data() + spec.size() - 1, width);
+
+  char digits[32];
+  const auto end = std::to_chars(std::begin(digits), std::end(digits), id).ptr;
+  const auto size = static_cast<int64_t>(end - digits);
+  std::string formatted(std::max<int64_t>(width - size, 0), zero ? '0' : ' ');
+  formatted.append(digits, end);
+  return formatted;
+}
+
+// Names of the entries of the directory by a single readdir pass
+inline bool list_entries(const std::string &dir, std::vector<std::string> &names) {
+  std::error_code ec;
+  for (const auto &entry :
+       std::filesystem::directory_iterator{dir.empty() ? std::string{"."} : dir, ec}) {
+    names.emplace_back(entry.path().filename().string());
+  }
+  if (ec) {
+    std::clog << dir << " could not be listed: " << ec.message() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief parse_filename() listing the directories by list, the members are searched in the
+ * subdirectories id / shard_size of the directory unless shard_size is 0
+ */
+template <typename List>
+bool parse_filename(const std::string &input, std::vector<std::string> &files, List &&list,
+                    const int64_t shard_size) {
+  // Position and length of the placeholder %d, %Nd or %0Nd
+  std::vector<std::pair<std::size_t, std::size_t>> placeholders;
+  for (auto pos = input.find('%'); pos != std::string::npos; pos = input.find('%', pos + 1)) {
+    auto end = pos + 1;
+    while (end < input.size() && std::isdigit(static_cast<unsigned char>(input[end]))) {
+      ++end;
+    }
+    if (end < input.size() && input[end] == 'd') {
+      placeholders.emplace_back(pos, end + 1 - pos);
+    }
+  }
+
+  if (placeholders.empty()) {
+    if (!std::filesystem::exists(input)) {
+      std::clog << input << " not exists" << std::endl;
       return false;
     }
+    files.emplace_back(input);
     return true;
-  };
+  }
+  if (placeholders.size() > 1) {
+    std::clog << input << " only 1 digit placeholder allowed but found " << placeholders.size()
+              << std::endl;
+    return false;
+  }
+
+  const auto [pos, len] = placeholders.front();
+  const auto separator = input.find_last_of('/');
+  if (separator != std::string::npos && separator > pos) {
+    std::clog << input << " placeholder should be in the file name" << std::endl;
+    return false;
+  }
+  const auto dir_size = separator == std::string::npos ? 0 : separator + 1;
+  const auto spec = input.substr(pos, len);
+  const auto prefix = input.substr(dir_size, pos - dir_size);
+  const auto suffix = input.substr(pos + len);
 
-  const auto check_exists = [](const std::filesystem::path &filename) -> bool {
-    if (!std::filesystem::exists(filename)) {
-      std::clog << filename << " not exists" << std::endl;
+  const auto dir = input.substr(0, dir_size);
+
+  // A name matches when the id formatted by the placeholder gives it back
+  std::vector<std::pair<int64_t, std::string>> members; // id and subdirectory
+  std::vector<std::string> names;
+  const auto scan = [&](const std::string &subdir) -> bool {
+    names.clear();
+    if (!list(dir + subdir, names)) {
       return false;
     }
+    for (const auto &name : names) {
+      if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) ||
+          name.compare(name.size() - suffix.size(), suffix.size(), suffix)) {
+        continue;
+      }
+      const auto digits = std::string_view{name}.substr(
+          prefix.size(), name.size() - prefix.size() - suffix.size());
+      const auto first = digits.find_first_not_of(' ');
+      int64_t id;
+      if (first == std::string_view::npos || !parse_id(digits.substr(first), id)) {
+        continue;
+      }
+      if (format_id(spec, id) == digits) {
+        members.emplace_back(id, subdir);
+      }
+    }
     return true;
   };
 
-  std::regex pattern{R"(%(\d+|)d)"};
-  const int64_t match_cnt = regex_match_count(input, pattern);
-  if (match_cnt == 0) {
-    if (!check_exists(input)) {
+  if (shard_size == 0) {
+    if (!scan("")) {
       return false;
     }
-    files.emplace_back(input);
-  } else if (match_cnt == 1) {
-    int64_t start;
-    std::string filename;
-    for (start = 0; start < max_ensemble; ++start) {
-      if (!yield_filename(input, start, filename)) {
-        return false;
-      }
-      if (!std::filesystem::exists(filename)) {
+  } else {
+    std::vector<std::string> shards;
+    if (!list(dir, shards)) {
+      return false;
+    }
+    for (const auto &shard : shards) {
+      int64_t shard_id;
+      if (!parse_id(shard, shard_id) || !std::filesystem::is_directory(dir + shard)) {
         continue;
       }
-      files.emplace_back(filename);
-      ++start;
-      break;
-    }
-    for (; start < max_ensemble; ++start) {
-      if (!yield_filename(input, start, filename)) {
+      const auto begin = members.size();
+      if (!scan(shard + "/")) {
         return false;
       }
-      if (std::filesystem::exists(filename)) {
-        files.emplace_back(filename);
-        continue;
-      }
-      break;
+      members.erase(std::remove_if(members.begin() + begin, members.end(),
+                                   [shard_id, shard_size](const auto &member) {
+                                     return member.first / shard_size != shard_id;
+                                   }),
+                    members.end());
     }
-    if (files.empty()) {
-      std::clog << input << " does not match to any file" << std::endl;
+  }
+  if (members.empty()) {
+    std::clog << input << " does not match to any file" << std::endl;
+    return false;
+  }
+
+  std::sort(members.begin(), members.end());
+  for (std::size_t i = 1; i < members.size(); ++i) {
+    if (members[i].first != members[i - 1].first + 1) {
+      std::clog << input << " has a gap between the ids " << members[i - 1].first << " and "
+                << members[i].first << std::endl;
       return false;
     }
-  } else {
-    std::clog << input << " only 1 digit placeholder allowed but found " << match_cnt << std::endl;
-    return false;
+  }
+
+  files.reserve(files.size() + members.size());
+  for (const auto &[id, subdir] : members) {
+    files.emplace_back(dir + subdir + prefix + format_id(spec, id) + suffix);
   }
   return true;
 }
+} // namespace detail
+
+/**
+ * @brief Files of the input, either a file or a pattern of a single %d, %Nd or %0Nd placeholder
+ * of the id in the file name. The ids matching the pattern are sorted and should be consecutive.
+ */
+inline bool parse_filename(const std::string &input, std::vector<std::string> &files) {
+  return detail::parse_filename(input, files, detail::list_entries, 0);
+}
 
-inline std::string state_filename(const State &state) {
+inline std::string state_filename(const State &state, const int64_t id_width = 4) {
   std::stringstream ss;
   ss << state.name << "_";
-  ss << std::setfill('0') << std::setw(4) << state.id << "_";
+  ss << std::setfill('0') << std::setw(id_width) << state.id << "_";
   ss << std::setfill('0') << std::setw(6) << state.sys_tim << "_";
   ss << std::setfill('0') << std::setw(6) << state.obs_tim << ".json";
   return ss.str();
 }
 
-inline std::string state_filename_with_id_place_holder(const State &state) {
+inline std::string state_filename_with_id_place_holder(const State &state,
+                                                       const int64_t id_width = 4) {
   std::stringstream ss;
-  ss << state.name << "_%04d_";
+  ss << state.name << "_%0" << id_width << "d_";
   ss << std::setfill('0') << std::setw(6) << state.sys_tim << "_";
   ss << std::setfill('0') << std::setw(6) << state.obs_tim << ".json";
   return ss.str();
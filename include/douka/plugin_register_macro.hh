@@ -13,4 +13,12 @@
   douka::PluginInterface *make() { return new __func__; }                                          \
   }
 
+// Register a plugin whose instances share no state, so that an instance per thread can run
+// concurrently, e.g. for the truths of obsgen
+#define DOUKA_PLUGIN_REGISTER_CONCURRENT(__func__)                                                 \
+  DOUKA_PLUGIN_REGISTER(__func__)                                                                  \
+  extern "C" {                                                                                     \
+  bool concurrent() { return true; }                                                               \
+  }
+
 #endif
\ No newline at end of file
@@ -6,22 +6,28 @@
 #ifndef __DOUKA_COMMAND__
 #define __DOUKA_COMMAND__
 
+#include "command/convert.hh"
 #include "command/filter.hh"
 #include "command/init.hh"
 #include "command/obsgen.hh"
+#include "command/obsprep.hh"
 #include "command/predict.hh"
+#include "command/store.hh"
 
 #include <string>
 #include <string_view>
 
 namespace douka::command {
-enum class id { init, predict, filter, obsgen };
+enum class id { init, predict, filter, obsgen, convert, store, obsprep };
 
 inline static const std::string_view names[] = {
     init::name,
     predict::name,
     filter::name,
     obsgen::name,
+    convert::name,
+    store::name,
+    obsprep::name,
 };
 
 inline static const std::string_view descriptions[] = {
@@ -29,6 +35,9 @@ inline static const std::string_view descriptions[] = {
     predict::description,
     filter::description,
     obsgen::description,
+    convert::description,
+    store::description,
+    obsprep::description,
 };
 
 } // namespace douka::command
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "convert.hh"
+#include "common/ensemble.hh"
+#include "common/profile.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+namespace douka::command::convert {
+static bool show_help(const int argc, char const *const argv[]) {
+  static const auto &show_help = [argv](std::ostream &os) {
+    os << argv[0] << " " << argv[1] << " [Options]" << std::endl;
+    os << "Description:" << std::endl;
+    os << "   " << description << std::endl;
+    os << std::endl;
+    os << "Options:" << std::endl;
+    os << "   --state       Input state vector json file or binary ensemble" << std::endl;
+    os << "   --output      (Opt) Output path (default='output')" << std::endl;
+    os << "   --format      (Opt) Output format [json|binary] (default=the other of the input)"
+       << std::endl;
+    os << "   --force       (Opt) Overwrite existing file" << std::endl;
+    os << "   --help        (Opt) Print help message" << std::endl;
+  };
+
+  if (argc <= 2) {
+    show_help(std::cout);
+    throw std::invalid_argument("no option given");
+  }
+
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--help")) {
+      show_help(std::cout);
+      return true;
+    }
+  }
+  return false;
+}
+
+Args get_args(const int argc, const char *const argv[]) {
+  Args args;
+  enum class Context {
+    none = 0,
+    state,
+    output,
+    format,
+  } ctx = Context::none;
+
+  for (int i = 2; i < argc; i++) {
+    if (!strncmp(argv[i], "--", 2)) {
+      ctx = Context::none;
+      if (!strcmp(argv[i], "--state")) {
+        ctx = Context::state;
+      } else if (!strcmp(argv[i], "--output")) {
+        ctx = Context::output;
+      } else if (!strcmp(argv[i], "--format")) {
+        ctx = Context::format;
+      } else if (!strcmp(argv[i], "--force")) {
+        args.force = true;
+        ctx = Context::none;
+      } else {
+        throw std::invalid_argument("unknown option '" + std::string{argv[i]} + "' given");
+      }
+    } else {
+      switch (ctx) {
+      case Context::state: {
+        args.state = argv[i];
+        ctx = Context::none;
+        break;
+      }
+      case Context::output: {
+        args.output = argv[i];
+        ctx = Context::none;
+        break;
+      }
+      case Context::format: {
+        io::to_format(argv[i]);
+        args.format = argv[i];
+        ctx = Context::none;
+        break;
+      }
+      default:
+        throw std::invalid_argument("invalid command '" + std::string{argv[i]} + "' given");
+      }
+    }
+  }
+  if (ctx != Context::none) {
+    throw std::invalid_argument("required option for '" + std::string{argv[argc - 1]} +
+                                "' not given");
+  }
+  if (args.state.empty()) {
+    throw std::invalid_argument("required option '--state' not given");
+  }
+  return args;
+}
+
+bool validate(const std::vector<io::State> &states) {
+  if (states.empty()) {
+    std::clog << "no state given" << std::endl;
+    return false;
+  }
+  return std::all_of(states.begin(), states.end(),
+                     [](const auto &state) { return state.validate(); });
+}
+
+int entry(const int argc, const char *const argv[]) {
+  if (show_help(argc, argv)) {
+    return EXIT_SUCCESS;
+  }
+  const auto args = get_args(argc, argv);
+
+  if (!io::create_output_directory(args.output)) {
+    return EXIT_FAILURE;
+  }
+
+  const bool is_ensemble = io::is_ensemble(args.state);
+  const auto format = args.format.empty() ? (is_ensemble ? io::Format::json : io::Format::binary)
+                                          : io::to_format(args.format);
+
+  common::profile::Phase phase{is_ensemble ? "read_ensemble" : "read_json"};
+  std::vector<io::State> states;
+  if (!io::read_states(args.state, states)) {
+    return EXIT_FAILURE;
+  }
+
+  phase.next("validate");
+  if (!validate(states)) {
+    return EXIT_FAILURE;
+  }
+
+  phase.next(std::string("write_") + std::string(io::format_names[static_cast<int>(format)]));
+  if (!io::write_states(args.output, states, format, args.force)) {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+} // namespace douka::command::convert
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMAND_CONVERT__
+#define __DOUKA_COMMAND_CONVERT__
+
+#include "douka/io.hh"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace douka::command::convert {
+inline static constexpr std::string_view name = "convert";
+inline static constexpr std::string_view description =
+    "Convert an ensemble between json and binary format";
+
+struct Args {
+  std::string state;
+  std::string output = "output";
+  std::string format; // Optional, the other format of the input by default
+  bool force = false;
+};
+
+Args get_args(const int argc, const char *const argv[]);
+bool validate(const std::vector<io::State> &states);
+int entry(const int argc, const char *const argv[]);
+} // namespace douka::command::convert
+#endif
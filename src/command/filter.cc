@@ -4,14 +4,28 @@
  */
 
 #include "filter.hh"
+#include "common/ensemble.hh"
 #include "common/io.hh"
+#include "common/parallel.hh"
 #include "douka/io.hh"
 #include "filter/enkf.hh"
 #include "filter/particle.hh"
 
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <numeric>
+#include <string>
+#include <vector>
+
+extern char **environ;
 
 namespace douka::command::filter {
 static const std::string_view type_names[] = {
@@ -35,13 +49,19 @@ static bool show_help(const int argc, char const *const argv[]) {
     os << "   " << description << std::endl;
     os << std::endl;
     os << "Options:" << std::endl;
-    os << "   --state       Input state vector json file" << std::endl;
+    os << "   --state       Input state vector json file or binary ensemble" << std::endl;
     os << "   --param       Input parameter json files" << std::endl;
-    os << "   --obs         Input observation json file" << std::endl;
+    os << "   --obs         Input observation json file or series:<file>@<obs_tim>" << std::endl;
     os << "   --filter      (Opt) Filter [" << show_filter_types() << "] (default=enkf)"
        << std::endl;
     os << "   --output      (Opt) Output path (default='output')" << std::endl;
+    os << "   --format      (Opt) Output format [json|binary] (default=json)" << std::endl;
     os << "   --force       (Opt) Overwrite existing file" << std::endl;
+    os << "   --ranks       (Opt) Number of processes the states are decomposed into (default=1)"
+       << std::endl;
+    os << "   --rank        (Opt) Rank of this process, the ranks are launched on this node if not "
+          "given"
+       << std::endl;
     os << "   --help        (Opt) Print help message" << std::endl;
   };
 
@@ -69,6 +89,9 @@ Args get_args(const int argc, const char *const argv[]) {
     obs,
     filter,
     output,
+    format,
+    ranks,
+    rank,
   } ctx = Context::none;
 
   for (int i = 2; i < argc; i++) {
@@ -84,6 +107,12 @@ Args get_args(const int argc, const char *const argv[]) {
         ctx = Context::filter;
       } else if (!strcmp(argv[i], "--output")) {
         ctx = Context::output;
+      } else if (!strcmp(argv[i], "--format")) {
+        ctx = Context::format;
+      } else if (!strcmp(argv[i], "--ranks")) {
+        ctx = Context::ranks;
+      } else if (!strcmp(argv[i], "--rank")) {
+        ctx = Context::rank;
       } else if (!strcmp(argv[i], "--force")) {
         args.force = true;
         ctx = Context::none;
@@ -116,6 +145,24 @@ Args get_args(const int argc, const char *const argv[]) {
         ctx = Context::none;
         break;
       }
+      case Context::format: {
+        io::to_format(argv[i]);
+        args.format = argv[i];
+        ctx = Context::none;
+        break;
+      }
+      case Context::ranks:
+      case Context::rank: {
+        char *end = nullptr;
+        const auto number = std::strtoll(argv[i], &end, 10);
+        if (*end != '\0' || number < (ctx == Context::ranks ? 1 : 0)) {
+          throw std::invalid_argument("invalid value '" + std::string{argv[i]} + "' given for '" +
+                                      std::string{argv[i - 1]} + "'");
+        }
+        (ctx == Context::ranks ? args.ranks : args.rank) = number;
+        ctx = Context::none;
+        break;
+      }
       default: {
         throw std::invalid_argument("invalid command '" + std::string{argv[i]} + "' given");
       }
@@ -135,16 +182,94 @@ Args get_args(const int argc, const char *const argv[]) {
   if (args.obs.empty()) {
     throw std::invalid_argument("required option '--obs' not given");
   }
+  if (args.rank >= args.ranks) {
+    throw std::invalid_argument("invalid rank " + std::to_string(args.rank) + " of " +
+                                std::to_string(args.ranks) + " given");
+  }
 
   return args;
 }
 
+// Single-node launcher, the ranks are run as child processes of this executable
+static int launch(const int argc, const char *const argv[], const Args &args) {
+  // The cores are shared by the ranks
+  const auto threads = std::to_string(std::max<int64_t>(common::compute_threads() / args.ranks, 1));
+  const auto io_threads = std::to_string(io::io_threads());
+  std::vector<std::string> ranks(args.ranks);
+  std::vector<pid_t> pids;
+  for (int64_t rank = 0; rank < args.ranks; ++rank) {
+    ranks[rank] = std::to_string(rank);
+    std::vector<char *> child{const_cast<char *>(argv[0]),
+                              const_cast<char *>("--threads"),
+                              const_cast<char *>(threads.c_str()),
+                              const_cast<char *>("--io-threads"),
+                              const_cast<char *>(io_threads.c_str())};
+    for (int i = 1; i < argc; i++) {
+      child.emplace_back(const_cast<char *>(argv[i]));
+    }
+    child.emplace_back(const_cast<char *>("--rank"));
+    child.emplace_back(ranks[rank].data());
+    child.emplace_back(nullptr);
+
+    pid_t pid;
+    const int err = posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, child.data(), environ);
+    if (err != 0) {
+      std::clog << "rank " << rank << " could not launch: " << std::strerror(err) << std::endl;
+      break;
+    }
+    pids.emplace_back(pid);
+  }
+
+  // A failed rank takes down the others, which would wait for it otherwise
+  bool ok = static_cast<int64_t>(pids.size()) == args.ranks;
+  const auto stop = [&pids]() {
+    for (const auto pid : pids) {
+      if (pid > 0) {
+        kill(pid, SIGTERM);
+      }
+    }
+  };
+  if (!ok) {
+    stop();
+  }
+  for (std::size_t remaining = pids.size(); remaining > 0; remaining--) {
+    int status = 0;
+    const auto pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      std::clog << "could not wait for the ranks: " << std::strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+    const auto it = std::find(pids.begin(), pids.end(), pid);
+    if (it == pids.end()) {
+      remaining++;
+      continue;
+    }
+    *it = 0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+      if (ok) {
+        std::clog << "rank " << it - pids.begin() << " failed" << std::endl;
+        stop();
+      }
+      ok = false;
+    }
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int entry(const int argc, const char *const argv[]) {
   if (show_help(argc, argv)) {
     return EXIT_SUCCESS;
   }
   const auto args = get_args(argc, argv);
 
+  if (args.ranks > 1 && args.filter != "enkf") {
+    std::clog << "filter '" << args.filter << "' is not decomposed into ranks" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (args.ranks > 1 && args.rank < 0) {
+    return launch(argc, argv, args);
+  }
+
   if (args.filter == "enkf") {
     return douka::filter::enkf::entry(args);
   } else if (args.filter == "particle") {
@@ -6,6 +6,7 @@
 #ifndef __DOUKA_COMMAND_FILTER__
 #define __DOUKA_COMMAND_FILTER__
 
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -20,7 +21,10 @@ struct Args {
   std::string obs;
   std::string filter = "enkf";
   std::string output = "output";
+  std::string format = "json";
   bool force = false;
+  int64_t ranks = 1; // Processes of the domain decomposition
+  int64_t rank = -1; // Rank of this process, all the ranks are launched if not given
 };
 
 Args get_args(const int argc, const char *const argv[]);
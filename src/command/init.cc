@@ -5,16 +5,29 @@
 
 #include "init.hh"
 #include "common/compute.hh"
+#include "common/ensemble.hh"
 #include "common/io.hh"
+#include "common/parallel.hh"
+#include "common/profile.hh"
+#include "common/sampling.hh"
+#include "common/series.hh"
 
+#include <Eigen/Cholesky>
 #include <Eigen/Core>
 
 #include <algorithm>
+#include <cmath>
 #include <filesystem>
+#include <functional>
 #include <random>
 #include <unordered_map>
 
 namespace douka::command::init {
+namespace {
+// Members drawn by a task, a full V0 is applied to them by a single product
+constexpr int64_t member_block = 64;
+} // namespace
+
 static bool show_help(const int argc, char const *const argv[]) {
 
   static const auto &show_help = [argv](std::ostream &os) {
@@ -25,6 +38,7 @@ static bool show_help(const int argc, char const *const argv[]) {
     os << "Options:" << std::endl;
     os << "   --param       Input parameter json files" << std::endl;
     os << "   --output      (Opt) Output path (default='output')" << std::endl;
+    os << "   --format      (Opt) Output format [json|binary] (default=json)" << std::endl;
     os << "   --force       (Opt) Overwrite existing file" << std::endl;
     os << "   --help        (Opt) Print help message" << std::endl;
   };
@@ -49,6 +63,7 @@ Args get_args(const int argc, char const *const argv[]) {
     none = 0,
     param,
     output,
+    format,
   } ctx = Context::none;
 
   for (int i = 2; i < argc; i++) {
@@ -58,6 +73,8 @@ Args get_args(const int argc, char const *const argv[]) {
         ctx = Context::param;
       } else if (!strcmp(argv[i], "--output")) {
         ctx = Context::output;
+      } else if (!strcmp(argv[i], "--format")) {
+        ctx = Context::format;
       } else if (!strcmp(argv[i], "--force")) {
         args.force = true;
         ctx = Context::none;
@@ -75,6 +92,12 @@ Args get_args(const int argc, char const *const argv[]) {
         ctx = Context::none;
         break;
       }
+      case Context::format: {
+        io::to_format(argv[i]);
+        args.format = argv[i];
+        ctx = Context::none;
+        break;
+      }
       default:
         throw std::invalid_argument("invalid command '" + std::string{argv[i]} + "' given");
       }
@@ -98,48 +121,191 @@ bool validate(const Param &param) {
   return true;
 }
 
-bool init(std::vector<io::State> &states, const Param &param) {
-  static std::default_random_engine engine{static_cast<unsigned>(param.seed)};
-  const Eigen::VectorXd V = Eigen::Map<const Eigen::VectorXd>(param.V0.data(), param.V0.size());
-  const auto x0 = Eigen::Map<const Eigen::VectorXd>(param.x0.data(), param.x0.size());
-  states.reserve(param.N);
-
-  for (uint64_t i = 0; i < param.N; ++i) {
-    io::State state;
-    state.name = param.name;
-    state.id = i;
-    state.obs_tim = 0;
-    state.sys_tim = 0;
+bool climatology(Eigen::Ref<Eigen::MatrixXd> X, const Param &param) {
+  const auto N = static_cast<uint64_t>(X.cols());
+  io::ObsSeriesReader reader;
+  if (!reader.open(param.trajectory)) {
+    return false;
+  }
+  const auto n = reader.size();
+  if (n < N) {
+    std::clog << param.trajectory << " of " << n << " states is shorter than N=" << N
+              << std::endl;
+    return false;
+  }
+  if (N == 0) {
+    return true;
+  }
 
-    state.x.resize(param.k);
-    auto x = Eigen::Map<Eigen::VectorXd>(state.x.data(), state.x.size());
-    x = common::compute::rand(V, 1, engine) + x0;
+  io::Obs state;
+  const auto read = [&](const Eigen::Index member) {
+    if (!reader.next(state)) {
+      return false;
+    }
+    if (state.y.size() != static_cast<std::size_t>(X.rows())) {
+      std::clog << param.trajectory << " invalid state size of obs_tim " << state.obs_tim << " "
+                << state.y.size() << " != " << X.rows() << std::endl;
+      return false;
+    }
+    X.col(member) = Eigen::Map<const Eigen::VectorXd>(state.y.data(), X.rows());
+    return true;
+  };
 
-    states.emplace_back(state);
+  // The first N states fill the reservoir
+  for (uint64_t member = 0; member < N; ++member) {
+    if (!read(member)) {
+      return false;
+    }
   }
 
+  // Algorithm L (Li 1994), the number of states skipped until the next replacement is drawn
+  // from its geometric distribution
+  std::mt19937_64 engine{param.seed};
+  std::uniform_real_distribution<> uniform{std::nextafter(0.0, 1.0), 1.0};
+  std::uniform_int_distribution<Eigen::Index> replaced{0, X.cols() - 1};
+  double w = std::exp(std::log(uniform(engine)) / N);
+  while (true) {
+    const auto skip = std::floor(std::log(uniform(engine)) / std::log1p(-w));
+    if (!(skip < static_cast<double>(n - reader.position()))) {
+      break;
+    }
+    if (!reader.skip(static_cast<uint64_t>(skip)) || !read(replaced(engine))) {
+      return false;
+    }
+    w *= std::exp(std::log(uniform(engine)) / N);
+  }
   return true;
 }
 
+bool init(Eigen::Ref<Eigen::MatrixXd> X, const Param &param) {
+  if (!param.validate()) {
+    return false;
+  }
+  const auto N = static_cast<int64_t>(param.N);
+  const auto k = static_cast<Eigen::Index>(param.k);
+  if (X.rows() != k || X.cols() != N) {
+    std::clog << "invalid size of ensemble " << X.rows() << " x " << X.cols() << " != " << k
+              << " x " << N << std::endl;
+    return false;
+  }
+  if (!param.trajectory.empty()) {
+    return climatology(X, param);
+  }
+  const auto x0 = Eigen::Map<const Eigen::VectorXd>(param.x0.data(), k);
+
+  // The square root of V0 is taken once, the Cholesky factor of a full one
+  const bool diagonal = param.V0.size() == static_cast<std::size_t>(k);
+  Eigen::VectorXd sigma;
+  Eigen::MatrixXd L;
+  if (diagonal) {
+    sigma = Eigen::Map<const Eigen::VectorXd>(param.V0.data(), k);
+    if (sigma.minCoeff() < 0.0) {
+      std::clog << "negative variance of V0 given" << std::endl;
+      return false;
+    }
+    sigma = sigma.cwiseSqrt();
+  } else {
+    const Eigen::LLT<Eigen::MatrixXd> llt{
+        Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>{
+            param.V0.data(), k, k}};
+    if (llt.info() != Eigen::Success) {
+      std::clog << "V0 is not positive definite" << std::endl;
+      return false;
+    }
+    L = llt.matrixL();
+  }
+
+  // The standard normal members are drawn into X, then scaled and shifted in place
+  namespace sampling = common::sampling;
+  const auto blocks = (N + member_block - 1) / member_block;
+  const auto threads = std::min(common::compute_threads(), std::max<int64_t>(blocks, 1));
+  const auto for_each_block = [&](const std::function<void(int64_t, int64_t, int64_t)> &task) {
+    return common::parallel_for(
+        blocks,
+        [&](const int64_t block, const int64_t thread) {
+          const auto begin = block * member_block;
+          task(begin, std::min(member_block, N - begin), thread);
+          return true;
+        },
+        threads);
+  };
+  switch (to_sampling(param.sampling)) {
+  case sampling::Sampling::random:
+    for_each_block([&](const int64_t begin, const int64_t size, const int64_t) {
+      sampling::draw_random(X.middleCols(begin, size), param.seed, begin);
+    });
+    break;
+  case sampling::Sampling::sobol: {
+    const sampling::Sobol sobol{k, param.seed};
+    for_each_block([&](const int64_t begin, const int64_t size, const int64_t) {
+      sobol.draw(X.middleCols(begin, size), begin);
+    });
+    break;
+  }
+  case sampling::Sampling::lhs:
+    // Each dimension is stratified over all the members
+    common::parallel_for(k, [&](const int64_t row, const int64_t) {
+      sampling::draw_latin_hypercube(X.row(row), param.seed, row);
+      return true;
+    });
+    break;
+  case sampling::Sampling::antithetic:
+    for_each_block([&](const int64_t begin, const int64_t size, const int64_t) {
+      sampling::draw_antithetic(X.middleCols(begin, size), param.seed, begin);
+    });
+    sampling::match_moments(X);
+    break;
+  }
+
+  std::vector<Eigen::MatrixXd> Z(diagonal ? 0 : threads);
+  return for_each_block([&](const int64_t begin, const int64_t size, const int64_t thread) {
+    auto x = X.middleCols(begin, size);
+    if (diagonal) {
+      x = sigma.asDiagonal() * x;
+    } else {
+      Z[thread] = x;
+      x.noalias() = L.triangularView<Eigen::Lower>() * Z[thread];
+    }
+    x.colwise() += x0;
+  });
+}
+
+bool init(io::Ensemble &ensemble, const Param &param) {
+  ensemble.name = param.name;
+  ensemble.N = param.N;
+  ensemble.k = param.k;
+  ensemble.sys_tim = 0;
+  ensemble.obs_tim = 0;
+  ensemble.X.resize(param.N * param.k);
+  return init(Eigen::Map<Eigen::MatrixXd>(ensemble.X.data(), param.k, param.N), param);
+}
+
+bool init(std::vector<io::State> &states, const Param &param) {
+  io::Ensemble ensemble;
+  return init(ensemble, param) && io::to_states(ensemble, states);
+}
+
 int entry(const int argc, const char *const argv[]) {
   if (show_help(argc, argv)) {
     return EXIT_SUCCESS;
   }
   const auto args = get_args(argc, argv);
 
-  if (!std::filesystem::exists(args.output) && !std::filesystem::create_directories(args.output)) {
+  if (!io::create_output_directory(args.output)) {
     return EXIT_FAILURE;
   }
 
   /* Parse filename */
+  common::profile::Phase phase{"parse_filename"};
   std::vector<std::string> param_filenames;
   for (const auto &param : args.param) {
-    if (!io::parse_filename(param, param_filenames)) {
+    if (!io::parse_filename(param, param_filenames, io::layout())) {
       return EXIT_FAILURE;
     }
   }
 
   /* filename -> json */
+  phase.next("read_json");
   nlohmann::json param_json;
   for (const auto &filename : param_filenames) {
     if (!io::read_json(filename, param_json)) {
@@ -149,6 +315,7 @@ int entry(const int argc, const char *const argv[]) {
   param_filenames.clear();
 
   /* json -> object */
+  phase.next("json_to_object");
   Param param;
   try {
     param = param_json;
@@ -156,22 +323,54 @@ int entry(const int argc, const char *const argv[]) {
     std::clog << e.what() << std::endl;
     return EXIT_FAILURE;
   }
+  if (param_json.contains("x0") && param_json["x0"].is_array()) {
+    param.x0 = param_json["x0"].get<std::vector<double>>();
+  }
+  if (param_json.contains("V0") && param_json["V0"].is_array()) {
+    param.V0 = param_json["V0"].get<std::vector<double>>();
+  }
+  if (param_json.contains("sampling") && param_json["sampling"].is_string()) {
+    param.sampling = param_json["sampling"].get<std::string>();
+  }
+  if (param_json.contains("trajectory") && param_json["trajectory"].is_string()) {
+    param.trajectory = param_json["trajectory"].get<std::string>();
+  }
 
+  phase.next("validate");
   if (!validate(param)) {
     return EXIT_FAILURE;
   }
 
-  std::vector<io::State> states;
-  if (!init(states, param)) {
+  phase.next("compute");
+  const auto format = io::to_format(args.format);
+  if (io::is_store(args.output) || (format == io::Format::binary && !io::is_stdio(args.output))) {
+    // The members are drawn into the mapping of the output without an intermediate copy
+    const auto filename = io::is_store(args.output)
+                              ? std::filesystem::path(args.output)
+                              : std::filesystem::path(args.output) /
+                                    io::ensemble_filename(param.name, 0, 0);
+    io::MappedEnsemble mapped;
+    if (!mapped.create(filename, param.name, param.N, param.k, 0, 0,
+                       args.force || io::is_store(args.output))) {
+      return EXIT_FAILURE;
+    }
+    if (!init(mapped.X(), param)) {
+      std::clog << "failed to initialize" << std::endl;
+      return EXIT_FAILURE;
+    }
+    phase.next("write_binary");
+    return mapped.close() ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  io::Ensemble ensemble;
+  if (!init(ensemble, param)) {
     std::clog << "failed to initialize" << std::endl;
     return EXIT_FAILURE;
   }
 
-  for (const auto &state : states) {
-    const auto &filename = std::filesystem::path(args.output) / io::state_filename(state);
-    if (!io::write_json(filename.string(), state, args.force)) {
-      return EXIT_FAILURE;
-    }
+  phase.next("write_" + args.format);
+  if (!io::write_states(args.output, ensemble, format, args.force)) {
+    return EXIT_FAILURE;
   }
 
   return EXIT_SUCCESS;
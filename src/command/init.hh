@@ -6,8 +6,13 @@
 #ifndef __DOUKA_COMMAND_INIT__
 #define __DOUKA_COMMAND_INIT__
 
+#include "common/ensemble.hh"
+#include "common/sampling.hh"
 #include "douka/io.hh"
 
+#include <Eigen/Core>
+
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <string_view>
@@ -23,6 +28,7 @@ inline static constexpr std::string_view description = "Provide initial distribu
 struct Args {
   std::vector<std::string> param;
   std::string output = "output";
+  std::string format = "json";
   bool force = false;
 };
 
@@ -31,10 +37,13 @@ struct Param {
   uint64_t seed;
   uint64_t N;
   uint64_t k;
-  std::vector<double> x0;
-  std::vector<double> V0;
+  std::vector<double> x0; // Required without trajectory
+  std::vector<double> V0; // Required without trajectory
+
+  std::string sampling = "random"; // Optional
+  std::string trajectory = {};     // Optional, series file the members are sampled from
 
-  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Param, name, seed, N, k, x0, V0);
+  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Param, name, seed, N, k);
 
   inline bool validate() const {
     if (name.empty()) {
@@ -47,13 +56,26 @@ struct Param {
       return false;
     }
 
+    // The members are states of the trajectory, x0, V0 and sampling are not used
+    if (!trajectory.empty()) {
+      return true;
+    }
+
     if (x0.size() != static_cast<std::size_t>(k)) {
       std::clog << "invalid size of x0 given " << x0.size() << " != " << k << std::endl;
       return false;
     }
 
-    if (V0.size() != static_cast<std::size_t>(k)) {
-      std::clog << "invalid size of V0 given " << V0.size() << " != " << k << std::endl;
+    if (V0.size() != static_cast<std::size_t>(k) && V0.size() != static_cast<std::size_t>(k * k)) {
+      std::clog << "invalid size of V0 given " << V0.size() << " != " << k << " or " << k * k
+                << std::endl;
+      return false;
+    }
+
+    if (std::find(std::begin(common::sampling::sampling_names),
+                  std::end(common::sampling::sampling_names),
+                  sampling) == std::end(common::sampling::sampling_names)) {
+      std::clog << "invalid sampling '" << sampling << "' given" << std::endl;
       return false;
     }
 
@@ -61,8 +83,34 @@ struct Param {
   }
 };
 
+/**
+ * @brief Sampling of a valid name, see Param::validate()
+ */
+inline common::sampling::Sampling to_sampling(const std::string_view &name) {
+  const auto it = std::find(std::begin(common::sampling::sampling_names),
+                            std::end(common::sampling::sampling_names), name);
+  return static_cast<common::sampling::Sampling>(it -
+                                                 std::begin(common::sampling::sampling_names));
+}
+
 Args get_args(const int argc, char const *const argv[]);
 bool validate(const Param &param);
+
+/**
+ * @brief Sample N states of the trajectory into the columns of X by reservoir sampling.
+ * The trajectory is read in a single pass holding a single state besides X, the skipped states
+ * are not read.
+ */
+bool climatology(Eigen::Ref<Eigen::MatrixXd> X, const Param &param);
+
+/**
+ * @brief Draw the members x0 + N(0, V0) into the columns of the k x N block X.
+ * The members are drawn in parallel, each from its own stream keyed by (seed, id), see
+ * common::compute::member_engine(). A full V0 is factorized once for all the members.
+ * With a trajectory given, the members are sampled from it instead, see climatology().
+ */
+bool init(Eigen::Ref<Eigen::MatrixXd> X, const Param &param);
+bool init(io::Ensemble &ensemble, const Param &param);
 bool init(std::vector<io::State> &states, const Param &param);
 int entry(const int argc, const char *const argv[]);
 } // namespace douka::command::init
@@ -6,10 +6,15 @@
 #include "obsgen.hh"
 #include "common/compute.hh"
 #include "common/io.hh"
+#include "common/parallel.hh"
+#include "common/profile.hh"
+#include "common/series.hh"
+#include "common/writer.hh"
 
 #include <Eigen/Core>
 #include <Eigen/QR>
 
+#include <algorithm>
 #include <cinttypes>
 #include <filesystem>
 #include <random>
@@ -26,6 +31,7 @@ static bool show_help(const int argc, char const *const argv[]) {
     os << "   --plugin          System model plugin" << std::endl;
     os << "   --plugin_option   (Opt) Plugin option json file" << std::endl;
     os << "   --output          (Opt) Output path (default='output')" << std::endl;
+    os << "   --format          (Opt) Output format [json|series] (default=json)" << std::endl;
     os << "   --force           (Opt) Overwrite existing file" << std::endl;
     os << "   --help            (Opt) Print help message" << std::endl;
   };
@@ -52,6 +58,7 @@ Args get_args(const int argc, char const *const argv[]) {
     plugin,
     plugin_param,
     output,
+    format,
   } ctx = Context::none;
 
   for (int i = 2; i < argc; i++) {
@@ -65,6 +72,8 @@ Args get_args(const int argc, char const *const argv[]) {
         ctx = Context::plugin_param;
       } else if (!strcmp(argv[i], "--output")) {
         ctx = Context::output;
+      } else if (!strcmp(argv[i], "--format")) {
+        ctx = Context::format;
       } else if (!strcmp(argv[i], "--force")) {
         args.force = true;
         ctx = Context::none;
@@ -92,6 +101,15 @@ Args get_args(const int argc, char const *const argv[]) {
         ctx = Context::none;
         break;
       }
+      case Context::format: {
+        if (std::find(std::begin(format_names), std::end(format_names), argv[i]) ==
+            std::end(format_names)) {
+          throw std::invalid_argument("unknown format '" + std::string{argv[i]} + "' given");
+        }
+        args.format = argv[i];
+        ctx = Context::none;
+        break;
+      }
       default:
         throw std::invalid_argument("invalid command '" + std::string{argv[i]} + "' given");
       }
@@ -118,12 +136,10 @@ bool validate(const Param &param) {
   return true;
 }
 
-bool obsgen(std::vector<io::Obs> &observations, const Param &param,
-            const PluginInterface::SharedPtr plugin) {
+bool obsgen(const Param &param, const PluginInterface::SharedPtr plugin,
+            const std::function<bool(io::Obs &&)> &sink) {
   static std::default_random_engine engine{static_cast<unsigned>(param.seed)};
 
-  observations.resize(param.t + 1);
-
   Eigen::MatrixXd H;
   if (param.H.empty()) {
     H = Eigen::MatrixXd::Identity(param.l, param.k);
@@ -136,26 +152,68 @@ bool obsgen(std::vector<io::Obs> &observations, const Param &param,
   auto x = Eigen::Map<Eigen::VectorXd>(x_data.data(), x_data.size());
   const std::vector<double> zeros(param.k, 0.0);
 
-  int64_t t = 0;
-  for (auto &obs : observations) {
+  for (int64_t t = 0; t <= static_cast<int64_t>(param.t); t++) {
     plugin->sys_tim = t;
 
-    obs.name = param.name;
-    obs.obs_tim = t;
-    obs.y.resize(param.l);
+    io::Obs obs{param.name, t, std::vector<double>(param.l)};
     auto y = Eigen::Map<Eigen::VectorXd>{obs.y.data(), static_cast<Eigen::Index>(obs.y.size())};
 
     y = H * x;
 
+    if (!sink(std::move(obs))) {
+      return false;
+    }
     if (!plugin->predict(x_data, zeros)) {
       return false;
     }
-    t++;
   }
 
   return true;
 }
 
+bool obsgen(std::vector<io::Obs> &observations, const Param &param,
+            const PluginInterface::SharedPtr plugin) {
+  observations.clear();
+  observations.reserve(param.t + 1);
+  return obsgen(param, plugin, [&observations](io::Obs &&obs) {
+    observations.emplace_back(std::move(obs));
+    return true;
+  });
+}
+
+// Generate the observations of a truth into the output directory.
+// Each observation is queued to the writer as soon as it is generated, the bounded queue of the
+// writer keeps the generation from running ahead of the disk.
+static bool generate(const Args &args, const Param &param, const PluginInterface::SharedPtr plugin,
+                     const std::filesystem::path &output) {
+  if (args.format == "series") {
+    io::ObsSeriesWriter writer;
+    if (!writer.open(output / io::obs_series_filename(param.name), param.name, args.force)) {
+      return false;
+    }
+    // A single worker appends the records in the order of obs_tim
+    io::FileWorkers workers{1};
+    const bool generated = obsgen(param, plugin, [&](io::Obs &&obs) {
+      const auto obs_tim = obs.obs_tim;
+      return workers.submit(obs_tim,
+                            [&writer, obs = std::move(obs)] { return writer.append(obs); });
+    });
+    // A series cut short by a failure is not left behind as a shorter one
+    if (!workers.wait() || !generated) {
+      writer.discard();
+      return false;
+    }
+    return writer.close();
+  }
+
+  io::AsyncWriter writer;
+  const bool generated = obsgen(param, plugin, [&](io::Obs &&obs) {
+    return writer.write(output / io::obs_filename(obs), nlohmann::json(obs).dump(2) + "\n",
+                        args.force);
+  });
+  return writer.wait() && generated;
+}
+
 int entry(const int argc, const char *const argv[]) {
   if (show_help(argc, argv)) {
     return EXIT_SUCCESS;
@@ -167,14 +225,16 @@ int entry(const int argc, const char *const argv[]) {
   }
 
   /* Parse filename */
+  common::profile::Phase phase{"parse_filename"};
   std::vector<std::string> param_filenames;
   for (const auto &param : args.param) {
-    if (!io::parse_filename(param, param_filenames)) {
+    if (!io::parse_filename(param, param_filenames, io::layout())) {
       return EXIT_FAILURE;
     }
   }
 
   /* filename -> json */
+  phase.next("read_json");
   nlohmann::json param_json;
   for (const auto &filename : param_filenames) {
     if (!io::read_json(filename, param_json)) {
@@ -184,9 +244,18 @@ int entry(const int argc, const char *const argv[]) {
   param_filenames.clear();
 
   /* json -> object */
+  phase.next("json_to_object");
   Param param;
   try {
+    // A list of initial conditions gives a truth for each of them
+    std::vector<std::vector<double>> truths;
+    if (param_json.contains("x0") && param_json["x0"].is_array() && !param_json["x0"].empty() &&
+        param_json["x0"].front().is_array()) {
+      truths = param_json["x0"].get<std::vector<std::vector<double>>>();
+      param_json["x0"] = truths.front();
+    }
     param = param_json;
+    param.truths = std::move(truths);
   } catch (const nlohmann::json::exception &e) {
     std::clog << e.what() << std::endl;
     return EXIT_FAILURE;
@@ -195,15 +264,18 @@ int entry(const int argc, const char *const argv[]) {
     param.H = param_json["H"].get<std::vector<double>>();
   }
 
+  phase.next("validate");
   if (!validate(param)) {
     return EXIT_FAILURE;
   }
 
   /* Load plugin */
+  phase.next("load_plugin");
   PluginInterface::SharedPtr plugin;
+  std::filesystem::path plugin_name;
   try {
-    const auto plugin_name = io::is_plugin(args.plugin) ? std::filesystem::path(args.plugin)
-                                                        : io::find_plugin(args.plugin);
+    plugin_name = io::is_plugin(args.plugin) ? std::filesystem::path(args.plugin)
+                                             : io::find_plugin(args.plugin);
     plugin = io::load_plugin(plugin_name);
   } catch (const std::runtime_error &e) {
     std::clog << e.what() << std::endl;
@@ -219,18 +291,43 @@ int entry(const int argc, const char *const argv[]) {
     return EXIT_FAILURE;
   }
 
-  std::vector<io::Obs> observations;
-  if (!obsgen(observations, param, plugin)) {
-    return EXIT_FAILURE;
+  phase.next("compute");
+  if (param.truths.empty()) {
+    return generate(args, param, plugin, args.output) ? EXIT_SUCCESS : EXIT_FAILURE;
   }
 
-  for (const auto &obs : observations) {
-    const auto &filename = std::filesystem::path(args.output) / io::obs_filename(obs);
-    if (!io::write_json(filename, obs, args.force)) {
+  // The truths are integrated concurrently by an instance of the plugin per thread, if the
+  // plugin allows it
+  const auto n = static_cast<int64_t>(param.truths.size());
+  const auto threads =
+      io::is_concurrent_plugin(plugin_name) ? std::min(common::compute_threads(), n) : int64_t{1};
+  std::vector<PluginInterface::SharedPtr> plugins{plugin};
+  for (int64_t i = 1; i < threads; ++i) {
+    try {
+      plugins.emplace_back(io::load_plugin(plugin_name));
+    } catch (const std::runtime_error &e) {
+      std::clog << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    plugins.back()->ctx = PluginInterface::context::obsgen;
+    if (!plugins.back()->set_option(args.plugin_param)) {
       return EXIT_FAILURE;
     }
   }
-
-  return EXIT_SUCCESS;
+  const bool generated = common::parallel_for(
+      n,
+      [&](const int64_t i, const int64_t thread) {
+        Param truth = param;
+        truth.x0 = param.truths[i];
+        truth.truths.clear();
+        const auto output = std::filesystem::path(args.output) / truth_directory(i);
+        if (!std::filesystem::exists(output) && !std::filesystem::create_directories(output)) {
+          return false;
+        }
+        plugins[thread]->id = i;
+        return generate(args, truth, plugins[thread], output);
+      },
+      threads);
+  return generated ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 } // namespace douka::command::obsgen
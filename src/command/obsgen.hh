@@ -6,9 +6,12 @@
 #ifndef __DOUKA_COMMAND_OBSGEN__
 #define __DOUKA_COMMAND_OBSGEN__
 
-#include "douka/io.hh"
+#include "common/io.hh"
 #include "douka/plugin_interface.hh"
 
+#include <functional>
+#include <iomanip>
+#include <sstream>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -24,9 +27,12 @@ struct Args {
   std::string plugin;
   std::string plugin_param;
   std::string output = "output";
+  std::string format = "json"; // json: one file per time, series: a single indexed file
   bool force = false;
 };
 
+inline static constexpr std::string_view format_names[] = {"json", "series"};
+
 struct Param {
   std::string name;
   uint64_t seed;
@@ -34,7 +40,8 @@ struct Param {
   uint64_t k;
   uint64_t l;
   std::vector<double> x0;
-  std::vector<double> H; // Optional
+  std::vector<double> H;                        // Optional
+  std::vector<std::vector<double>> truths = {}; // Optional, x0 of each truth given as a list
 
   NLOHMANN_DEFINE_TYPE_INTRUSIVE(Param, name, seed, t, k, l, x0);
 
@@ -64,6 +71,14 @@ struct Param {
       return false;
     }
 
+    for (std::size_t i = 0; i < truths.size(); ++i) {
+      if (truths[i].size() != static_cast<std::size_t>(k)) {
+        std::clog << "invalid size of x0 of the truth " << i << " given " << truths[i].size()
+                  << " != " << k << std::endl;
+        return false;
+      }
+    }
+
     if (!H.empty() && H.size() != static_cast<std::size_t>(k * l)) {
       std::clog << "invalid size of H given " << H.size() << " != " << k * l << std::endl;
       return false;
@@ -73,8 +88,25 @@ struct Param {
   }
 };
 
+/**
+ * @brief Output directory of a truth under the output path, given x0 as a list
+ */
+inline std::string truth_directory(const int64_t truth) {
+  std::stringstream ss;
+  ss << "truth_" << std::setfill('0') << std::setw(io::layout().id_width) << truth;
+  return ss.str();
+}
+
 Args get_args(const int argc, const char *const argv[]);
 bool validate(const Param &param);
+
+/**
+ * @brief Generate the observations of time 0 to t one after another.
+ * Each observation is passed to the sink as soon as it is computed, so that the memory does not
+ * grow with t and the consumer can write it while the next one is generated.
+ */
+bool obsgen(const Param &param, const PluginInterface::SharedPtr plugin,
+            const std::function<bool(io::Obs &&)> &sink);
 bool obsgen(std::vector<io::Obs> &observations, const Param &param,
             const PluginInterface::SharedPtr plugin);
 int entry(const int argc, const char *const argv[]);
@@ -0,0 +1,570 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "obsprep.hh"
+#include "common/ensemble.hh"
+#include "common/io.hh"
+#include "common/parallel.hh"
+#include "common/profile.hh"
+#include "common/series.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <numeric>
+#include <unordered_map>
+
+namespace douka::command::obsprep {
+static bool show_help(const int argc, char const *const argv[]) {
+  static const auto &show_help = [argv](std::ostream &os) {
+    os << argv[0] << " " << argv[1] << " [Options]" << std::endl;
+    os << "Description:" << std::endl;
+    os << "   " << description << std::endl;
+    os << std::endl;
+    os << "Options:" << std::endl;
+    os << "   --param       Input parameter json files" << std::endl;
+    os << "   --obs         Input observation json file or series:<file>@<obs_tim>" << std::endl;
+    os << "   --state       (Opt) Input state vector json file or binary ensemble, required by "
+          "gross_error"
+       << std::endl;
+    os << "   --output      (Opt) Output path (default='output')" << std::endl;
+    os << "   --force       (Opt) Overwrite existing file" << std::endl;
+    os << "   --help        (Opt) Print help message" << std::endl;
+  };
+
+  if (argc <= 2) {
+    show_help(std::cout);
+    throw std::invalid_argument("no option given");
+  }
+
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--help")) {
+      show_help(std::cout);
+      return true;
+    }
+  }
+  return false;
+}
+
+Args get_args(const int argc, const char *const argv[]) {
+  Args args;
+  enum class Context {
+    none = 0,
+    state,
+    param,
+    obs,
+    output,
+  } ctx = Context::none;
+
+  for (int i = 2; i < argc; i++) {
+    if (!strncmp(argv[i], "--", 2)) {
+      ctx = Context::none;
+      if (!strcmp(argv[i], "--state")) {
+        ctx = Context::state;
+      } else if (!strcmp(argv[i], "--param")) {
+        ctx = Context::param;
+      } else if (!strcmp(argv[i], "--obs")) {
+        ctx = Context::obs;
+      } else if (!strcmp(argv[i], "--output")) {
+        ctx = Context::output;
+      } else if (!strcmp(argv[i], "--force")) {
+        args.force = true;
+        ctx = Context::none;
+      } else {
+        throw std::invalid_argument("unknown option '" + std::string{argv[i]} + "' given");
+      }
+    } else {
+      switch (ctx) {
+      case Context::state: {
+        args.state = argv[i];
+        ctx = Context::none;
+        break;
+      }
+      case Context::param: {
+        args.param.emplace_back(argv[i]);
+        break;
+      }
+      case Context::obs: {
+        args.obs = argv[i];
+        ctx = Context::none;
+        break;
+      }
+      case Context::output: {
+        args.output = argv[i];
+        ctx = Context::none;
+        break;
+      }
+      default:
+        throw std::invalid_argument("invalid command '" + std::string{argv[i]} + "' given");
+      }
+    }
+  }
+  if (ctx != Context::none) {
+    throw std::invalid_argument("required option for '" + std::string{argv[argc - 1]} +
+                                "' not given");
+  }
+  if (args.param.empty()) {
+    throw std::invalid_argument("required option '--param' not given");
+  }
+  if (args.obs.empty()) {
+    throw std::invalid_argument("required option '--obs' not given");
+  }
+  return args;
+}
+
+namespace {
+using RowMajorMatrixXd = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+using Cell = std::array<int64_t, max_dimensions>;
+
+struct CellHash {
+  std::size_t operator()(const Cell &cell) const {
+    std::size_t seed = 0;
+    for (const auto index : cell) {
+      seed ^= std::hash<int64_t>{}(index) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+  }
+};
+
+// Cell of the grid of the given spacing containing the observation i
+Cell cell_of(const Eigen::Ref<const Eigen::MatrixXd> &coords, const int64_t i,
+             const std::vector<double> &spacing) {
+  Cell cell{};
+  for (std::size_t d = 0; d < spacing.size(); ++d) {
+    cell[d] = static_cast<int64_t>(std::floor(coords(i, d) / spacing[d]));
+  }
+  return cell;
+}
+} // namespace
+
+std::vector<int64_t> check_gross_error(const Eigen::Ref<const Eigen::VectorXd> &y,
+                                       const Eigen::Ref<const Eigen::MatrixXd> &HX,
+                                       const Eigen::Ref<const Eigen::VectorXd> &R_diag,
+                                       const double threshold) {
+  const auto N = HX.cols();
+  const Eigen::VectorXd mean = HX.rowwise().mean();
+  Eigen::VectorXd var = Eigen::VectorXd::Zero(HX.rows());
+  if (N > 1) {
+    var = (HX.colwise() - mean).rowwise().squaredNorm() / static_cast<double>(N - 1);
+  }
+  const Eigen::ArrayXd bound = threshold * (R_diag + var).array().sqrt();
+  const Eigen::ArrayXd innovation = (y - mean).array().abs();
+
+  std::vector<int64_t> indices;
+  indices.reserve(y.size());
+  for (Eigen::Index i = 0; i < y.size(); ++i) {
+    if (innovation(i) <= bound(i)) {
+      indices.push_back(i);
+    }
+  }
+  return indices;
+}
+
+std::vector<int64_t> thin(const Eigen::Ref<const Eigen::MatrixXd> &coords,
+                          const std::vector<int64_t> &indices, const std::vector<double> &spacing) {
+  if (spacing.empty()) {
+    return indices;
+  }
+  const auto n = static_cast<int64_t>(indices.size());
+  // Distance of each observation to the center of its cell, the nearest one is kept, the first
+  // of them on a tie
+  std::vector<double> distance(n);
+  std::unordered_map<Cell, int64_t, CellHash> nearest;
+  nearest.reserve(n);
+  for (int64_t p = 0; p < n; ++p) {
+    const auto i = indices[p];
+    const auto cell = cell_of(coords, i, spacing);
+    double squared = 0.0;
+    for (std::size_t d = 0; d < spacing.size(); ++d) {
+      const auto offset = coords(i, d) - (static_cast<double>(cell[d]) + 0.5) * spacing[d];
+      squared += offset * offset;
+    }
+    distance[p] = squared;
+    const auto [it, inserted] = nearest.try_emplace(cell, p);
+    if (!inserted && squared < distance[it->second]) {
+      it->second = p;
+    }
+  }
+
+  std::vector<char> kept(n, 0);
+  for (const auto &[cell, p] : nearest) {
+    kept[p] = 1;
+  }
+  std::vector<int64_t> result;
+  result.reserve(nearest.size());
+  for (int64_t p = 0; p < n; ++p) {
+    if (kept[p]) {
+      result.push_back(indices[p]);
+    }
+  }
+  return result;
+}
+
+Groups superob(const Eigen::Ref<const Eigen::MatrixXd> &coords, const std::vector<int64_t> &indices,
+               const std::vector<double> &spacing) {
+  const auto n = static_cast<int64_t>(indices.size());
+  Groups groups;
+  groups.index.reserve(n);
+  if (spacing.empty()) {
+    groups.begin.resize(n + 1);
+    std::iota(groups.begin.begin(), groups.begin.end(), int64_t{0});
+    groups.index = indices;
+    return groups;
+  }
+
+  // Group of each observation, numbered in the order of the first observation of the cell
+  std::vector<int64_t> group(n);
+  std::unordered_map<Cell, int64_t, CellHash> cells;
+  cells.reserve(n);
+  for (int64_t p = 0; p < n; ++p) {
+    const auto next_group = static_cast<int64_t>(cells.size());
+    const auto [it, inserted] = cells.try_emplace(cell_of(coords, indices[p], spacing), next_group);
+    group[p] = it->second;
+  }
+
+  // Counting sort of the observations by the group, stable in the order of the indices
+  groups.begin.assign(cells.size() + 1, 0);
+  for (const auto g : group) {
+    groups.begin[g + 1]++;
+  }
+  std::partial_sum(groups.begin.begin(), groups.begin.end(), groups.begin.begin());
+  std::vector<int64_t> next(groups.begin.begin(), groups.begin.end() - 1);
+  groups.index.resize(n);
+  for (int64_t p = 0; p < n; ++p) {
+    groups.index[next[group[p]]++] = indices[p];
+  }
+  return groups;
+}
+
+bool obsprep(const Param &param, const io::Obs &obs, const Eigen::MatrixXd *X, Result &result) {
+  if (!param.validate() || !obs.validate()) {
+    return false;
+  }
+  if (static_cast<std::size_t>(param.l) != obs.y.size()) {
+    std::clog << "invalid observation size " << obs.y.size() << " != " << param.l << std::endl;
+    return false;
+  }
+  if (param.name != obs.name) {
+    std::clog << "invalid name" << std::endl;
+    return false;
+  }
+  if (param.gross_error > 0.0 && X == nullptr) {
+    std::clog << "states required by the gross error check not given" << std::endl;
+    return false;
+  }
+  if (X != nullptr && X->rows() != param.k) {
+    std::clog << "invalid state size " << X->rows() << " != " << param.k << std::endl;
+    return false;
+  }
+
+  const auto l = param.l;
+  const auto k = param.k;
+  const bool is_H_identity = param.H.empty();
+  const bool is_R_diagonal = param.R.size() == static_cast<std::size_t>(l);
+  const Eigen::Map<const Eigen::VectorXd> y{obs.y.data(), l};
+  const Eigen::Map<const RowMajorMatrixXd> H{param.H.data(), is_H_identity ? 0 : l,
+                                             is_H_identity ? 0 : k};
+  const Eigen::Map<const RowMajorMatrixXd> R{param.R.data(), l, is_R_diagonal ? 1 : l};
+
+  common::profile::Phase phase{"gross_error"};
+  std::vector<int64_t> indices(l);
+  std::iota(indices.begin(), indices.end(), int64_t{0});
+  if (param.gross_error > 0.0) {
+    const Eigen::VectorXd R_diag = is_R_diagonal ? Eigen::VectorXd(R.col(0))
+                                                 : Eigen::VectorXd(R.diagonal());
+    if (is_H_identity) {
+      indices = check_gross_error(y, X->topRows(l), R_diag, param.gross_error);
+    } else {
+      indices = check_gross_error(y, H * *X, R_diag, param.gross_error);
+    }
+  }
+
+  phase.next("thin");
+  const auto dimensions = param.dimensions();
+  const Eigen::MatrixXd coords =
+      Eigen::Map<const RowMajorMatrixXd>{param.coords.data(), dimensions > 0 ? l : 0, dimensions};
+  const auto kept = thin(coords, indices, param.thin);
+
+  phase.next("superob");
+  const auto groups = superob(coords, kept, param.superob);
+  const auto reduced = groups.size();
+  if (reduced == 0) {
+    std::clog << "no observation left of " << l << std::endl;
+    return false;
+  }
+  result.rejected = l - static_cast<int64_t>(indices.size());
+  result.thinned = static_cast<int64_t>(indices.size() - kept.size());
+
+  // Each reduced observation is the average of its group, A has 1/n at the members of the group
+  result.obs = io::Obs{obs.name, obs.obs_tim, std::vector<double>(reduced)};
+  result.H.assign(is_H_identity ? 0 : reduced * k, 0.0);
+  result.coords.assign(reduced * dimensions, 0.0);
+  result.R.assign(is_R_diagonal ? reduced : reduced * reduced, 0.0);
+  RowMajorMatrixXd AR;
+  if (!is_R_diagonal) {
+    AR.setZero(reduced, l);
+  }
+  const bool averaged = common::parallel_for(reduced, [&](const int64_t a, const int64_t) {
+    const auto *members = groups.index.data() + groups.begin[a];
+    const auto n = groups.begin[a + 1] - groups.begin[a];
+    const auto weight = 1.0 / static_cast<double>(n);
+    double y_sum = 0.0, R_sum = 0.0;
+    for (int64_t m = 0; m < n; ++m) {
+      const auto i = members[m];
+      y_sum += y(i);
+      if (!is_H_identity) {
+        Eigen::Map<Eigen::RowVectorXd>{result.H.data() + a * k, k} += weight * H.row(i);
+      }
+      for (int64_t d = 0; d < dimensions; ++d) {
+        result.coords[a * dimensions + d] += weight * coords(i, d);
+      }
+      if (is_R_diagonal) {
+        R_sum += R(i, 0);
+      } else {
+        AR.row(a) += weight * R.row(i);
+      }
+    }
+    result.obs.y[a] = weight * y_sum;
+    if (is_R_diagonal) {
+      result.R[a] = weight * weight * R_sum;
+    }
+    return true;
+  });
+  if (!averaged) {
+    return false;
+  }
+  result.groups = groups;
+  if (!is_R_diagonal) {
+    // R' = (A R) A^T, the column b is the average of the columns of its group
+    Eigen::Map<RowMajorMatrixXd> R_reduced{result.R.data(), reduced, reduced};
+    for (int64_t b = 0; b < reduced; ++b) {
+      const auto weight = 1.0 / static_cast<double>(groups.begin[b + 1] - groups.begin[b]);
+      for (auto m = groups.begin[b]; m < groups.begin[b + 1]; ++m) {
+        R_reduced.col(b) += weight * AR.col(groups.index[m]);
+      }
+    }
+  }
+  return true;
+}
+
+bool merge_blocks(nlohmann::json &param_json) {
+  if (!param_json.contains("blocks") || !param_json["blocks"].is_array()) {
+    return true;
+  }
+  if ((param_json.contains("R") && !param_json["R"].is_null()) ||
+      (param_json.contains("H") && !param_json["H"].is_null())) {
+    std::clog << "R and H should be given by the blocks" << std::endl;
+    return false;
+  }
+
+  struct Block {
+    int64_t l;
+    std::vector<double> R, H;
+  };
+  std::vector<Block> blocks;
+  int64_t l = 0;
+  bool is_R_diagonal = true;
+  try {
+    for (const auto &block_json : param_json["blocks"]) {
+      Block block{block_json.value("l", int64_t{0}), block_json.value("R", std::vector<double>{}),
+                  block_json.value("H", std::vector<double>{})};
+      if (block.l <= 0) {
+        std::clog << "invalid size of block given " << block.l << std::endl;
+        return false;
+      }
+      if (!blocks.empty() && block.H.empty() != blocks.front().H.empty()) {
+        std::clog << "H should be given for all the blocks or none" << std::endl;
+        return false;
+      }
+      is_R_diagonal &= block.R.size() != static_cast<std::size_t>(block.l * block.l) ||
+                       block.l == 1;
+      l += block.l;
+      blocks.emplace_back(std::move(block));
+    }
+  } catch (const nlohmann::json::exception &e) {
+    std::clog << "failed to parse blocks " << e.what() << std::endl;
+    return false;
+  }
+
+  // A block without R is of no error, as the filter takes it
+  std::vector<double> R(is_R_diagonal ? l : l * l, 0.0), H;
+  int64_t offset = 0;
+  for (const auto &block : blocks) {
+    const auto is_block_diagonal =
+        block.R.size() != static_cast<std::size_t>(block.l * block.l) || block.l == 1;
+    if (!block.R.empty() && block.R.size() != static_cast<std::size_t>(block.l) &&
+        block.R.size() != static_cast<std::size_t>(block.l * block.l)) {
+      std::clog << "invalid size of R of block given " << block.R.size() << " != " << block.l
+                << " or " << block.l * block.l << std::endl;
+      return false;
+    }
+    for (int64_t i = 0; i < block.l && !block.R.empty(); ++i) {
+      for (int64_t j = 0; j < (is_block_diagonal ? 1 : block.l); ++j) {
+        const auto value = block.R[is_block_diagonal ? i : i * block.l + j];
+        if (is_R_diagonal) {
+          R[offset + i] = value;
+        } else {
+          R[(offset + i) * l + offset + (is_block_diagonal ? i : j)] = value;
+        }
+      }
+    }
+    H.insert(H.end(), block.H.begin(), block.H.end());
+    offset += block.l;
+  }
+  param_json["R"] = R;
+  if (!H.empty()) {
+    param_json["H"] = H;
+  }
+  param_json.erase("blocks");
+  return true;
+}
+
+nlohmann::json reduced_param(const Result &result, const bool blocks) {
+  nlohmann::json reduced = {{"l", result.obs.y.size()}, {"R", result.R}};
+  if (result.H.empty()) {
+    // Row a of A [I 0] averages the states of the group a
+    const auto &groups = result.groups;
+    std::vector<double> value(groups.index.size());
+    for (int64_t a = 0; a < groups.size(); ++a) {
+      const auto n = groups.begin[a + 1] - groups.begin[a];
+      std::fill_n(value.begin() + groups.begin[a], n, 1.0 / static_cast<double>(n));
+    }
+    reduced["H_sparse"] = {{"begin", groups.begin}, {"index", groups.index}, {"value", value}};
+  } else {
+    reduced["H"] = result.H;
+  }
+  if (!result.coords.empty()) {
+    reduced["coords"] = result.coords;
+  }
+  if (blocks) {
+    // The reduced observations are a single block, as the averages mix the blocks
+    reduced["blocks"] = nullptr;
+  }
+  return reduced;
+}
+
+int entry(const int argc, const char *const argv[]) {
+  if (show_help(argc, argv)) {
+    return EXIT_SUCCESS;
+  }
+  const auto args = get_args(argc, argv);
+
+  if (!io::create_output_directory(args.output)) {
+    return EXIT_FAILURE;
+  }
+
+  /* Parse filename */
+  common::profile::Phase phase{"parse_filename"};
+  std::vector<std::string> param_filenames;
+  for (const auto &param : args.param) {
+    if (!io::parse_filename(param, param_filenames, io::layout())) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* filename -> json */
+  phase.next("read_json");
+  nlohmann::json obs_json, param_json;
+  const bool is_obs_series = io::is_obs_series(args.obs);
+  if (!is_obs_series && !io::read_json(args.obs, obs_json)) {
+    return EXIT_FAILURE;
+  }
+  for (const auto &param_filename : param_filenames) {
+    if (!io::read_json(param_filename, param_json)) {
+      return EXIT_FAILURE;
+    }
+  }
+  param_filenames.clear();
+
+  /* json -> object */
+  phase.next("json_to_object");
+  Param param;
+  io::Obs obs;
+  if (is_obs_series) {
+    if (!io::read_obs_series(args.obs, obs)) {
+      return EXIT_FAILURE;
+    }
+  } else {
+    try {
+      obs = obs_json;
+    } catch (const nlohmann::json::exception &e) {
+      std::clog << "failed to parse obs json " << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  const bool blocks = param_json.contains("blocks") && param_json["blocks"].is_array();
+  if (!merge_blocks(param_json)) {
+    return EXIT_FAILURE;
+  }
+  try {
+    param = param_json;
+    if (param_json.contains("H") && param_json["H"].is_array()) {
+      param.H = param_json["H"].get<std::vector<double>>();
+    }
+    if (param_json.contains("coords") && param_json["coords"].is_array()) {
+      param.coords = param_json["coords"].get<std::vector<double>>();
+    }
+    if (param_json.contains("gross_error") && param_json["gross_error"].is_number()) {
+      param.gross_error = param_json["gross_error"].get<double>();
+    }
+    if (param_json.contains("thin") && param_json["thin"].is_array()) {
+      param.thin = param_json["thin"].get<std::vector<double>>();
+    }
+    if (param_json.contains("superob") && param_json["superob"].is_array()) {
+      param.superob = param_json["superob"].get<std::vector<double>>();
+    }
+  } catch (const nlohmann::json::exception &e) {
+    std::clog << "failed to parse param json " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  phase.next("validate");
+  if (!param.validate()) {
+    return EXIT_FAILURE;
+  }
+
+  // The states are only read for the gross error check
+  io::Ensemble ensemble;
+  Eigen::MatrixXd X;
+  if (param.gross_error > 0.0) {
+    if (args.state.empty()) {
+      std::clog << "required option '--state' not given for gross_error" << std::endl;
+      return EXIT_FAILURE;
+    }
+    phase.next("read_states");
+    if (!io::read_states(args.state, ensemble) || !ensemble.validate()) {
+      return EXIT_FAILURE;
+    }
+    if (ensemble.name != param.name || ensemble.sys_tim != obs.obs_tim) {
+      std::clog << "invalid states of " << ensemble.name << " at sys_tim " << ensemble.sys_tim
+                << " given" << std::endl;
+      return EXIT_FAILURE;
+    }
+    X = Eigen::Map<const Eigen::MatrixXd>{ensemble.X.data(), ensemble.k, ensemble.N};
+    ensemble.X.clear();
+  }
+
+  phase.next("compute");
+  Result result;
+  if (!obsprep(param, obs, param.gross_error > 0.0 ? &X : nullptr, result)) {
+    return EXIT_FAILURE;
+  }
+
+  phase.next("write_json");
+  const std::filesystem::path output = args.output;
+  if (!io::write_json(output / io::obs_filename(result.obs), result.obs, args.force) ||
+      !io::write_json(output / param_filename(result.obs), reduced_param(result, blocks),
+                      args.force)) {
+    return EXIT_FAILURE;
+  }
+
+  auto &log = io::is_stdio(args.output) ? std::clog : std::cout;
+  log << "obsprep: " << param.l << " -> " << result.obs.y.size() << " observations, "
+      << result.rejected << " rejected, " << result.thinned << " thinned" << std::endl;
+  return EXIT_SUCCESS;
+}
+} // namespace douka::command::obsprep
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMAND_OBSPREP__
+#define __DOUKA_COMMAND_OBSPREP__
+
+#include "douka/io.hh"
+
+#include <Eigen/Core>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace douka::command::obsprep {
+inline static constexpr std::string_view name = "obsprep";
+inline static constexpr std::string_view description =
+    "Quality control, thin and super-ob observation data";
+
+struct Args {
+  std::string state; // Optional, required by the gross error check
+  std::vector<std::string> param;
+  std::string obs;
+  std::string output = "output";
+  bool force = false;
+};
+
+// Observations are located in up to 3 dimensions
+inline static constexpr int64_t max_dimensions = 3;
+
+struct Param {
+  std::string name;
+  int64_t k;
+  int64_t l;
+  std::vector<double> R; // l or l x l
+
+  std::vector<double> H = {};       // Optional, l x k
+  std::vector<double> coords = {};  // Optional, l x dimensions locations of the observations
+  double gross_error = 0.0;         // Optional, innovation threshold in standard deviations
+  std::vector<double> thin = {};    // Optional, grid spacing of the thinning per dimension
+  std::vector<double> superob = {}; // Optional, grid spacing of the super-obs per dimension
+
+  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Param, name, k, l, R);
+
+  inline int64_t dimensions() const {
+    return static_cast<int64_t>(thin.empty() ? superob.size() : thin.size());
+  }
+
+  inline bool validate() const {
+    if (name.empty()) {
+      std::clog << "no name given" << std::endl;
+      return false;
+    }
+    if (k == 0) {
+      std::clog << "no state size given" << std::endl;
+      return false;
+    }
+    if (l == 0) {
+      std::clog << "no observation size given" << std::endl;
+      return false;
+    }
+    if (R.size() != static_cast<std::size_t>(l) && R.size() != static_cast<std::size_t>(l * l)) {
+      std::clog << "invalid size of R given " << R.size() << " != " << l << " or " << l * l
+                << std::endl;
+      return false;
+    }
+    if (!H.empty() && H.size() != static_cast<std::size_t>(k * l)) {
+      std::clog << "invalid size of H given " << H.size() << " != " << k * l << std::endl;
+      return false;
+    }
+    if (H.empty() && l > k) {
+      std::clog << "H is required to observe " << l << " > " << k << " states" << std::endl;
+      return false;
+    }
+    if (!(gross_error >= 0.0)) {
+      std::clog << "invalid gross_error " << gross_error << " given" << std::endl;
+      return false;
+    }
+    if (!thin.empty() && !superob.empty() && thin.size() != superob.size()) {
+      std::clog << "thin and superob of different dimensions given" << std::endl;
+      return false;
+    }
+    const auto d = dimensions();
+    if (d > max_dimensions) {
+      std::clog << "invalid dimensions " << d << " > " << max_dimensions << " given" << std::endl;
+      return false;
+    }
+    for (const auto &spacing : {thin, superob}) {
+      for (const auto dx : spacing) {
+        if (!(dx > 0.0)) {
+          std::clog << "invalid grid spacing " << dx << " given" << std::endl;
+          return false;
+        }
+      }
+    }
+    if (d > 0 && coords.size() != static_cast<std::size_t>(l * d)) {
+      std::clog << "invalid size of coords given " << coords.size() << " != " << l * d
+                << std::endl;
+      return false;
+    }
+    if (!std::all_of(coords.begin(), coords.end(),
+                     [](const double x) { return std::isfinite(x); })) {
+      std::clog << "non-finite coords given" << std::endl;
+      return false;
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief Reduced observations, each the average of a group of the given observations.
+ * The groups are given in CSR form, the group i consists of the observations
+ * index[begin[i]] to index[begin[i + 1] - 1].
+ */
+struct Groups {
+  std::vector<int64_t> begin = {0};
+  std::vector<int64_t> index;
+
+  inline int64_t size() const { return static_cast<int64_t>(begin.size()) - 1; }
+};
+
+/**
+ * @brief Observations given and reduced by obsprep
+ */
+struct Result {
+  io::Obs obs;
+  std::vector<double> R;      // l' or l' x l' as given by the param
+  std::vector<double> H;      // l' x k, empty if no H is given
+  Groups groups;              // of the given observations, averaged into each of the l'
+  std::vector<double> coords; // l' x dimensions
+  int64_t rejected = 0;       // by the gross error check
+  int64_t thinned = 0;        // removed by the thinning
+};
+
+/**
+ * @brief Path of the parameters of the reduced observations relative to the output, which
+ * override l, R, H and blocks of the filter parameters
+ */
+inline std::string param_filename(const io::Obs &obs) {
+  std::stringstream ss;
+  ss << obs.name << "_obsprep_";
+  ss << std::setfill('0') << std::setw(6) << obs.obs_tim << ".json";
+  return ss.str();
+}
+
+Args get_args(const int argc, const char *const argv[]);
+
+/**
+ * @brief Replace the blocks of the filter parameters by R and H of all the observations,
+ * R the block diagonal of the R of the blocks and H the stack of their H (all or none)
+ */
+bool merge_blocks(nlohmann::json &param_json);
+
+/**
+ * @brief Parameters of the reduced observations overriding those of the filter. An identity H
+ * is averaged into a sparse H_sparse of the groups, instead of a dense l' x k H.
+ */
+nlohmann::json reduced_param(const Result &result, const bool blocks);
+
+/**
+ * @brief Observations passing the gross error check |y - mean(HX)| <= threshold *
+ * sqrt(R_ii + var(HX)_i), in ascending order
+ */
+std::vector<int64_t> check_gross_error(const Eigen::Ref<const Eigen::VectorXd> &y,
+                                       const Eigen::Ref<const Eigen::MatrixXd> &HX,
+                                       const Eigen::Ref<const Eigen::VectorXd> &R_diag,
+                                       const double threshold);
+
+/**
+ * @brief Observations of the indices kept by the thinning, the one nearest to the center of
+ * each grid cell, in ascending order. coords is l x dimensions.
+ */
+std::vector<int64_t> thin(const Eigen::Ref<const Eigen::MatrixXd> &coords,
+                          const std::vector<int64_t> &indices, const std::vector<double> &spacing);
+
+/**
+ * @brief Observations of the indices grouped by the grid cell, in the order of the first
+ * observation of each cell
+ */
+Groups superob(const Eigen::Ref<const Eigen::MatrixXd> &coords, const std::vector<int64_t> &indices,
+               const std::vector<double> &spacing);
+
+/**
+ * @brief Gross error check against the ensemble mean (if X is given), thinning and super-obbing.
+ * Each reduced observation is the average of its group, y' = A y, H' = A H and R' = A R A^T,
+ * so the error of a super-observation is that of the average of independent errors.
+ * H' is only formed if H is given, otherwise A is given by the groups of the result.
+ * The cost is linear in l besides the products of H.
+ */
+bool obsprep(const Param &param, const io::Obs &obs, const Eigen::MatrixXd *X, Result &result);
+int entry(const int argc, const char *const argv[]);
+} // namespace douka::command::obsprep
+#endif
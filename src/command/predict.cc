@@ -5,7 +5,9 @@
 
 #include "predict.hh"
 #include "common/compute.hh"
+#include "common/ensemble.hh"
 #include "common/io.hh"
+#include "common/profile.hh"
 
 #include <Eigen/Core>
 #include <Eigen/QR>
@@ -22,11 +24,12 @@ static bool show_help(const int argc, char const *const argv[]) {
     os << "   " << description << std::endl;
     os << std::endl;
     os << "Options:" << std::endl;
-    os << "   --state         Input state vector json file" << std::endl;
+    os << "   --state         Input state vector json file or binary ensemble" << std::endl;
     os << "   --param         Input parameter json files" << std::endl;
     os << "   --plugin        System model plugin" << std::endl;
     os << "   --plugin_param  (Opt) Plugin option json file" << std::endl;
     os << "   --output        (Opt) Output path (default='output')" << std::endl;
+    os << "   --format        (Opt) Output format [json|binary] (default=json)" << std::endl;
     os << "   --force         (Opt) Overwrite existing file" << std::endl;
     os << "   --help          (Opt) Print help message" << std::endl;
   };
@@ -52,6 +55,7 @@ Args get_args(const int argc, const char *const argv[]) {
     plugin,
     plugin_param,
     output,
+    format,
   } ctx = Context::none;
 
   for (int i = 2; i < argc; i++) {
@@ -67,6 +71,8 @@ Args get_args(const int argc, const char *const argv[]) {
         ctx = Context::plugin_param;
       } else if (!strcmp(argv[i], "--output")) {
         ctx = Context::output;
+      } else if (!strcmp(argv[i], "--format")) {
+        ctx = Context::format;
       } else if (!strcmp(argv[i], "--force")) {
         args.force = true;
         ctx = Context::none;
@@ -99,6 +105,12 @@ Args get_args(const int argc, const char *const argv[]) {
         ctx = Context::none;
         break;
       }
+      case Context::format: {
+        io::to_format(argv[i]);
+        args.format = argv[i];
+        ctx = Context::none;
+        break;
+      }
       default:
         throw std::invalid_argument("invalid command '" + std::string{argv[i]} + "' given");
       }
@@ -141,7 +153,7 @@ bool validate(const io::State &state, const Param &param) {
 bool predict(io::State &state, const Param &param, const PluginInterface::SharedPtr plugin) {
   // To prevent using the same seed in the each ensemble,
   // add its id and sys_tim
-  static std::default_random_engine engine{
+  std::default_random_engine engine{
       static_cast<unsigned>(param.seed + state.id + state.sys_tim)};
 
   std::vector<double> noise_data;
@@ -174,21 +186,25 @@ int entry(const int argc, const char *const argv[]) {
   }
   const auto args = get_args(argc, argv);
 
-  if (!std::filesystem::exists(args.output) && !std::filesystem::create_directories(args.output)) {
+  if (!io::create_output_directory(args.output)) {
     return EXIT_FAILURE;
   }
 
   /* Parse filename  */
+  common::profile::Phase phase{"parse_filename"};
   std::vector<std::string> param_filenames;
   for (const auto &param : args.param) {
-    if (!io::parse_filename(param, param_filenames)) {
+    if (!io::parse_filename(param, param_filenames, io::layout())) {
       return EXIT_FAILURE;
     }
   }
 
   /* filename -> json */
+  phase.next("read_json");
+  // The standard input may carry several members, so it is read as an ensemble
+  const bool is_ensemble = io::is_stdio(args.state) || io::is_ensemble(args.state);
   nlohmann::json state_json;
-  if (!io::read_json(args.state, state_json)) {
+  if (!is_ensemble && !io::read_json(args.state, state_json)) {
     return EXIT_FAILURE;
   }
   nlohmann::json param_json;
@@ -200,24 +216,37 @@ int entry(const int argc, const char *const argv[]) {
   param_filenames.clear();
 
   /* json -> object */
-  io::State state;
+  phase.next("json_to_object");
+  std::vector<io::State> states;
   Param param;
   try {
-    state = state_json;
+    if (!is_ensemble) {
+      states.emplace_back(state_json);
+    }
     param = param_json;
   } catch (const nlohmann::json::exception &e) {
     std::clog << e.what() << std::endl;
     return EXIT_FAILURE;
   }
+  if (is_ensemble) {
+    phase.next("read_ensemble");
+    if (!io::read_states(args.state, states)) {
+      return EXIT_FAILURE;
+    }
+  }
   if (param_json.contains("Q") && param_json["Q"].is_array()) {
     param.Q = param_json["Q"].get<std::vector<double>>();
   }
 
-  if (!validate(state, param)) {
-    return EXIT_FAILURE;
+  phase.next("validate");
+  for (const auto &state : states) {
+    if (!validate(state, param)) {
+      return EXIT_FAILURE;
+    }
   }
 
   /* Load plugin */
+  phase.next("load_plugin");
   PluginInterface::SharedPtr plugin;
   try {
     const auto plugin_name = io::is_plugin(args.plugin) ? std::filesystem::path(args.plugin)
@@ -228,8 +257,8 @@ int entry(const int argc, const char *const argv[]) {
     return EXIT_FAILURE;
   }
 
-  plugin->id = state.id;
-  plugin->sys_tim = state.sys_tim;
+  plugin->id = states.front().id;
+  plugin->sys_tim = states.front().sys_tim;
   plugin->ctx = PluginInterface::context::predict;
   if (!args.plugin_param.empty() && !std::filesystem::exists(args.plugin_param)) {
     std::clog << args.plugin_param << " not exist" << std::endl;
@@ -239,16 +268,23 @@ int entry(const int argc, const char *const argv[]) {
     return EXIT_FAILURE;
   }
 
-  /* Run prediction */
-  if (!predict(state, param, plugin)) {
-    return EXIT_FAILURE;
+  /* Run prediction, member by member for a binary ensemble */
+  phase.next("compute");
+  for (auto &state : states) {
+    plugin->id = state.id;
+    plugin->sys_tim = state.sys_tim;
+    if (!predict(state, param, plugin)) {
+      return EXIT_FAILURE;
+    }
   }
 
-  const auto &filename = std::filesystem::path(args.output) / io::state_filename(state);
-  if (!io::write_json(filename.string(), state, args.force)) {
+  phase.next("write_" + args.format);
+  if (!io::write_states(args.output, states, io::to_format(args.format), args.force)) {
     return EXIT_FAILURE;
   }
-  std::cout << "result saved to " << filename << std::endl;
+  // The standard output is kept for the states
+  (io::is_stdio(args.output) ? std::clog : std::cout)
+      << "result saved to " << args.output << std::endl;
 
   return EXIT_SUCCESS;
 }
@@ -26,6 +26,7 @@ struct Args {
   std::string plugin;
   std::string plugin_param;
   std::string output = "output";
+  std::string format = "json";
   bool force = false;
 };
 
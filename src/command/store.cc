@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "store.hh"
+#include "common/ensemble.hh"
+#include "common/parallel.hh"
+#include "common/profile.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+namespace douka::command::store {
+static bool show_help(const int argc, char const *const argv[]) {
+  static const auto &show_help = [argv](std::ostream &os) {
+    os << argv[0] << " " << argv[1] << " [create|attach|persist|destroy] [Options]" << std::endl;
+    os << "Description:" << std::endl;
+    os << "   " << description << std::endl;
+    os << std::endl;
+    os << "Actions:" << std::endl;
+    os << "   create        Publish the ensemble given by --state to a new store" << std::endl;
+    os << "   attach        Print the header of the store" << std::endl;
+    os << "   persist       Write the store to the output directory" << std::endl;
+    os << "   destroy       Remove the store" << std::endl;
+    os << std::endl;
+    os << "Options:" << std::endl;
+    os << "   --name        Name of the experiment, the store is given as shm:<name> elsewhere"
+       << std::endl;
+    os << "   --state       (create) Input state vector json file or binary ensemble" << std::endl;
+    os << "   --output      (persist, Opt) Output path (default='output')" << std::endl;
+    os << "   --format      (persist, Opt) Output format [json|binary] (default=binary)"
+       << std::endl;
+    os << "   --force       (Opt) Replace an existing store or overwrite existing file"
+       << std::endl;
+    os << "   --help        (Opt) Print help message" << std::endl;
+  };
+
+  if (argc <= 2) {
+    show_help(std::cout);
+    throw std::invalid_argument("no action given");
+  }
+
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--help")) {
+      show_help(std::cout);
+      return true;
+    }
+  }
+  return false;
+}
+
+Args get_args(const int argc, const char *const argv[]) {
+  Args args;
+  if (argc <= 2) {
+    throw std::invalid_argument("no action given");
+  }
+  const auto action = std::find(std::begin(action_names), std::end(action_names), argv[2]);
+  if (action == std::end(action_names)) {
+    throw std::invalid_argument("unknown action '" + std::string{argv[2]} + "' given");
+  }
+  args.action = static_cast<Action>(action - std::begin(action_names));
+
+  enum class Context {
+    none = 0,
+    name,
+    state,
+    output,
+    format,
+  } ctx = Context::none;
+
+  for (int i = 3; i < argc; i++) {
+    if (!strncmp(argv[i], "--", 2)) {
+      ctx = Context::none;
+      if (!strcmp(argv[i], "--name")) {
+        ctx = Context::name;
+      } else if (!strcmp(argv[i], "--state")) {
+        ctx = Context::state;
+      } else if (!strcmp(argv[i], "--output")) {
+        ctx = Context::output;
+      } else if (!strcmp(argv[i], "--format")) {
+        ctx = Context::format;
+      } else if (!strcmp(argv[i], "--force")) {
+        args.force = true;
+        ctx = Context::none;
+      } else {
+        throw std::invalid_argument("unknown option '" + std::string{argv[i]} + "' given");
+      }
+    } else {
+      switch (ctx) {
+      case Context::name: {
+        args.store = io::is_store(argv[i]) ? std::string{argv[i]}
+                                           : std::string{io::store_prefix} + argv[i];
+        ctx = Context::none;
+        break;
+      }
+      case Context::state: {
+        args.state = argv[i];
+        ctx = Context::none;
+        break;
+      }
+      case Context::output: {
+        args.output = argv[i];
+        ctx = Context::none;
+        break;
+      }
+      case Context::format: {
+        io::to_format(argv[i]);
+        args.format = argv[i];
+        ctx = Context::none;
+        break;
+      }
+      default:
+        throw std::invalid_argument("invalid command '" + std::string{argv[i]} + "' given");
+      }
+    }
+  }
+  if (ctx != Context::none) {
+    throw std::invalid_argument("required option for '" + std::string{argv[argc - 1]} +
+                                "' not given");
+  }
+  if (args.store.empty()) {
+    throw std::invalid_argument("required option '--name' not given");
+  }
+  if (args.action == Action::create && args.state.empty()) {
+    throw std::invalid_argument("required option '--state' not given");
+  }
+  return args;
+}
+
+static bool create(const Args &args) {
+  common::profile::Phase phase{"read_state"};
+  io::Ensemble ensemble;
+  if (!io::read_states(args.state, ensemble)) {
+    return false;
+  }
+  phase.next("write_store");
+  return io::write_ensemble(args.store, ensemble, args.force);
+}
+
+static bool attach(const Args &args) {
+  io::MappedEnsemble store;
+  if (!store.open(args.store)) {
+    return false;
+  }
+  const auto &header = store.header();
+  std::cout << args.store << std::endl;
+  std::cout << "   name     " << store.name() << std::endl;
+  std::cout << "   N        " << header.N << std::endl;
+  std::cout << "   k        " << header.k << std::endl;
+  std::cout << "   sys_tim  " << header.sys_tim << std::endl;
+  std::cout << "   obs_tim  " << header.obs_tim << std::endl;
+  return true;
+}
+
+static bool persist(const Args &args) {
+  common::profile::Phase phase{"read_store"};
+  io::MappedEnsemble store;
+  if (!store.open(args.store)) {
+    return false;
+  }
+  if (!io::create_output_directory(args.output)) {
+    return false;
+  }
+  const auto format = io::to_format(args.format);
+  phase.next("write_" + args.format);
+  if (format == io::Format::binary && !io::is_stdio(args.output) &&
+      !io::is_store(args.output)) {
+    // The file is created as a mapping and filled from the store without an intermediate copy
+    const auto &header = store.header();
+    io::MappedEnsemble file;
+    if (!file.create(std::filesystem::path(args.output) /
+                         io::ensemble_filename(store.name(), header.sys_tim, header.obs_tim),
+                     store.name(), header.N, header.k, header.sys_tim, header.obs_tim,
+                     args.force)) {
+      return false;
+    }
+    io::copy_blocks(store.X().data(), file.X().data(), store.X().size());
+    return file.close();
+  }
+  io::Ensemble ensemble;
+  return io::to_ensemble(store, ensemble) &&
+         io::write_states(args.output, ensemble, format, args.force);
+}
+
+int entry(const int argc, const char *const argv[]) {
+  if (show_help(argc, argv)) {
+    return EXIT_SUCCESS;
+  }
+  const auto args = get_args(argc, argv);
+
+  switch (args.action) {
+  case Action::create:
+    return create(args) ? EXIT_SUCCESS : EXIT_FAILURE;
+  case Action::attach:
+    return attach(args) ? EXIT_SUCCESS : EXIT_FAILURE;
+  case Action::persist:
+    return persist(args) ? EXIT_SUCCESS : EXIT_FAILURE;
+  case Action::destroy:
+    return io::destroy_store(args.store) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  return EXIT_FAILURE;
+}
+} // namespace douka::command::store
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMAND_STORE__
+#define __DOUKA_COMMAND_STORE__
+
+#include <string>
+#include <string_view>
+
+namespace douka::command::store {
+inline static constexpr std::string_view name = "store";
+inline static constexpr std::string_view description =
+    "Manage an ensemble store in shared memory";
+
+/**
+ * @brief Lifetime of the store
+ *   create:  publish an ensemble to a new store
+ *   attach:  map the store and print its header
+ *   persist: write the store to the output directory
+ *   destroy: remove the store
+ */
+enum class Action { create, attach, persist, destroy };
+inline static constexpr std::string_view action_names[] = {"create", "attach", "persist",
+                                                           "destroy"};
+
+struct Args {
+  Action action = Action::attach;
+  std::string store; // shm:<experiment>
+  std::string state;
+  std::string output = "output";
+  std::string format = "binary";
+  bool force = false;
+};
+
+Args get_args(const int argc, const char *const argv[]);
+int entry(const int argc, const char *const argv[]);
+} // namespace douka::command::store
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "alloc.hh"
+
+#include <atomic>
+
+#if defined(DOUKA_USE_ALLOC_COUNTER)
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <malloc.h>
+#include <unistd.h>
+
+// The counter replaces the malloc family of glibc and forwards to its internal entry points.
+// It is placed below operator new and Eigen's allocator, so every heap allocation is seen.
+// valloc, pvalloc and reallocarray are replaced too, since glibc does not route them through
+// the replaced functions. Allocations by mmap are not heap allocations and are not counted.
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t n, std::size_t size);
+void *__libc_realloc(void *ptr, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void *ptr);
+}
+#endif
+
+namespace douka::common::alloc {
+namespace {
+std::atomic<uint64_t> g_count = 0;
+std::atomic<uint64_t> g_bytes = 0;
+std::atomic<int64_t> g_current = 0;
+std::atomic<int64_t> g_peak = 0;
+
+#if defined(DOUKA_USE_ALLOC_COUNTER)
+int64_t usable_size(void *ptr) {
+  return ptr == nullptr ? 0 : static_cast<int64_t>(malloc_usable_size(ptr));
+}
+
+void on_alloc(void *ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  const auto size = usable_size(ptr);
+  g_count.fetch_add(1, std::memory_order_relaxed);
+  g_bytes.fetch_add(static_cast<uint64_t>(size), std::memory_order_relaxed);
+  const auto current = g_current.fetch_add(size, std::memory_order_relaxed) + size;
+  auto peak = g_peak.load(std::memory_order_relaxed);
+  while (current > peak && !g_peak.compare_exchange_weak(peak, current)) {
+  }
+}
+
+void on_free(const int64_t size) { g_current.fetch_sub(size, std::memory_order_relaxed); }
+#endif
+} // namespace
+
+Stats stats() {
+  return {g_count.load(std::memory_order_relaxed), g_bytes.load(std::memory_order_relaxed),
+          g_current.load(std::memory_order_relaxed), g_peak.load(std::memory_order_relaxed)};
+}
+
+void reset_peak() { g_peak = g_current.load(); }
+} // namespace douka::common::alloc
+
+#if defined(DOUKA_USE_ALLOC_COUNTER)
+namespace alloc = douka::common::alloc;
+
+extern "C" {
+void *malloc(std::size_t size) noexcept {
+  void *ptr = __libc_malloc(size);
+  alloc::on_alloc(ptr);
+  return ptr;
+}
+
+void *calloc(std::size_t n, std::size_t size) noexcept {
+  void *ptr = __libc_calloc(n, size);
+  alloc::on_alloc(ptr);
+  return ptr;
+}
+
+void *realloc(void *ptr, std::size_t size) noexcept {
+  const auto prev_size = alloc::usable_size(ptr);
+  void *next = __libc_realloc(ptr, size);
+  if (next == nullptr && size != 0) {
+    // The original block is left untouched on failure
+    return next;
+  }
+  alloc::on_free(prev_size);
+  alloc::on_alloc(next);
+  return next;
+}
+
+void *memalign(std::size_t alignment, std::size_t size) noexcept {
+  void *ptr = __libc_memalign(alignment, size);
+  alloc::on_alloc(ptr);
+  return ptr;
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size) noexcept {
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, std::size_t alignment, std::size_t size) noexcept {
+  if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  void *p = memalign(alignment, size);
+  if (p == nullptr && size != 0) {
+    return ENOMEM;
+  }
+  *ptr = p;
+  return 0;
+}
+
+void *valloc(std::size_t size) noexcept { return memalign(sysconf(_SC_PAGESIZE), size); }
+
+void *pvalloc(std::size_t size) noexcept {
+  const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  return memalign(page, (size + page - 1) / page * page);
+}
+
+void *reallocarray(void *ptr, std::size_t n, std::size_t size) noexcept {
+  if (size != 0 && n > std::numeric_limits<std::size_t>::max() / size) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  return realloc(ptr, n * size);
+}
+
+void free(void *ptr) noexcept {
+  alloc::on_free(alloc::usable_size(ptr));
+  __libc_free(ptr);
+}
+}
+#endif
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMON_ALLOC__
+#define __DOUKA_COMMON_ALLOC__
+
+#include <cstdint>
+
+namespace douka::common::alloc {
+/**
+ * @brief Process wide heap allocation statistics
+ */
+struct Stats {
+  uint64_t count = 0; // Number of allocations
+  uint64_t bytes = 0; // Total allocated bytes
+  int64_t current = 0; // Bytes in use
+  int64_t peak = 0;    // Peak of bytes in use
+
+  /**
+   * @brief Allocations made since other was taken.
+   * current and peak are kept as they are.
+   */
+  inline Stats operator-(const Stats &other) const {
+    return {this->count - other.count, this->bytes - other.bytes, this->current, this->peak};
+  }
+};
+
+/**
+ * @brief Whether the library is built with DOUKA_USE_ALLOC_COUNTER.
+ * Otherwise all the statistics stay zero.
+ */
+inline constexpr bool enabled() {
+#if defined(DOUKA_USE_ALLOC_COUNTER)
+  return true;
+#else
+  return false;
+#endif
+}
+
+Stats stats();
+
+/**
+ * @brief Reset the peak to the bytes currently in use
+ */
+void reset_peak();
+} // namespace douka::common::alloc
+#endif
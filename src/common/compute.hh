@@ -6,10 +6,17 @@
 #ifndef __DOUKA_COMMON_COMPUTE__
 #define __DOUKA_COMMON_COMPUTE__
 
+#include <Eigen/Cholesky>
 #include <Eigen/Core>
 #include <Eigen/QR>
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
 #include <random>
+#include <string_view>
 
 namespace douka::common::compute {
 template <typename Type, typename RandomEngine>
@@ -32,30 +39,229 @@ auto rand(const Eigen::MatrixX<Type> &sigma, const Eigen::Index &N, RandomEngine
   return (sigma.llt().matrixL() * r).eval();
 }
 
+/**
+ * @brief Random engine of a member, an independent stream keyed by (seed, id).
+ * A member is drawn the same whatever the number of members or of threads drawing them.
+ */
+inline std::mt19937_64 member_engine(const uint64_t seed, const uint64_t id) {
+  std::seed_seq seq{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+                    static_cast<uint32_t>(id), static_cast<uint32_t>(id >> 32)};
+  return std::mt19937_64{seq};
+}
+
 template <typename Arg1> auto mean_diff(const Eigen::MatrixBase<Arg1> &m) {
   return m.colwise() - m.rowwise().mean();
 }
 
+/**
+ * @brief Lower triangle of C += alpha A A^T as a symmetric rank-k update (syrk).
+ * Half the flops of the general product, the strictly upper part of C is not referenced.
+ */
+template <typename Derived1, typename Derived2>
+void rank_update(Eigen::MatrixBase<Derived1> &C, const Eigen::MatrixBase<Derived2> &A,
+                 const typename Derived1::Scalar &alpha = 1.0) {
+  C.derived().template selfadjointView<Eigen::Lower>().rankUpdate(A, alpha);
+}
+
+/**
+ * @brief Copy the lower triangle of C to the strictly upper one
+ */
+template <typename Derived1> void symmetrize(Eigen::MatrixBase<Derived1> &C) {
+  C.template triangularView<Eigen::StrictlyUpper>() = C.transpose();
+}
+
+/**
+ * @brief Solve C X = B in place for a symmetric C given by its lower triangle.
+ * The Cholesky factorization is used when C is positive definite, the pseudo inverse otherwise.
+ */
+template <typename Derived1, typename Derived2>
+void solve_symmetric(Eigen::MatrixBase<Derived1> &C, Eigen::MatrixBase<Derived2> &B) {
+  using Matrix = Eigen::MatrixX<typename Derived1::Scalar>;
+  const Eigen::LLT<Matrix, Eigen::Lower> llt{C};
+  if (llt.info() == Eigen::Success) {
+    llt.solveInPlace(B);
+  } else {
+    symmetrize(C);
+    B = C.completeOrthogonalDecomposition().pseudoInverse() * B;
+  }
+}
+
+// NOTE: Operands used more than once are evaluated once. Otherwise the lazy expressions,
+// e.g. mean_diff, would be recomputed for each product they appear in.
 template <typename Arg1> auto cov(const Eigen::MatrixBase<Arg1> &m) {
-  const auto md = mean_diff(m);
-  return (1.0 / (m.cols() - 1.0)) * md * md.transpose();
+  using Matrix = Eigen::MatrixX<typename Arg1::Scalar>;
+  const Matrix md = mean_diff(m);
+  Matrix c = Matrix::Zero(m.rows(), m.rows());
+  rank_update(c, md, 1.0 / (m.cols() - 1.0));
+  symmetrize(c);
+  return c;
 }
 
 template <typename Derive1, typename Derive2, typename Derive3>
 auto kalman_gain(const Eigen::MatrixBase<Derive1> &X, const Eigen::MatrixBase<Derive2> &H,
                  const Eigen::MatrixBase<Derive3> &R) {
+  using Matrix = Eigen::MatrixX<typename Derive1::Scalar>;
   const auto V = cov(X);
-  return V * H.transpose() *
-         (H * V * H.transpose() + R).completeOrthogonalDecomposition().pseudoInverse();
+  const Matrix VHt = V * H.transpose();
+  Matrix C = R;
+  C.noalias() += H * VHt;
+  Matrix Kt = VHt.transpose();
+  solve_symmetric(C, Kt);
+  return Matrix{Kt.transpose()};
 }
 
 template <typename Derive1, typename Derive2, typename Derive3>
 auto kalman_gain_tall(const Eigen::MatrixBase<Derive1> &X, const Eigen::MatrixBase<Derive2> &H,
                       const Eigen::MatrixBase<Derive3> &R) {
-  const auto Z = (1.0 / std::sqrt(X.cols() - 1.0)) * mean_diff(X);
-  const auto S = H * Z;
-  return Z * S.transpose() *
-         (S * S.transpose() + R).completeOrthogonalDecomposition().pseudoInverse();
+  using Matrix = Eigen::MatrixX<typename Derive1::Scalar>;
+  const Matrix Z = (1.0 / std::sqrt(X.cols() - 1.0)) * mean_diff(X);
+  const Matrix S = H * Z;
+  Matrix C = R;
+  rank_update(C, S);
+  Matrix Kt = S * Z.transpose();
+  solve_symmetric(C, Kt);
+  return Matrix{Kt.transpose()};
+}
+
+/**
+ * @brief Formulations of the analysis update X += K (Y + W - HX) with Z = mean_diff(X) / sqrt(N-1)
+ *   state:       K = (I + Z Z^T H^T R^-1 H)^-1 Z Z^T H^T R^-1   solves a k x k system
+ *   observation: K = Z S^T (S S^T + R)^-1 with S = H Z         solves a l x l system
+ *   ensemble:    K = Z (I + S^T R^-1 S)^-1 S^T R^-1             solves a N x N system
+ */
+enum class Gain { state, observation, ensemble };
+inline static constexpr std::string_view gain_names[] = {"state", "observation", "ensemble"};
+
+/**
+ * @brief Structure of H and R the formulations can take advantage of
+ */
+struct Structure {
+  bool H_identity = false;  // H selects the first l states
+  bool R_diagonal = false;  // R is diagonal (or not given)
+  bool R_invertible = true; // R is positive definite
+};
+
+/**
+ * @brief Flops of a formulation by kernel class.
+ * The classes run at different rates, see gain_weights.
+ */
+struct Flops {
+  double gemm = 0.0;   // matrix-matrix products
+  double factor = 0.0; // Cholesky / LU factorization
+  double solve = 0.0;  // triangular solves with multiple right hand sides
+  double stream = 0.0; // memory bound element-wise operations and random draws
+
+  inline double total() const { return gemm + factor + solve + stream; }
+};
+
+/**
+ * @brief Time per flop of each kernel class relative to gemm.
+ * Least squares fit to the BM_gain sweep of bench-common-compute (Release, Eigen without BLAS).
+ * stream is dominated by the normal random draws of the perturbation.
+ */
+inline static constexpr Flops gain_weights = {1.0, 1.1, 1.8, 27.0};
+
+struct GainCost {
+  Gain gain;
+  bool available; // R must be invertible for state and ensemble
+  Flops flops;    // per cycle
+  double memory;  // peak bytes of the workspace
+  double cost;    // weighted flops
+
+  inline friend std::ostream &operator<<(std::ostream &os, const GainCost &c) {
+    os << std::left << std::setw(12) << gain_names[static_cast<int>(c.gain)];
+    if (!c.available) {
+      return os << "not available";
+    }
+    os << std::scientific << std::setprecision(3);
+    os << "flops=" << c.flops.total() << " memory=" << c.memory << "B cost=" << c.cost;
+    return os << std::defaultfloat;
+  }
+};
+
+/**
+ * @brief Estimate the per cycle flops and the workspace memory of each formulation
+ */
+inline std::array<GainCost, 3> gain_costs(const double N, const double k, const double l,
+                                          const Structure &s) {
+  // Shared by all: Z, S = H Z, H x_mean, the observation perturbation and the innovation
+  Flops shared;
+  shared.stream += k * N + 4.0 * l * N;
+  if (s.H_identity) {
+    shared.stream += l * N;
+  } else {
+    shared.gemm += 2.0 * l * k * N + 2.0 * l * k;
+  }
+  if (s.R_diagonal) {
+    shared.stream += l * N;
+  } else {
+    shared.gemm += l * l * N;
+  }
+  double shared_memory = k * N + 3.0 * l * N + k + 2.0 * l;
+  shared_memory += s.H_identity ? 0.0 : l * k;
+  shared_memory += s.R_diagonal ? 3.0 * l : 3.0 * l * l;
+
+  std::array<GainCost, 3> costs;
+
+  // state: X += (I + P B)^-1 P F D with P = Z Z^T, F = H^T R^-1 and B = F H
+  Flops state = shared;
+  state.gemm += 2.0 * k * l * N; // U = F D
+  state.gemm += k * k * N;       // P, rank update
+  state.stream += k * k;         // symmetrize P
+  state.gemm += 2.0 * k * k * k; // A = I + P B
+  state.gemm += 2.0 * k * k * N; // W = P U
+  state.factor += 2.0 / 3.0 * k * k * k;
+  state.solve += 2.0 * k * k * N;
+  state.stream += k * N;
+  costs[0] = {Gain::state, s.R_invertible, state,
+              8.0 * (shared_memory + 4.0 * k * k + k * l + 2.0 * k * N), 0.0};
+
+  // observation: X += Z S^T C^-1 D with C = S S^T + R
+  Flops observation = shared;
+  observation.gemm += l * l * N; // C, rank update
+  observation.stream += l * l;
+  observation.factor += l * l * l / 3.0;
+  observation.solve += 2.0 * l * l * N;
+  observation.gemm += 2.0 * l * N * N; // M = S^T C^-1 D
+  observation.gemm += 2.0 * k * N * N; // X += Z M
+  costs[1] = {Gain::observation, true, observation,
+              8.0 * (shared_memory + 2.0 * l * l + N * N), 0.0};
+
+  // ensemble: X += Z Q^-1 T^T L^-1 D with R = L L^T, T = L^-1 S and Q = I + T^T T
+  Flops ensemble = shared;
+  if (s.R_diagonal) {
+    ensemble.stream += 2.0 * l * N;
+  } else {
+    ensemble.solve += 2.0 * l * l * N;
+  }
+  ensemble.gemm += l * N * N;       // Q, rank update
+  ensemble.gemm += 2.0 * l * N * N; // T^T D
+  ensemble.factor += N * N * N / 3.0;
+  ensemble.solve += 2.0 * N * N * N;
+  ensemble.gemm += 2.0 * k * N * N; // X += Z M
+  costs[2] = {Gain::ensemble, s.R_invertible, ensemble,
+              8.0 * (shared_memory + l * N + 2.0 * N * N), 0.0};
+
+  for (auto &c : costs) {
+    c.cost = c.flops.gemm * gain_weights.gemm + c.flops.factor * gain_weights.factor +
+             c.flops.solve * gain_weights.solve + c.flops.stream * gain_weights.stream;
+  }
+  return costs;
+}
+
+/**
+ * @brief The cheapest available formulation, the smaller memory on a tie
+ */
+inline GainCost select_gain(const std::array<GainCost, 3> &costs) {
+  return *std::min_element(costs.begin(), costs.end(), [](const auto &a, const auto &b) {
+    if (a.available != b.available) {
+      return a.available;
+    }
+    if (a.cost != b.cost) {
+      return a.cost < b.cost;
+    }
+    return a.memory < b.memory;
+  });
 }
 } // namespace douka::common::compute
 #endif
\ No newline at end of file
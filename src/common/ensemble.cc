@@ -0,0 +1,856 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ensemble.hh"
+#include "io.hh"
+#include "json.hh"
+#include "parallel.hh"
+#include "writer.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace douka::io {
+namespace {
+// Create the directory of the state in the sharded layout, once for consecutive members
+bool create_state_directory(const std::filesystem::path &output, const State &state,
+                            std::string &created) {
+  auto directory = state_directory(state);
+  if (directory.empty() || directory == created) {
+    return true;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(output / directory, ec);
+  if (ec) {
+    std::clog << output / directory << " could not be created: " << ec.message() << std::endl;
+    return false;
+  }
+  created = std::move(directory);
+  return true;
+}
+
+// Name of the shared memory object of the store, the experiment should be a plain name
+bool store_object(const std::string_view &path, std::string &object) {
+  const auto experiment = path.substr(store_prefix.size());
+  if (experiment.empty() || experiment.size() > 200 ||
+      !std::all_of(experiment.begin(), experiment.end(), [](const char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.';
+      })) {
+    return false;
+  }
+  object = "/douka." + std::string{experiment};
+  return true;
+}
+
+// Descriptor of the binary ensemble file or of the shared memory object of the store
+int open_ensemble(const std::filesystem::path &filename, const int flags, const mode_t mode = 0) {
+  if (!is_store(filename.native())) {
+    return ::open(filename.c_str(), flags, mode);
+  }
+  std::string object;
+  if (!store_object(filename.native(), object)) {
+    std::clog << "invalid store name " << filename << " given" << std::endl;
+    errno = EINVAL;
+    return -1;
+  }
+  return shm_open(object.c_str(), flags, mode);
+}
+
+uint64_t align_up(const uint64_t size) {
+  return (size + ensemble_alignment - 1) / ensemble_alignment * ensemble_alignment;
+}
+
+// Size in bytes of the k x N states, false unless it fits in a file offset.
+// The bound is taken by a division first, as k and N may come from a broken header.
+bool states_size(const int64_t N, const int64_t k, uint64_t &size) {
+  constexpr auto max = static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) / sizeof(double);
+  if (N <= 0 || k <= 0 || static_cast<uint64_t>(k) > max / static_cast<uint64_t>(N)) {
+    return false;
+  }
+  size = static_cast<uint64_t>(k) * static_cast<uint64_t>(N) * sizeof(double);
+  return true;
+}
+
+bool check_header(const std::filesystem::path &filename, const EnsembleHeader &header,
+                  const uint64_t file_size) {
+  if (std::memcmp(header.magic, ensemble_magic, sizeof(ensemble_magic)) != 0) {
+    std::clog << filename << " is not a binary ensemble" << std::endl;
+    return false;
+  }
+  if (header.version != ensemble_version) {
+    std::clog << filename << " unsupported version " << header.version << std::endl;
+    return false;
+  }
+  if (header.byte_order != ensemble_byte_order) {
+    std::clog << filename << " written in a different byte order" << std::endl;
+    return false;
+  }
+  // The sizes are compared without overflowing, as the header may be broken
+  if (header.N <= 0 || header.k <= 0 || header.name_size > file_size ||
+      header.offset < sizeof(header) + header.name_size || header.offset > file_size ||
+      header.offset % ensemble_alignment != 0) {
+    std::clog << filename << " broken header" << std::endl;
+    return false;
+  }
+  const auto N = static_cast<uint64_t>(header.N);
+  const auto k = static_cast<uint64_t>(header.k);
+  const auto data_size = file_size - header.offset;
+  if (k > data_size / sizeof(double) / N || k * N * sizeof(double) != data_size) {
+    std::clog << filename << " invalid file size " << file_size << " for " << k << " x " << N
+              << " states" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Move the column i of the member ids[i] to the column of its id
+bool place_by_id(Ensemble &ensemble, std::vector<int64_t> &ids) {
+  std::vector<bool> found(ensemble.N, false);
+  for (const auto id : ids) {
+    if (id < 0 || id >= ensemble.N || found[id]) {
+      std::clog << "ids should be 0 to " << ensemble.N - 1 << " without duplicates" << std::endl;
+      return false;
+    }
+    found[id] = true;
+  }
+
+  // Follow the cycles of the permutation
+  for (int64_t i = 0; i < ensemble.N; ++i) {
+    while (ids[i] != i) {
+      const auto j = ids[i];
+      const auto column = ensemble.X.begin() + i * ensemble.k;
+      std::swap_ranges(column, column + ensemble.k, ensemble.X.begin() + j * ensemble.k);
+      std::swap(ids[i], ids[j]);
+    }
+  }
+  return true;
+}
+
+// Members from the standard input, one json state per line
+bool read_ndjson(std::istream &stream, std::vector<State> &states) {
+  std::string line;
+  while (std::getline(stream, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    State state;
+    if (!parse_state(line, state)) {
+      return false;
+    }
+    states.emplace_back(std::move(state));
+  }
+  return true;
+}
+
+bool read_ndjson(std::istream &stream, Ensemble &ensemble) {
+  std::vector<int64_t> ids;
+  std::string line;
+  State state;
+  while (std::getline(stream, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    if (!parse_state(line, state)) {
+      return false;
+    }
+    if (ids.empty()) {
+      ensemble.name = state.name;
+      ensemble.k = static_cast<int64_t>(state.x.size());
+      ensemble.sys_tim = state.sys_tim;
+      ensemble.obs_tim = state.obs_tim;
+      ensemble.X.clear();
+    } else if (state.name != ensemble.name || state.sys_tim != ensemble.sys_tim ||
+               state.obs_tim != ensemble.obs_tim) {
+      std::clog << "member of different name or timestamp given" << std::endl;
+      return false;
+    } else if (state.x.size() != static_cast<std::size_t>(ensemble.k)) {
+      std::clog << "invalid state size" << std::endl;
+      return false;
+    }
+    ensemble.X.insert(ensemble.X.end(), state.x.begin(), state.x.end());
+    ids.emplace_back(state.id);
+  }
+  if (ids.empty()) {
+    std::clog << "no state given" << std::endl;
+    return false;
+  }
+  ensemble.N = static_cast<int64_t>(ids.size());
+  return place_by_id(ensemble, ids);
+}
+
+bool is_binary(std::istream &stream) { return stream.peek() == ensemble_magic[0]; }
+} // namespace
+
+MappedEnsemble::~MappedEnsemble() {
+  if (!this->created.empty()) {
+    this->discard();
+  }
+  this->close();
+}
+
+MappedEnsemble::MappedEnsemble(MappedEnsemble &&other) noexcept
+    : data(other.data), size(other.size), writable(other.writable),
+      created(std::move(other.created)) {
+  other.data = nullptr;
+  other.size = 0;
+  other.created.clear();
+}
+
+MappedEnsemble &MappedEnsemble::operator=(MappedEnsemble &&other) noexcept {
+  if (this != &other) {
+    this->close();
+    std::swap(this->data, other.data);
+    std::swap(this->size, other.size);
+    std::swap(this->writable, other.writable);
+    std::swap(this->created, other.created);
+  }
+  return *this;
+}
+
+bool MappedEnsemble::open(const std::filesystem::path &filename, const bool writable) {
+  this->close();
+  if (!is_store(filename.native()) && !std::filesystem::exists(filename)) {
+    std::clog << filename << " not exists" << std::endl;
+    return false;
+  }
+
+  const int fd = open_ensemble(filename, writable ? O_RDWR : O_RDONLY);
+  if (fd < 0) {
+    std::cerr << filename << " could not open: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(EnsembleHeader)) {
+    std::clog << filename << " is not a binary ensemble" << std::endl;
+    ::close(fd);
+    return false;
+  }
+
+  const int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *data = mmap(nullptr, st.st_size, prot, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    std::cerr << filename << " could not map: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  this->data = data;
+  this->size = st.st_size;
+  this->writable = writable;
+
+  if (!check_header(filename, this->header(), this->size)) {
+    this->close();
+    return false;
+  }
+  return true;
+}
+
+bool MappedEnsemble::create(const std::filesystem::path &filename, const std::string_view &name,
+                            const int64_t N, const int64_t k, const int64_t sys_tim,
+                            const int64_t obs_tim, const bool force) {
+  this->close();
+  const bool store = is_store(filename.native());
+  if (!force && (store ? exists_store(filename.native())
+                       : std::filesystem::exists(filename) &&
+                             std::filesystem::is_regular_file(filename))) {
+    std::clog << filename << " already exists" << std::endl;
+    return false;
+  }
+  // A store is replaced by a new object instead of truncated, as truncating it under the
+  // mapping of an attached process would fault there
+  if (store && force && exists_store(filename.native()) && !destroy_store(filename.native())) {
+    return false;
+  }
+
+  uint64_t data_size;
+  if (!states_size(N, k, data_size)) {
+    std::clog << filename << " invalid shape " << k << " x " << N << std::endl;
+    return false;
+  }
+  const auto offset = align_up(sizeof(EnsembleHeader) + name.size());
+  const auto size = offset + data_size;
+  const int fd = store ? open_ensemble(filename, O_RDWR | O_CREAT | O_EXCL, 0600)
+                       : open_ensemble(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << filename << " could not open: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    std::cerr << filename << " could not resize: " << std::strerror(errno) << std::endl;
+    ::close(fd);
+    return false;
+  }
+  void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    std::cerr << filename << " could not map: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  this->data = data;
+  this->size = size;
+  this->writable = true;
+  this->created = filename;
+
+  auto &header = this->header();
+  std::memcpy(header.magic, ensemble_magic, sizeof(ensemble_magic));
+  header.version = ensemble_version;
+  header.byte_order = ensemble_byte_order;
+  header.offset = offset;
+  header.N = N;
+  header.k = k;
+  header.sys_tim = sys_tim;
+  header.obs_tim = obs_tim;
+  header.name_size = name.size();
+  std::memcpy(static_cast<char *>(this->data) + sizeof(EnsembleHeader), name.data(), name.size());
+  return true;
+}
+
+bool MappedEnsemble::close() {
+  if (this->data == nullptr) {
+    return true;
+  }
+  bool ok = true;
+  if (this->writable && msync(this->data, this->size, MS_SYNC) != 0) {
+    std::cerr << "failed to write back the ensemble: " << std::strerror(errno) << std::endl;
+    ok = false;
+  }
+  munmap(this->data, this->size);
+  this->data = nullptr;
+  this->size = 0;
+  if (!ok && !this->created.empty()) {
+    this->discard();
+  }
+  this->created.clear();
+  return ok;
+}
+
+// Remove the ensemble created by create() that is not complete
+void MappedEnsemble::discard() {
+  if (this->data != nullptr) {
+    munmap(this->data, this->size);
+    this->data = nullptr;
+    this->size = 0;
+  }
+  if (is_store(this->created.native())) {
+    destroy_store(this->created.native());
+  } else {
+    std::error_code ec;
+    std::filesystem::remove(this->created, ec);
+  }
+  this->created.clear();
+}
+
+void MappedEnsemble::advise_sequential() const {
+  if (this->data != nullptr) {
+    madvise(this->data, this->size, MADV_SEQUENTIAL);
+  }
+}
+
+bool Ensemble::validate() const {
+  if (this->name.empty()) {
+    std::clog << "No name given" << std::endl;
+    return false;
+  }
+  if (this->N <= 0) {
+    std::clog << "Invalid ensemble size given " << this->N << std::endl;
+    return false;
+  }
+  if (this->k <= 0) {
+    std::clog << "Invalid state size given " << this->k << std::endl;
+    return false;
+  }
+  if (this->sys_tim < 0) {
+    std::clog << "Invalid sys time given " << this->sys_tim << std::endl;
+    return false;
+  }
+  if (this->obs_tim < 0) {
+    std::clog << "Invalid obs time given " << this->obs_tim << std::endl;
+    return false;
+  }
+  uint64_t size;
+  if (!states_size(this->N, this->k, size)) {
+    std::clog << "Invalid shape of ensemble given " << this->k << " x " << this->N << std::endl;
+    return false;
+  }
+  if (this->X.size() != size / sizeof(double)) {
+    std::clog << "Invalid size of ensemble given " << this->X.size() << " != " << this->k << " x "
+              << this->N << std::endl;
+    return false;
+  }
+  return true;
+}
+
+Format to_format(const std::string_view &name) {
+  const auto it = std::find(std::begin(format_names), std::end(format_names), name);
+  if (it == std::end(format_names)) {
+    throw std::invalid_argument("unknown format '" + std::string{name} + "' given");
+  }
+  return static_cast<Format>(it - std::begin(format_names));
+}
+
+bool is_ensemble(const std::filesystem::path &filename) {
+  char magic[sizeof(ensemble_magic)];
+  if (is_store(filename.native())) {
+    const int fd = open_ensemble(filename, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    const bool read = pread(fd, magic, sizeof(magic), 0) == sizeof(magic);
+    ::close(fd);
+    return read && std::memcmp(magic, ensemble_magic, sizeof(magic)) == 0;
+  }
+  if (!std::filesystem::is_regular_file(filename)) {
+    return false;
+  }
+  std::ifstream stream{filename, std::ios::binary};
+  if (!stream.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return std::memcmp(magic, ensemble_magic, sizeof(magic)) == 0;
+}
+
+bool is_store(const std::string_view &path) {
+  return path.substr(0, store_prefix.size()) == store_prefix;
+}
+
+bool exists_store(const std::string_view &path) {
+  std::string object;
+  if (!store_object(path, object)) {
+    return false;
+  }
+  const int fd = shm_open(object.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  ::close(fd);
+  return true;
+}
+
+bool destroy_store(const std::string_view &path) {
+  std::string object;
+  if (!store_object(path, object)) {
+    std::clog << "invalid store name '" << path << "' given" << std::endl;
+    return false;
+  }
+  if (shm_unlink(object.c_str()) != 0) {
+    std::clog << path << " could not destroy: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool create_output_directory(const std::filesystem::path &output) {
+  if (is_stdio(output.native()) || is_store(output.native()) || std::filesystem::exists(output)) {
+    return true;
+  }
+  // The directory may be created concurrently, e.g. by the other ranks of a filter
+  std::error_code ec;
+  if (std::filesystem::create_directories(output, ec) || std::filesystem::is_directory(output)) {
+    return true;
+  }
+  std::clog << output << " could not create: " << ec.message() << std::endl;
+  return false;
+}
+
+bool read_ensemble(const std::filesystem::path &filename, Ensemble &ensemble) {
+  MappedEnsemble mapped;
+  if (!mapped.open(filename)) {
+    return false;
+  }
+  mapped.advise_sequential();
+  return to_ensemble(mapped, ensemble);
+}
+
+bool write_ensemble(const std::filesystem::path &filename, const Ensemble &ensemble,
+                    const bool force) {
+  if (!ensemble.validate()) {
+    return false;
+  }
+  MappedEnsemble mapped;
+  if (!mapped.create(filename, ensemble.name, ensemble.N, ensemble.k, ensemble.sys_tim,
+                     ensemble.obs_tim, force)) {
+    return false;
+  }
+  mapped.advise_sequential();
+  copy_blocks(ensemble.X.data(), mapped.X().data(), static_cast<int64_t>(ensemble.X.size()));
+  return mapped.close();
+}
+
+bool read_ensemble(std::istream &stream, Ensemble &ensemble) {
+  EnsembleHeader header;
+  if (!stream.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+    std::clog << "failed to read the header of the ensemble" << std::endl;
+    return false;
+  }
+  // The stream has no size to check the header against, the shape bounds the size instead
+  uint64_t data_size;
+  if (!states_size(header.N, header.k, data_size) ||
+      header.offset > std::numeric_limits<uint64_t>::max() - data_size) {
+    std::clog << stdio_path << " broken header" << std::endl;
+    return false;
+  }
+  if (!check_header(stdio_path, header, header.offset + data_size)) {
+    return false;
+  }
+  ensemble.name.resize(header.name_size);
+  ensemble.X.resize(data_size / sizeof(double));
+  if (!stream.read(ensemble.name.data(), header.name_size) ||
+      !stream.ignore(header.offset - sizeof(header) - header.name_size) ||
+      !stream.read(reinterpret_cast<char *>(ensemble.X.data()), data_size)) {
+    std::clog << "failed to read the ensemble" << std::endl;
+    return false;
+  }
+  ensemble.N = header.N;
+  ensemble.k = header.k;
+  ensemble.sys_tim = header.sys_tim;
+  ensemble.obs_tim = header.obs_tim;
+  return true;
+}
+
+bool write_ensemble(std::ostream &stream, const Ensemble &ensemble) {
+  if (!ensemble.validate()) {
+    return false;
+  }
+  EnsembleHeader header{};
+  std::memcpy(header.magic, ensemble_magic, sizeof(ensemble_magic));
+  header.version = ensemble_version;
+  header.byte_order = ensemble_byte_order;
+  header.offset = align_up(sizeof(EnsembleHeader) + ensemble.name.size());
+  header.N = ensemble.N;
+  header.k = ensemble.k;
+  header.sys_tim = ensemble.sys_tim;
+  header.obs_tim = ensemble.obs_tim;
+  header.name_size = ensemble.name.size();
+  const std::string padding(header.offset - sizeof(header) - header.name_size, '\0');
+  if (!stream.write(reinterpret_cast<const char *>(&header), sizeof(header)) ||
+      !stream.write(ensemble.name.data(), ensemble.name.size()) ||
+      !stream.write(padding.data(), padding.size()) ||
+      !stream.write(reinterpret_cast<const char *>(ensemble.X.data()),
+                    ensemble.X.size() * sizeof(double)) ||
+      !stream.flush()) {
+    std::clog << "failed to write the ensemble" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+namespace {
+// The members share the name and the time stamps and cover the ids 0 to N-1
+bool check_members(const std::vector<State> &states) {
+  if (states.empty()) {
+    std::clog << "no state given" << std::endl;
+    return false;
+  }
+  const auto &front = states.front();
+  const auto N = static_cast<int64_t>(states.size());
+  std::vector<bool> found(N, false);
+  for (const auto &state : states) {
+    if (state.name != front.name || state.sys_tim != front.sys_tim ||
+        state.obs_tim != front.obs_tim) {
+      std::clog << "members of different name or timestamp given" << std::endl;
+      return false;
+    }
+    if (state.x.size() != front.x.size()) {
+      std::clog << "invalid state size" << std::endl;
+      return false;
+    }
+    if (state.id < 0 || state.id >= N || found[state.id]) {
+      std::clog << "ids should be 0 to " << N - 1 << " without duplicates" << std::endl;
+      return false;
+    }
+    found[state.id] = true;
+  }
+  return true;
+}
+
+// Write the members straight into the mapping of a new binary ensemble, one copy of each
+bool write_members(const std::filesystem::path &filename, const std::vector<State> &states,
+                   const bool force) {
+  // The others share the name, the time stamps and the size of the first one
+  if (!check_members(states) || !states.front().validate()) {
+    return false;
+  }
+  const auto &front = states.front();
+  MappedEnsemble mapped;
+  if (!mapped.create(filename, front.name, static_cast<int64_t>(states.size()),
+                     static_cast<int64_t>(front.x.size()), front.sys_tim, front.obs_tim, force)) {
+    return false;
+  }
+  auto X = mapped.X();
+  for (const auto &state : states) {
+    std::copy(state.x.begin(), state.x.end(), X.col(state.id).data());
+  }
+  return mapped.close();
+}
+} // namespace
+
+bool to_ensemble(const std::vector<State> &states, Ensemble &ensemble) {
+  if (!check_members(states)) {
+    return false;
+  }
+  const auto &front = states.front();
+  ensemble.name = front.name;
+  ensemble.N = static_cast<int64_t>(states.size());
+  ensemble.k = static_cast<int64_t>(front.x.size());
+  ensemble.sys_tim = front.sys_tim;
+  ensemble.obs_tim = front.obs_tim;
+  ensemble.X.resize(ensemble.k * ensemble.N);
+  for (const auto &state : states) {
+    std::copy(state.x.begin(), state.x.end(), ensemble.X.begin() + state.id * ensemble.k);
+  }
+  return true;
+}
+
+bool to_ensemble(const MappedEnsemble &mapped, Ensemble &ensemble) {
+  if (!mapped.is_open()) {
+    std::clog << "ensemble not mapped" << std::endl;
+    return false;
+  }
+  const auto &header = mapped.header();
+  ensemble.name = mapped.name();
+  ensemble.N = header.N;
+  ensemble.k = header.k;
+  ensemble.sys_tim = header.sys_tim;
+  ensemble.obs_tim = header.obs_tim;
+  const auto X = mapped.X();
+  ensemble.X.resize(X.size());
+  copy_blocks(X.data(), ensemble.X.data(), X.size());
+  return true;
+}
+
+bool to_states(const Ensemble &ensemble, std::vector<State> &states) {
+  if (!ensemble.validate()) {
+    return false;
+  }
+  states.reserve(states.size() + ensemble.N);
+  for (int64_t id = 0; id < ensemble.N; ++id) {
+    const auto begin = ensemble.X.begin() + id * ensemble.k;
+    states.push_back(
+        {ensemble.name, id, ensemble.sys_tim, ensemble.obs_tim, {begin, begin + ensemble.k}});
+  }
+  return true;
+}
+
+bool to_states(const MappedEnsemble &mapped, std::vector<State> &states) {
+  if (!mapped.is_open()) {
+    std::clog << "ensemble not mapped" << std::endl;
+    return false;
+  }
+  const auto &header = mapped.header();
+  const std::string name{mapped.name()};
+  const auto X = mapped.X();
+  states.reserve(states.size() + header.N);
+  for (int64_t id = 0; id < header.N; ++id) {
+    const auto *begin = X.col(id).data();
+    states.push_back({name, id, header.sys_tim, header.obs_tim, {begin, begin + header.k}});
+  }
+  return true;
+}
+
+bool is_stdio(const std::string_view &path) { return path == stdio_path; }
+
+bool read_states(const std::string &input, std::vector<State> &states) {
+  if (is_stdio(input)) {
+    if (!is_binary(std::cin)) {
+      return read_ndjson(std::cin, states);
+    }
+    Ensemble ensemble;
+    return read_ensemble(std::cin, ensemble) && to_states(ensemble, states);
+  }
+  if (is_ensemble(input)) {
+    // The members are copied out of the mapping, without a snapshot in between
+    MappedEnsemble mapped;
+    if (!mapped.open(input)) {
+      return false;
+    }
+    mapped.advise_sequential();
+    return to_states(mapped, states);
+  }
+
+  std::vector<std::string> filenames;
+  if (!parse_filename(input, filenames, layout())) {
+    return false;
+  }
+  const auto offset = states.size();
+  states.resize(offset + filenames.size());
+  return for_each_file(static_cast<int64_t>(filenames.size()), [&](const int64_t i) {
+    return read_state(filenames[i], states[offset + i]);
+  });
+}
+
+bool read_states(const std::string &input, Ensemble &ensemble) {
+  if (is_stdio(input)) {
+    return is_binary(std::cin) ? read_ensemble(std::cin, ensemble)
+                               : read_ndjson(std::cin, ensemble);
+  }
+  if (is_ensemble(input)) {
+    return read_ensemble(input, ensemble);
+  }
+
+  std::vector<std::string> filenames;
+  if (!parse_filename(input, filenames, layout())) {
+    return false;
+  }
+  if (filenames.empty()) {
+    std::clog << "no state given" << std::endl;
+    return false;
+  }
+
+  // The first member gives the shape, the others are streamed into their column in file order
+  State front;
+  if (!read_state(filenames.front(), front)) {
+    return false;
+  }
+  ensemble.name = std::move(front.name);
+  ensemble.N = static_cast<int64_t>(filenames.size());
+  ensemble.k = static_cast<int64_t>(front.x.size());
+  ensemble.sys_tim = front.sys_tim;
+  ensemble.obs_tim = front.obs_tim;
+  ensemble.X.resize(ensemble.k * ensemble.N);
+  std::copy(front.x.begin(), front.x.end(), ensemble.X.begin());
+  front.x = {};
+
+  std::vector<int64_t> ids(ensemble.N);
+  ids[0] = front.id;
+  const auto read = [&](const int64_t i) {
+    StateHeader header;
+    if (!read_state(filenames[i], header,
+                    Eigen::Map<Eigen::VectorXd>{ensemble.X.data() + i * ensemble.k, ensemble.k})) {
+      return false;
+    }
+    if (header.name != ensemble.name || header.sys_tim != ensemble.sys_tim ||
+        header.obs_tim != ensemble.obs_tim) {
+      std::clog << filenames[i] << ": member of different name or timestamp given" << std::endl;
+      return false;
+    }
+    ids[i] = header.id;
+    return true;
+  };
+  if (!for_each_file(ensemble.N - 1, [&](const int64_t i) { return read(i + 1); })) {
+    return false;
+  }
+
+  return place_by_id(ensemble, ids);
+}
+
+bool write_states(const std::filesystem::path &output, const std::vector<State> &states,
+                  const Format format, const bool force) {
+  if (is_stdio(output.native())) {
+    if (format == Format::binary) {
+      Ensemble ensemble;
+      return to_ensemble(states, ensemble) && write_ensemble(std::cout, ensemble);
+    }
+    for (const auto &state : states) {
+      if (!(std::cout << to_text(state, JsonStyle::compact))) {
+        return false;
+      }
+    }
+    return static_cast<bool>(std::cout.flush());
+  }
+  if (is_store(output.native())) {
+    return write_members(output, states, true);
+  }
+  switch (format) {
+  case Format::json: {
+    AsyncWriter writer;
+    std::string directory;
+    for (const auto &state : states) {
+      if (!create_state_directory(output, state, directory) ||
+          !writer.write(output / state_path(state), to_text(state), force)) {
+        writer.wait();
+        return false;
+      }
+    }
+    return writer.wait();
+  }
+  case Format::binary: {
+    if (states.empty()) {
+      std::clog << "no state given" << std::endl;
+      return false;
+    }
+    const auto &front = states.front();
+    return write_members(output / ensemble_filename(front.name, front.sys_tim, front.obs_tim),
+                         states, force);
+  }
+  }
+  return false;
+}
+
+bool write_states(const std::filesystem::path &output, const Ensemble &ensemble,
+                  const Format format, const bool force) {
+  if (is_stdio(output.native())) {
+    if (format == Format::binary) {
+      return write_ensemble(std::cout, ensemble);
+    }
+    if (!ensemble.validate()) {
+      return false;
+    }
+    State state{ensemble.name, 0, ensemble.sys_tim, ensemble.obs_tim, {}};
+    for (int64_t id = 0; id < ensemble.N; ++id) {
+      const auto begin = ensemble.X.begin() + id * ensemble.k;
+      state.id = id;
+      state.x.assign(begin, begin + ensemble.k);
+      if (!(std::cout << to_text(state, JsonStyle::compact))) {
+        return false;
+      }
+    }
+    return static_cast<bool>(std::cout.flush());
+  }
+  if (is_store(output.native())) {
+    return write_ensemble(output, ensemble, true);
+  }
+  switch (format) {
+  case Format::json: {
+    if (!ensemble.validate()) {
+      return false;
+    }
+    // A member is serialized while the previous ones are written, the queue of the writer
+    // bounds the members held in memory
+    AsyncWriter writer;
+    std::string directory;
+    State state{ensemble.name, 0, ensemble.sys_tim, ensemble.obs_tim, {}};
+    for (int64_t id = 0; id < ensemble.N; ++id) {
+      const auto begin = ensemble.X.begin() + id * ensemble.k;
+      state.id = id;
+      state.x.assign(begin, begin + ensemble.k);
+      if (!create_state_directory(output, state, directory) ||
+          !writer.write(output / state_path(state), to_text(state), force)) {
+        writer.wait();
+        return false;
+      }
+    }
+    return writer.wait();
+  }
+  case Format::binary:
+    return write_ensemble(output / ensemble_filename(ensemble), ensemble, force);
+  }
+  return false;
+}
+
+std::string ensemble_filename(const std::string_view &name, const int64_t sys_tim,
+                              const int64_t obs_tim) {
+  std::stringstream ss;
+  ss << name << "_";
+  ss << std::setfill('0') << std::setw(6) << sys_tim << "_";
+  ss << std::setfill('0') << std::setw(6) << obs_tim << ".bin";
+  return ss.str();
+}
+
+std::string ensemble_filename(const Ensemble &ensemble) {
+  return ensemble_filename(ensemble.name, ensemble.sys_tim, ensemble.obs_tim);
+}
+} // namespace douka::io
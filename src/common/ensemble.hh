@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMON_ENSEMBLE__
+#define __DOUKA_COMMON_ENSEMBLE__
+
+#include "douka/io.hh"
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace douka::io {
+/**
+ * @brief Binary ensemble snapshot, all members of a time step in a single file.
+ *
+ * Layout (native byte order, checked by the byte order mark):
+ *   0   char[8]  magic "DOUKAENS"
+ *   8   uint32   version
+ *   12  uint32   byte order mark 0x01020304
+ *   16  uint64   offset of the state block
+ *   24  int64    N
+ *   32  int64    k
+ *   40  int64    sys_tim
+ *   48  int64    obs_tim
+ *   56  uint64   size of name
+ *   64  char[]   name
+ *   ... zero padding up to ensemble_alignment
+ *   offset double[k * N] column major, the column j is the member of id j
+ */
+struct Ensemble {
+  std::string name;
+  int64_t N = 0;
+  int64_t k = 0;
+  int64_t sys_tim = 0;
+  int64_t obs_tim = 0;
+  std::vector<double> X; // k x N column major
+
+  bool validate() const;
+};
+
+struct EnsembleHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t offset;
+  int64_t N;
+  int64_t k;
+  int64_t sys_tim;
+  int64_t obs_tim;
+  uint64_t name_size;
+};
+static_assert(sizeof(EnsembleHeader) == 64);
+
+inline static constexpr char ensemble_magic[8] = {'D', 'O', 'U', 'K', 'A', 'E', 'N', 'S'};
+inline static constexpr uint32_t ensemble_version = 1;
+inline static constexpr uint32_t ensemble_byte_order = 0x01020304;
+// The state block starts at a page boundary, so that it can be mapped into memory as it is
+inline static constexpr uint64_t ensemble_alignment = 4096;
+
+/**
+ * @brief Binary ensemble mapped into memory.
+ * The state block is exposed as an Eigen::Map on the mapping without copy, so a read goes at
+ * page cache speed and the pages can be evicted under memory pressure.
+ * A writable mapping is shared with the file, changes of the states and the header are
+ * written back to it.
+ */
+class MappedEnsemble {
+public:
+  MappedEnsemble() = default;
+  ~MappedEnsemble();
+  MappedEnsemble(const MappedEnsemble &) = delete;
+  MappedEnsemble &operator=(const MappedEnsemble &) = delete;
+  MappedEnsemble(MappedEnsemble &&other) noexcept;
+  MappedEnsemble &operator=(MappedEnsemble &&other) noexcept;
+
+  /**
+   * @brief Map an existing binary ensemble, the filename may name a store, see is_store()
+   */
+  bool open(const std::filesystem::path &filename, const bool writable = false);
+
+  /**
+   * @brief Create a binary ensemble of the given shape by ftruncate and map it writable.
+   * The states are left zero. The ensemble is complete once close() succeeds, it is removed if
+   * the mapping goes away before, so that a failed command leaves no ensemble of zero states.
+   */
+  bool create(const std::filesystem::path &filename, const std::string_view &name,
+              const int64_t N, const int64_t k, const int64_t sys_tim, const int64_t obs_tim,
+              const bool force = false);
+
+  /**
+   * @brief Flush a writable mapping to the file and unmap it
+   */
+  bool close();
+
+  /**
+   * @brief Hint the kernel that the states are accessed sequentially (madvise)
+   */
+  void advise_sequential() const;
+
+  inline bool is_open() const { return this->data != nullptr; }
+  inline EnsembleHeader &header() { return *static_cast<EnsembleHeader *>(this->data); }
+  inline const EnsembleHeader &header() const {
+    return *static_cast<const EnsembleHeader *>(this->data);
+  }
+  inline std::string_view name() const {
+    return {static_cast<const char *>(this->data) + sizeof(EnsembleHeader),
+            this->header().name_size};
+  }
+  inline Eigen::Map<Eigen::MatrixXd> X() {
+    return {reinterpret_cast<double *>(static_cast<char *>(this->data) + this->header().offset),
+            this->header().k, this->header().N};
+  }
+  inline Eigen::Map<const Eigen::MatrixXd> X() const {
+    return {reinterpret_cast<const double *>(static_cast<const char *>(this->data) +
+                                             this->header().offset),
+            this->header().k, this->header().N};
+  }
+
+private:
+  void discard();
+
+  void *data = nullptr;
+  std::size_t size = 0;
+  bool writable = false;
+  std::filesystem::path created; // Created by create() and not closed yet
+};
+
+/**
+ * @brief Output formats of the ensemble
+ *   json:   one file per member, see state_filename()
+ *   binary: one file per time step, see ensemble_filename()
+ */
+enum class Format { json, binary };
+inline static constexpr std::string_view format_names[] = {"json", "binary"};
+
+/**
+ * @brief Parse a format name, throws std::invalid_argument for an unknown one
+ */
+Format to_format(const std::string_view &name);
+
+/**
+ * @brief Whether the file starts with the magic of the binary ensemble
+ */
+bool is_ensemble(const std::filesystem::path &filename);
+
+bool read_ensemble(const std::filesystem::path &filename, Ensemble &ensemble);
+bool write_ensemble(const std::filesystem::path &filename, const Ensemble &ensemble,
+                    const bool force = false);
+
+/**
+ * @brief Binary ensemble on a stream, in the same layout as the file
+ */
+bool read_ensemble(std::istream &stream, Ensemble &ensemble);
+bool write_ensemble(std::ostream &stream, const Ensemble &ensemble);
+
+/**
+ * @brief Path of the standard input and output.
+ * The members are streamed as one compact json state per line (NDJSON) or as a binary ensemble,
+ * which is detected from the first byte when reading.
+ */
+inline static constexpr std::string_view stdio_path = "-";
+bool is_stdio(const std::string_view &path);
+
+/**
+ * @brief Ensemble store in POSIX shared memory, given as "shm:<experiment>" in place of a path.
+ * The store holds a binary ensemble in the same layout as the file. It outlives the process
+ * that created it, so that the next command attaches to it by mmap instead of reading files,
+ * until it is destroyed or the node reboots. Publishing to an existing store replaces it,
+ * the processes still attached to the previous one keep their mapping.
+ */
+inline static constexpr std::string_view store_prefix = "shm:";
+bool is_store(const std::string_view &path);
+bool exists_store(const std::string_view &path);
+bool destroy_store(const std::string_view &path);
+
+/**
+ * @brief Create the output directory unless the output is the standard output or a store
+ */
+bool create_output_directory(const std::filesystem::path &output);
+
+/**
+ * @brief Conversion between the members and the snapshot.
+ * The members must share the name and the time stamps and cover the ids 0 to N-1.
+ */
+bool to_ensemble(const std::vector<State> &states, Ensemble &ensemble);
+bool to_ensemble(const MappedEnsemble &mapped, Ensemble &ensemble);
+bool to_states(const Ensemble &ensemble, std::vector<State> &states);
+bool to_states(const MappedEnsemble &mapped, std::vector<State> &states);
+
+/**
+ * @brief Read the members from a binary ensemble or from the json files matching the input,
+ * see parse_filename()
+ */
+bool read_states(const std::string &input, std::vector<State> &states);
+
+/**
+ * @brief Read the members into a single k x N block.
+ * The json files are streamed into their column without an intermediate json tree or State,
+ * so that the peak memory is one copy of the ensemble.
+ */
+bool read_states(const std::string &input, Ensemble &ensemble);
+
+/**
+ * @brief Write the members to the output directory in the given format.
+ * A store is always written as a binary ensemble and replaced if it exists.
+ */
+bool write_states(const std::filesystem::path &output, const std::vector<State> &states,
+                  const Format format, const bool force = false);
+bool write_states(const std::filesystem::path &output, const Ensemble &ensemble,
+                  const Format format, const bool force = false);
+
+std::string ensemble_filename(const std::string_view &name, const int64_t sys_tim,
+                              const int64_t obs_tim);
+std::string ensemble_filename(const Ensemble &ensemble);
+} // namespace douka::io
+#endif
@@ -5,9 +5,14 @@
 
 #include "io.hh"
 
+#include <algorithm>
 #include <dlfcn.h>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string_view>
+#include <sys/stat.h>
 
 namespace douka::io {
 #if (defined(WIN32) || defined(WIN64))
@@ -98,4 +103,124 @@ PluginInterface::SharedPtr load_plugin(const std::filesystem::path &real_name) {
   }
   return PluginInterface::SharedPtr(plugin_generator());
 }
+
+typedef bool PluginConcurrentFunction();
+bool is_concurrent_plugin(const std::filesystem::path &real_name) {
+  const auto plugin_lib = dlopen(real_name.c_str(), RTLD_LAZY);
+  if (plugin_lib == nullptr) {
+    return false;
+  }
+  const auto concurrent =
+      reinterpret_cast<PluginConcurrentFunction *>(dlsym(plugin_lib, "concurrent"));
+  const bool result = concurrent != nullptr && concurrent();
+  dlclose(plugin_lib);
+  return result;
+}
+
+Layout &layout() {
+  static Layout instance;
+  return instance;
+}
+
+bool &use_filename_index() {
+  static bool enabled = false;
+  return enabled;
+}
+
+namespace {
+// Modification time and size of the path, the index is valid while they are unchanged
+bool stamp(const std::filesystem::path &path, int64_t &mtime, int64_t &size) {
+  std::error_code ec;
+  mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+  struct stat st;
+  if (ec || ::stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+  size = st.st_size;
+  return true;
+}
+} // namespace
+
+bool list_directory(const std::filesystem::path &dir, std::vector<std::string> &names) {
+  const auto path = dir.empty() ? std::filesystem::path{"."} : dir;
+  const auto index = path / filename_index;
+
+  const std::string header = "douka-index 2";
+  if (use_filename_index()) {
+    std::ifstream stream{index};
+    std::string line;
+    int64_t mtime, size, index_mtime, index_size;
+    if (stream && std::getline(stream, line) && stamp(path, mtime, size) &&
+        stamp(index, index_mtime, index_size) && mtime < index_mtime) {
+      std::istringstream ss{line};
+      std::string magic, version;
+      int64_t indexed_mtime = -1, indexed_size = -1, count = -1;
+      ss >> magic >> version >> indexed_mtime >> indexed_size >> count;
+      if (ss && magic + " " + version == header && indexed_mtime == mtime &&
+          indexed_size == size) {
+        const auto begin = names.size();
+        while (std::getline(stream, line)) {
+          names.emplace_back(line);
+        }
+        if (static_cast<int64_t>(names.size() - begin) == count) {
+          return true;
+        }
+        names.resize(begin);
+      }
+    }
+  }
+
+  std::error_code ec;
+  const auto begin = names.size();
+  for (const auto &entry : std::filesystem::directory_iterator{path, ec}) {
+    names.emplace_back(entry.path().filename().string());
+  }
+  if (ec) {
+    std::clog << path << " could not be listed: " << ec.message() << std::endl;
+    return false;
+  }
+
+  if (use_filename_index()) {
+    // Create the index before taking the stamp, rewriting it does not touch the directory
+    if (!std::filesystem::exists(index)) {
+      std::ofstream{index};
+    }
+    int64_t mtime, size;
+    if (!stamp(path, mtime, size)) {
+      return true;
+    }
+    const auto count = std::count_if(names.begin() + begin, names.end(),
+                                     [](const std::string &name) { return name != filename_index; });
+    std::ofstream stream{index, std::ios::trunc};
+    if (stream) {
+      stream << header << " " << mtime << " " << size << " " << count << "\n";
+      for (auto it = names.begin() + begin; it != names.end(); ++it) {
+        if (*it != filename_index) {
+          stream << *it << "\n";
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool parse_filename(const std::string &input, std::vector<std::string> &files,
+                    const Layout &layout) {
+  return detail::parse_filename(input, files, list_directory,
+                                layout.sharded ? layout.shard_size : 0);
+}
+
+std::string state_directory(const State &state) {
+  if (!layout().sharded) {
+    return {};
+  }
+  std::stringstream ss;
+  ss << std::setfill('0') << std::setw(6) << state.sys_tim << "/";
+  ss << state.id / layout().shard_size << "/";
+  return ss.str();
+}
+
+std::string state_path(const State &state) {
+  return state_directory(state) + state_filename(state, layout().id_width);
+}
 } // namespace douka::io
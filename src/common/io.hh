@@ -6,13 +6,72 @@
 #ifndef __DOUKA_COMMON_IO__
 #define __DOUKA_COMMON_IO__
 
+#include "douka/io.hh"
 #include "douka/plugin_interface.hh"
+#include <cstdint>
 #include <filesystem>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace douka::io {
 bool is_plugin(const std::filesystem::path &real_name);
 std::filesystem::path find_plugin(const std::string &name);
 PluginInterface::SharedPtr load_plugin(const std::filesystem::path &real_name);
+
+/**
+ * @brief Whether the plugin is registered by DOUKA_PLUGIN_REGISTER_CONCURRENT, so that its
+ * instances can run concurrently in separate threads
+ */
+bool is_concurrent_plugin(const std::filesystem::path &real_name);
+
+/**
+ * @brief Layout of the member files in the output directory
+ *   flat:    <output>/<name>_<id>_<sys_tim>_<obs_tim>.json
+ *   sharded: <output>/<sys_tim>/<id / shard_size>/<name>_<id>_<sys_tim>_<obs_tim>.json
+ * The id is zero padded to id_width digits.
+ * In the sharded layout, the members are read from the directory of the time step, for instance
+ * <output>/000001/<name>_%04d_000001_000000.json, and the shards are searched by parse_filename().
+ */
+struct Layout {
+  int64_t id_width = 4;
+  bool sharded = false;
+  int64_t shard_size = 1000;
+};
+
+Layout &layout();
+
+/**
+ * @brief Whether list_directory() keeps the listing of a directory in an index file,
+ * disabled by default
+ */
+bool &use_filename_index();
+
+inline static constexpr std::string_view filename_index = ".douka-index";
+
+/**
+ * @brief Names of the entries of a directory by a single readdir pass.
+ * With use_filename_index(), the names are cached in filename_index of the directory and
+ * read back while the modification time and the size of the directory are unchanged and the
+ * index holds as many names as it was written with. An index written within the same time stamp
+ * as the last change of the directory is not trusted, since a later entry may not have moved it.
+ */
+bool list_directory(const std::filesystem::path &dir, std::vector<std::string> &names);
+
+/**
+ * @brief parse_filename() of the layout, listing the directories by list_directory()
+ */
+bool parse_filename(const std::string &input, std::vector<std::string> &files,
+                    const Layout &layout);
+
+/**
+ * @brief Directory of the state relative to the output, empty unless layout().sharded
+ */
+std::string state_directory(const State &state);
+
+/**
+ * @brief Path of the state relative to the output
+ */
+std::string state_path(const State &state);
 } // namespace douka::io
 #endif
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "json.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+
+namespace douka::io {
+namespace {
+std::atomic<JsonStyle> g_style = JsonStyle::compact;
+
+template <typename T> void append(std::string &text, const T value) {
+  char buffer[32];
+  const auto [end, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value);
+  text.append(buffer, end);
+}
+
+void append_double(std::string &text, const double value) {
+  // Same as nlohmann::json, which has no representation of nan and inf
+  if (!std::isfinite(value)) {
+    text += "null";
+    return;
+  }
+  const auto begin = text.size();
+  append(text, value);
+  // Keep a number token of double such as 1.0 and -0.0, as nlohmann::json does
+  if (text.find_first_of(".e", begin) == std::string::npos) {
+    text += ".0";
+  }
+}
+
+/**
+ * @brief SAX handler of a state, see nlohmann::json_sax for the interface.
+ * Unknown fields are skipped, x is written to a fixed destination or appended to a vector.
+ */
+class StateSax {
+public:
+  using json = nlohmann::json;
+
+  StateSax(StateHeader &header, double *x, const int64_t size, std::vector<double> *grow)
+      : header(header), x(x), size(size), grow(grow) {}
+
+  bool null() { return this->scalar("null"); }
+  bool boolean(bool) { return this->scalar("boolean"); }
+  bool number_integer(json::number_integer_t value) { return this->number(value, true); }
+  bool number_unsigned(json::number_unsigned_t value) { return this->number(value, true); }
+  bool number_float(json::number_float_t value, const json::string_t &) {
+    return this->number(value, std::trunc(value) == value);
+  }
+  bool string(json::string_t &value) {
+    if (this->depth == 1 && this->field == Field::name) {
+      this->header.name = std::move(value);
+      this->found |= 1u << static_cast<int>(Field::name);
+      return true;
+    }
+    return this->scalar("string");
+  }
+  template <typename Binary> bool binary(Binary &) { return this->scalar("binary"); }
+
+  bool start_object(std::size_t) {
+    if (this->depth > 0 && this->is_known()) {
+      return this->error("unexpected object");
+    }
+    this->depth++;
+    return true;
+  }
+  bool key(json::string_t &name) {
+    if (this->depth == 1) {
+      this->field = to_field(name);
+    }
+    return true;
+  }
+  bool end_object() {
+    this->depth--;
+    return true;
+  }
+  bool start_array(std::size_t) {
+    if (this->depth == 1 && this->field == Field::x) {
+      this->in_x = true;
+    } else if (this->depth > 0 && this->is_known()) {
+      return this->error("unexpected array");
+    }
+    this->depth++;
+    return true;
+  }
+  bool end_array() {
+    this->depth--;
+    if (this->in_x && this->depth == 1) {
+      this->in_x = false;
+      this->found |= 1u << static_cast<int>(Field::x);
+    }
+    return true;
+  }
+  bool parse_error(std::size_t, const std::string &, const json::exception &e) {
+    this->message = e.what();
+    return false;
+  }
+
+  bool finish() {
+    static constexpr std::string_view names[] = {"name", "id", "sys_tim", "obs_tim", "x"};
+    for (int i = 0; i < 5; ++i) {
+      if (!(this->found & (1u << i))) {
+        return this->error("'" + std::string(names[i]) + "' not found");
+      }
+    }
+    if (this->grow == nullptr && this->count != this->size) {
+      return this->error("invalid state size " + std::to_string(this->count) +
+                         " != " + std::to_string(this->size));
+    }
+    return true;
+  }
+
+  std::string message;
+
+private:
+  enum class Field { name, id, sys_tim, obs_tim, x, unknown };
+
+  static Field to_field(const std::string_view &name) {
+    if (name == "name") {
+      return Field::name;
+    } else if (name == "id") {
+      return Field::id;
+    } else if (name == "sys_tim") {
+      return Field::sys_tim;
+    } else if (name == "obs_tim") {
+      return Field::obs_tim;
+    } else if (name == "x") {
+      return Field::x;
+    }
+    return Field::unknown;
+  }
+
+  // A value at the top level of a known field or an element of x
+  bool is_known() const {
+    return this->in_x || (this->depth == 1 && this->field != Field::unknown);
+  }
+
+  bool error(const std::string &message) {
+    this->message = message;
+    return false;
+  }
+
+  bool scalar(const std::string_view &type) {
+    if (this->is_known()) {
+      return this->error("unexpected " + std::string(type));
+    }
+    return true;
+  }
+
+  template <typename Number> bool number(const Number value, const bool integral) {
+    if (this->in_x) {
+      if (this->depth != 2) {
+        return this->error("unexpected nested array in 'x'");
+      }
+      if (this->grow != nullptr) {
+        this->grow->push_back(static_cast<double>(value));
+      } else if (this->count < this->size) {
+        this->x[this->count] = static_cast<double>(value);
+      }
+      this->count++;
+      return true;
+    }
+    if (this->depth != 1 || this->field == Field::unknown) {
+      return true;
+    }
+    if (!integral) {
+      return this->error("integer expected");
+    }
+    switch (this->field) {
+    case Field::id:
+      this->header.id = static_cast<int64_t>(value);
+      break;
+    case Field::sys_tim:
+      this->header.sys_tim = static_cast<int64_t>(value);
+      break;
+    case Field::obs_tim:
+      this->header.obs_tim = static_cast<int64_t>(value);
+      break;
+    default:
+      return this->error("unexpected number");
+    }
+    this->found |= 1u << static_cast<int>(this->field);
+    return true;
+  }
+
+  StateHeader &header;
+  double *x;
+  int64_t size;
+  std::vector<double> *grow;
+
+  int64_t depth = 0;
+  int64_t count = 0;
+  bool in_x = false;
+  Field field = Field::unknown;
+  unsigned found = 0;
+};
+
+bool read_file(const std::filesystem::path &filename, std::string &buffer) {
+  if (!std::filesystem::exists(filename)) {
+    std::clog << filename << " not exists" << std::endl;
+    return false;
+  }
+  if (!std::filesystem::is_regular_file(filename)) {
+    std::clog << filename << " is not a regular file" << std::endl;
+    return false;
+  }
+  std::ifstream stream{filename, std::ios::binary};
+  if (!stream) {
+    std::cerr << filename << " could not open" << std::endl;
+    return false;
+  }
+  buffer.resize(std::filesystem::file_size(filename));
+  if (!stream.read(buffer.data(), buffer.size())) {
+    std::cerr << filename << " failed to read" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool parse(const std::filesystem::path &filename, StateSax &sax) {
+  std::string buffer;
+  if (!read_file(filename, buffer)) {
+    return false;
+  }
+  if (!nlohmann::json::sax_parse(buffer, &sax) || !sax.finish()) {
+    std::clog << filename << ": " << sax.message << std::endl;
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+bool read_state(const std::filesystem::path &filename, StateHeader &header,
+                Eigen::Ref<Eigen::VectorXd> x) {
+  StateSax sax{header, x.data(), x.size(), nullptr};
+  return parse(filename, sax);
+}
+
+bool read_state(const std::filesystem::path &filename, State &state) {
+  StateHeader header;
+  state.x.clear();
+  StateSax sax{header, nullptr, 0, &state.x};
+  if (!parse(filename, sax)) {
+    return false;
+  }
+  state.name = std::move(header.name);
+  state.id = header.id;
+  state.sys_tim = header.sys_tim;
+  state.obs_tim = header.obs_tim;
+  return true;
+}
+
+bool parse_state(const std::string_view &text, State &state) {
+  StateHeader header;
+  state.x.clear();
+  StateSax sax{header, nullptr, 0, &state.x};
+  if (!nlohmann::json::sax_parse(text, &sax) || !sax.finish()) {
+    std::clog << "invalid state: " << sax.message << std::endl;
+    return false;
+  }
+  state.name = std::move(header.name);
+  state.id = header.id;
+  state.sys_tim = header.sys_tim;
+  state.obs_tim = header.obs_tim;
+  return true;
+}
+
+JsonStyle to_json_style(const std::string_view &name) {
+  const auto it = std::find(std::begin(json_style_names), std::end(json_style_names), name);
+  if (it == std::end(json_style_names)) {
+    throw std::invalid_argument("unknown json style '" + std::string{name} + "' given");
+  }
+  return static_cast<JsonStyle>(it - std::begin(json_style_names));
+}
+
+void set_json_style(const JsonStyle style) { g_style = style; }
+
+JsonStyle json_style() { return g_style; }
+
+std::string to_text(const State &state, const JsonStyle style) {
+  if (style == JsonStyle::pretty) {
+    return nlohmann::json(state).dump(2) + '\n';
+  }
+
+  // Keys in the order of nlohmann::json
+  std::string text;
+  text.reserve(96 + state.name.size() + 24 * state.x.size());
+  text += "{\"id\":";
+  append(text, state.id);
+  text += ",\"name\":";
+  text += nlohmann::json(state.name).dump();
+  text += ",\"obs_tim\":";
+  append(text, state.obs_tim);
+  text += ",\"sys_tim\":";
+  append(text, state.sys_tim);
+  text += ",\"x\":[";
+  for (std::size_t i = 0; i < state.x.size(); ++i) {
+    if (i > 0) {
+      text += ',';
+    }
+    append_double(text, state.x[i]);
+  }
+  text += "]}\n";
+  return text;
+}
+} // namespace douka::io
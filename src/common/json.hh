@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMON_JSON__
+#define __DOUKA_COMMON_JSON__
+
+#include "douka/io.hh"
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace douka::io {
+/**
+ * @brief Fields of a state file except x
+ */
+struct StateHeader {
+  std::string name;
+  int64_t id = -1;
+  int64_t sys_tim = -1;
+  int64_t obs_tim = -1;
+};
+
+/**
+ * @brief Streaming reader of a state json file.
+ * The file is parsed by the SAX interface without building the json tree, the header fields are
+ * checked and the values of x are written straight into the destination, whose size must be
+ * equal to the one of x.
+ */
+bool read_state(const std::filesystem::path &filename, StateHeader &header,
+                Eigen::Ref<Eigen::VectorXd> x);
+
+/**
+ * @brief Streaming reader of a state json file, x is resized as it is read
+ */
+bool read_state(const std::filesystem::path &filename, State &state);
+
+/**
+ * @brief Streaming reader of a state given as text, such as a line of NDJSON
+ */
+bool parse_state(const std::string_view &text, State &state);
+
+/**
+ * @brief Text style of the state files
+ *   compact: single line, doubles in the shortest form that reads back to the same value
+ *   pretty:  indented by 2 spaces, one value per line as write_json()
+ */
+enum class JsonStyle { compact, pretty };
+inline static constexpr std::string_view json_style_names[] = {"compact", "pretty"};
+
+/**
+ * @brief Parse a style name, throws std::invalid_argument for an unknown one
+ */
+JsonStyle to_json_style(const std::string_view &name);
+
+/**
+ * @brief Style of the state files written by write_states(), compact by default
+ */
+void set_json_style(const JsonStyle style);
+JsonStyle json_style();
+
+/**
+ * @brief Text of the state file terminated by a new line
+ */
+std::string to_text(const State &state, const JsonStyle style = json_style());
+} // namespace douka::io
+#endif
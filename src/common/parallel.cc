@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "parallel.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <utility>
+
+namespace douka::io {
+namespace {
+std::atomic<int64_t> g_threads = 1;
+
+// Smallest block of copy_blocks() [doubles], 8 MiB
+constexpr int64_t copy_block = 1 << 20;
+} // namespace
+
+void set_io_threads(const int64_t threads) { g_threads = std::max<int64_t>(threads, 1); }
+
+int64_t io_threads() { return g_threads; }
+
+FileWorkers::FileWorkers(const int64_t threads, const int64_t capacity)
+    : capacity(capacity > 0 ? capacity : 2 * std::max<int64_t>(threads, 1)) {
+  this->workers.reserve(std::max<int64_t>(threads, 0));
+  for (int64_t i = 0; i < threads; ++i) {
+    this->workers.emplace_back([this] { this->work(); });
+  }
+}
+
+FileWorkers::~FileWorkers() {
+  {
+    const std::lock_guard<std::mutex> lock{this->mutex};
+    this->stop = true;
+  }
+  this->not_empty.notify_all();
+  for (auto &worker : this->workers) {
+    worker.join();
+  }
+}
+
+bool FileWorkers::submit(const int64_t index, std::function<bool()> task) {
+  if (this->workers.empty()) {
+    if (!this->failed.empty()) {
+      return false;
+    }
+    if (!task()) {
+      this->failed.emplace_back(index);
+      return false;
+    }
+    return true;
+  }
+
+  std::unique_lock<std::mutex> lock{this->mutex};
+  this->not_full.wait(lock, [this] {
+    return static_cast<int64_t>(this->queue.size()) < this->capacity || !this->failed.empty();
+  });
+  if (!this->failed.empty()) {
+    return false;
+  }
+  this->queue.push_back({index, std::move(task)});
+  lock.unlock();
+  this->not_empty.notify_one();
+  return true;
+}
+
+bool FileWorkers::wait() {
+  std::unique_lock<std::mutex> lock{this->mutex};
+  this->idle.wait(lock, [this] { return this->queue.empty() && this->running == 0; });
+  if (this->error) {
+    const auto error = std::exchange(this->error, nullptr);
+    this->failed.clear();
+    std::rethrow_exception(error);
+  }
+  if (this->failed.empty()) {
+    return true;
+  }
+  std::sort(this->failed.begin(), this->failed.end());
+  std::clog << "failed to process file";
+  for (const auto index : this->failed) {
+    std::clog << " " << index;
+  }
+  std::clog << std::endl;
+  return false;
+}
+
+void FileWorkers::work() {
+  std::unique_lock<std::mutex> lock{this->mutex};
+  while (true) {
+    this->not_empty.wait(lock, [this] { return !this->queue.empty() || this->stop; });
+    if (this->queue.empty()) {
+      return;
+    }
+    auto task = std::move(this->queue.front());
+    this->queue.pop_front();
+    this->running++;
+    lock.unlock();
+    this->not_full.notify_one();
+
+    // An exception is rethrown by wait() in the thread of the producer
+    bool ok = false;
+    std::exception_ptr error;
+    try {
+      ok = task.run();
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    lock.lock();
+    this->running--;
+    if (error && !this->error) {
+      this->error = error;
+    }
+    if (!ok) {
+      // Drop the queued tasks, the producer is released by not_full
+      this->failed.emplace_back(task.index);
+      this->queue.clear();
+      this->not_full.notify_all();
+    }
+    if (this->queue.empty() && this->running == 0) {
+      this->idle.notify_all();
+    }
+  }
+}
+
+bool for_each_file(const int64_t n, const std::function<bool(int64_t)> &task) {
+  // A single thread runs inline rather than behind a queue
+  FileWorkers workers{io_threads() > 1 ? std::min(io_threads(), n) : 0};
+  for (int64_t i = 0; i < n; ++i) {
+    if (!workers.submit(i, [&task, i] { return task(i); })) {
+      break;
+    }
+  }
+  return workers.wait();
+}
+
+void copy_blocks(const double *src, double *dst, const int64_t size) {
+  const auto n = std::clamp<int64_t>(size / copy_block, 1, io_threads());
+  const auto block = (size + n - 1) / n;
+  for_each_file(n, [=](const int64_t i) {
+    const auto begin = std::min(i * block, size), end = std::min(begin + block, size);
+    std::copy(src + begin, src + end, dst + begin);
+    return true;
+  });
+}
+} // namespace douka::io
+
+namespace douka::common {
+namespace {
+std::atomic<int64_t> g_threads = std::max<int64_t>(std::thread::hardware_concurrency(), 1);
+} // namespace
+
+void set_compute_threads(const int64_t threads) { g_threads = std::max<int64_t>(threads, 1); }
+
+int64_t compute_threads() { return g_threads; }
+
+bool parallel_for(const int64_t n, const std::function<bool(int64_t, int64_t)> &task,
+                  const int64_t threads) {
+  const auto count = std::clamp<int64_t>(threads, 1, std::max<int64_t>(n, 1));
+  std::atomic<int64_t> next = 0;
+  std::atomic<bool> ok = true;
+  // The first exception of the tasks is rethrown in the calling thread once all have joined
+  std::mutex mutex;
+  std::exception_ptr error;
+  const auto work = [&](const int64_t thread) {
+    for (auto i = next++; i < n && ok; i = next++) {
+      try {
+        if (!task(i, thread)) {
+          ok = false;
+        }
+      } catch (...) {
+        ok = false;
+        const std::lock_guard<std::mutex> lock{mutex};
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  };
+
+  // A single thread runs inline
+  std::vector<std::thread> workers;
+  workers.reserve(count - 1);
+  for (int64_t thread = 1; thread < count; ++thread) {
+    workers.emplace_back(work, thread);
+  }
+  work(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return ok;
+}
+
+ThreadPool::ThreadPool(const int64_t threads) {
+  this->workers.reserve(std::max<int64_t>(threads - 1, 0));
+  for (int64_t thread = 1; thread < threads; ++thread) {
+    this->workers.emplace_back([this, thread] { this->work(thread); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    const std::lock_guard<std::mutex> lock{this->mutex};
+    this->stop = true;
+  }
+  this->start.notify_all();
+  for (auto &worker : this->workers) {
+    worker.join();
+  }
+}
+
+bool ThreadPool::run(const int64_t n, const void *task, const Invoke invoke) {
+  const auto count = std::clamp<int64_t>(this->size(), 1, std::max<int64_t>(n, 1));
+  this->task = task;
+  this->invoke = invoke;
+  this->n = n;
+  this->next = 0;
+  this->ok = true;
+  this->error = nullptr;
+  if (count > 1) {
+    {
+      const std::lock_guard<std::mutex> lock{this->mutex};
+      this->count = count;
+      this->pending = count - 1;
+      this->generation++;
+    }
+    this->start.notify_all();
+  }
+  this->run_tasks(0);
+  if (count > 1) {
+    std::unique_lock<std::mutex> lock{this->mutex};
+    this->done.wait(lock, [this] { return this->pending == 0; });
+  }
+  if (this->error) {
+    std::rethrow_exception(std::exchange(this->error, nullptr));
+  }
+  return this->ok;
+}
+
+void ThreadPool::work(const int64_t thread) {
+  uint64_t seen = 0;
+  std::unique_lock<std::mutex> lock{this->mutex};
+  while (true) {
+    this->start.wait(lock, [this, seen] { return this->stop || this->generation != seen; });
+    if (this->stop) {
+      return;
+    }
+    seen = this->generation;
+    // Fewer tasks than threads leave the others asleep
+    if (thread >= this->count) {
+      continue;
+    }
+    lock.unlock();
+    this->run_tasks(thread);
+    lock.lock();
+    if (--this->pending == 0) {
+      this->done.notify_one();
+    }
+  }
+}
+
+void ThreadPool::run_tasks(const int64_t thread) {
+  for (auto i = this->next++; i < this->n && this->ok; i = this->next++) {
+    try {
+      if (!this->invoke(this->task, i, thread)) {
+        this->ok = false;
+      }
+    } catch (...) {
+      this->ok = false;
+      const std::lock_guard<std::mutex> lock{this->mutex};
+      if (!this->error) {
+        this->error = std::current_exception();
+      }
+    }
+  }
+}
+} // namespace douka::common
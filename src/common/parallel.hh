@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMON_PARALLEL__
+#define __DOUKA_COMMON_PARALLEL__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace douka::io {
+/**
+ * @brief Number of threads of the file I/O, 1 (default) runs the tasks in the calling thread
+ */
+void set_io_threads(const int64_t threads);
+int64_t io_threads();
+
+/**
+ * @brief Worker threads running per-file tasks from a bounded queue.
+ * submit() blocks while the queue is full, so that a producer does not run ahead of the disk.
+ * A failed task stops the remaining ones from being run, the failed indices are reported in
+ * ascending order by wait().
+ * With no thread, the tasks are run in the calling thread by submit().
+ */
+class FileWorkers {
+public:
+  explicit FileWorkers(const int64_t threads = io::io_threads(), const int64_t capacity = 0);
+  ~FileWorkers();
+  FileWorkers(const FileWorkers &) = delete;
+  FileWorkers &operator=(const FileWorkers &) = delete;
+
+  /**
+   * @brief Queue the task of the file of the given index, returns false once a task has failed
+   */
+  bool submit(const int64_t index, std::function<bool()> task);
+
+  /**
+   * @brief Wait for the queued tasks, returns false if any of them failed.
+   * The first exception thrown by a task on a worker is rethrown here.
+   */
+  bool wait();
+
+private:
+  struct Task {
+    int64_t index;
+    std::function<bool()> run;
+  };
+
+  void work();
+
+  int64_t capacity;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable not_empty, not_full, idle;
+  std::deque<Task> queue;
+  int64_t running = 0;
+  bool stop = false;
+  std::vector<int64_t> failed;
+  std::exception_ptr error;
+};
+
+/**
+ * @brief Run task(i) for the files 0 to n-1 on the I/O threads, returns false if any failed
+ */
+bool for_each_file(const int64_t n, const std::function<bool(int64_t)> &task);
+
+/**
+ * @brief Copy between a mapped ensemble and memory in blocks on the I/O threads, so that the
+ * page faults of the mapping are served concurrently
+ */
+void copy_blocks(const double *src, double *dst, const int64_t size);
+} // namespace douka::io
+
+namespace douka::common {
+/**
+ * @brief Number of threads of the computations over independent members or truths,
+ * the number of cores by default
+ */
+void set_compute_threads(const int64_t threads);
+int64_t compute_threads();
+
+/**
+ * @brief Run task(i, thread) for i in 0 to n-1 on up to the given number of threads.
+ * The thread is the index 0 to threads-1 of the running thread, e.g. for per-thread state.
+ * A failed task stops the remaining ones, returns false if any failed. The first exception
+ * thrown by a task is rethrown once all the threads joined.
+ */
+bool parallel_for(const int64_t n, const std::function<bool(int64_t, int64_t)> &task,
+                  const int64_t threads = common::compute_threads());
+
+/**
+ * @brief Threads kept for repeated parallel_for(), e.g. once per cycle of the filter, so that
+ * a call only wakes them instead of starting new ones.
+ * The calling thread takes part as the thread 0, a pool of a single thread runs inline.
+ * A task must not call parallel_for() of the same pool.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(const int64_t threads = common::compute_threads());
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * @brief parallel_for() on the threads of the pool, the task is not copied
+   */
+  template <typename Task> bool parallel_for(const int64_t n, const Task &task) {
+    return this->run(n, &task, [](const void *task, const int64_t i, const int64_t thread) {
+      return (*static_cast<const Task *>(task))(i, thread);
+    });
+  }
+
+  inline int64_t size() const { return static_cast<int64_t>(this->workers.size()) + 1; }
+
+private:
+  using Invoke = bool (*)(const void *, int64_t, int64_t);
+
+  bool run(const int64_t n, const void *task, const Invoke invoke);
+  void work(const int64_t thread);
+  void run_tasks(const int64_t thread);
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable start, done;
+  uint64_t generation = 0;
+  bool stop = false;
+
+  // The job of the current generation
+  const void *task = nullptr;
+  Invoke invoke = nullptr;
+  int64_t n = 0, count = 0, pending = 0;
+  std::atomic<int64_t> next = 0;
+  std::atomic<bool> ok = true;
+  std::exception_ptr error;
+};
+} // namespace douka::common
+#endif
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "profile.hh"
+#include "douka/io.hh"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace douka::common::profile {
+namespace {
+struct Event {
+  std::string name;
+  int64_t tid;
+  double ts;  // [us]
+  double dur; // [us]
+  int64_t peak_rss;
+  int64_t rss;
+  int64_t heap;
+  alloc::Stats allocs;
+};
+
+struct Recorder {
+  std::atomic<bool> enabled = false;
+  std::filesystem::path filename;
+  std::chrono::steady_clock::time_point origin;
+  std::mutex mutex;
+  std::vector<Event> events;
+};
+
+Recorder &recorder() {
+  static Recorder instance;
+  return instance;
+}
+
+int64_t thread_index() {
+  static std::atomic<int64_t> count = 0;
+  thread_local const int64_t index = count++;
+  return index;
+}
+
+// Peak resident set size [kB]
+int64_t peak_rss() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return -1;
+  }
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+// Current resident set size [kB]
+int64_t rss() {
+#if defined(__linux__)
+  std::ifstream stream{"/proc/self/statm"};
+  int64_t size = 0, resident = 0;
+  if (!(stream >> size >> resident)) {
+    return -1;
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+  return -1;
+#endif
+}
+
+// Heap bytes in use
+int64_t heap() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  const auto info = mallinfo2();
+  return static_cast<int64_t>(info.uordblks + info.hblkhd);
+#else
+  return -1;
+#endif
+}
+
+double elapsed(const std::chrono::steady_clock::time_point &from,
+               const std::chrono::steady_clock::time_point &to) {
+  return std::chrono::duration<double, std::micro>(to - from).count();
+}
+
+// The heap peak is reset by each phase, a scope takes the largest of the phases within it
+void record(std::string name, const std::chrono::steady_clock::time_point &begin,
+            const alloc::Stats &allocs, const bool phase) {
+  auto &r = recorder();
+  const auto end = std::chrono::steady_clock::now();
+  Event event{std::move(name), thread_index(), elapsed(r.origin, begin), elapsed(begin, end),
+              peak_rss(),      rss(),          heap(),                   alloc::stats() - allocs};
+
+  const std::lock_guard<std::mutex> lock{r.mutex};
+  if (!phase) {
+    for (const auto &other : r.events) {
+      if (other.ts >= event.ts) {
+        event.allocs.peak = std::max(event.allocs.peak, other.allocs.peak);
+      }
+    }
+  }
+  r.events.emplace_back(std::move(event));
+}
+} // namespace
+
+void enable(const std::filesystem::path &filename) {
+  auto &r = recorder();
+  const std::lock_guard<std::mutex> lock{r.mutex};
+  r.filename = filename;
+  r.origin = std::chrono::steady_clock::now();
+  r.events.clear();
+  r.enabled = true;
+}
+
+bool enabled() { return recorder().enabled; }
+
+nlohmann::json trace() {
+  auto &r = recorder();
+  const auto pid = static_cast<int64_t>(getpid());
+
+  nlohmann::json events = nlohmann::json::array();
+  const std::lock_guard<std::mutex> lock{r.mutex};
+  for (const auto &event : r.events) {
+    nlohmann::json args = {
+        {"peak_rss_kb", event.peak_rss},
+        {"rss_kb", event.rss},
+        {"heap", event.heap},
+    };
+    if (alloc::enabled()) {
+      args["alloc_count"] = event.allocs.count;
+      args["alloc_bytes"] = event.allocs.bytes;
+      args["heap_peak"] = event.allocs.peak;
+    }
+    events.push_back({
+        {"name", event.name},
+        {"cat", "douka"},
+        {"ph", "X"},
+        {"pid", pid},
+        {"tid", event.tid},
+        {"ts", event.ts},
+        {"dur", event.dur},
+        {"args", args},
+    });
+    events.push_back({
+        {"name", "memory"},
+        {"cat", "douka"},
+        {"ph", "C"},
+        {"pid", pid},
+        {"tid", event.tid},
+        {"ts", event.ts + event.dur},
+        {"args", {{"peak_rss_kb", event.peak_rss}, {"rss_kb", event.rss}}},
+    });
+  }
+
+  return {{"traceEvents", events}, {"displayTimeUnit", "ms"}};
+}
+
+bool write() {
+  if (!enabled()) {
+    return true;
+  }
+  return io::write_json(recorder().filename, trace(), true);
+}
+
+Scope::Scope(std::string_view name)
+    : name(name), begin(std::chrono::steady_clock::now()), allocs(alloc::stats()),
+      active(enabled()) {}
+
+Scope::~Scope() {
+  if (active) {
+    record(std::move(this->name), this->begin, this->allocs, false);
+  }
+}
+
+Phase::Phase(std::string_view name)
+    : name(name), begin(std::chrono::steady_clock::now()), allocs(alloc::stats()),
+      active(enabled()) {
+  if (this->active) {
+    alloc::reset_peak();
+  }
+}
+
+Phase::~Phase() { this->close(); }
+
+void Phase::next(std::string_view name) {
+  this->close();
+  this->name = name;
+  this->begin = std::chrono::steady_clock::now();
+  this->allocs = alloc::stats();
+  this->active = enabled();
+  if (this->active) {
+    alloc::reset_peak();
+  }
+}
+
+void Phase::close() {
+  if (this->active) {
+    record(this->name, this->begin, this->allocs, true);
+    this->active = false;
+  }
+}
+} // namespace douka::common::profile
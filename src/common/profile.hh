@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMON_PROFILE__
+#define __DOUKA_COMMON_PROFILE__
+
+#include "common/alloc.hh"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include <nlohmann/json.hpp>
+
+namespace douka::common::profile {
+/**
+ * @brief Start recording events. The trace is written to filename by write().
+ */
+void enable(const std::filesystem::path &filename);
+bool enabled();
+
+/**
+ * @brief Recorded events in Chrome trace event format
+ * (https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU)
+ */
+nlohmann::json trace();
+
+/**
+ * @brief Write recorded events to the file given by enable()
+ */
+bool write();
+
+/**
+ * @brief Scoped timer recorded as a complete event ("ph": "X").
+ * Allocations within the scope are recorded when alloc::enabled(), its heap peak is the largest
+ * of the phases within it.
+ */
+class Scope {
+public:
+  explicit Scope(std::string_view name);
+  ~Scope();
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+
+private:
+  std::string name;
+  std::chrono::steady_clock::time_point begin;
+  alloc::Stats allocs;
+  bool active;
+};
+
+/**
+ * @brief Sequential phases of a command.
+ * Starting a new phase closes the previous one, the last one is closed on destruction.
+ * Each phase resets the heap peak, so that the peak is that of the phase.
+ */
+class Phase {
+public:
+  explicit Phase(std::string_view name);
+  ~Phase();
+  Phase(const Phase &) = delete;
+  Phase &operator=(const Phase &) = delete;
+
+  void next(std::string_view name);
+
+private:
+  void close();
+
+  std::string name;
+  std::chrono::steady_clock::time_point begin;
+  alloc::Stats allocs;
+  bool active;
+};
+} // namespace douka::common::profile
+#endif
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ranks.hh"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace douka::common {
+/*
+ * Head of the segment, followed by the slots of ranks x capacity doubles.
+ * The segment is zero filled by ftruncate, so the counters start at 0.
+ */
+struct alignas(64) RankGroup::Control {
+  std::atomic<uint32_t> ready;   // set by the rank 0 once ranks and capacity are written
+  std::atomic<uint32_t> aborted; // set by a rank leaving without close()
+  std::atomic<int64_t> count;    // ranks arrived at the current barrier
+  std::atomic<int64_t> generation;
+  int64_t ranks;
+  int64_t capacity;
+  int64_t creator; // pid of the rank 0
+};
+static_assert(std::atomic<int64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "the counters are shared between processes");
+
+namespace {
+bool job_object(const std::string_view &job, std::string &object) {
+  if (job.empty() || job.size() > 200 ||
+      !std::all_of(job.begin(), job.end(), [](const char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.';
+      })) {
+    return false;
+  }
+  object = "/douka.ranks." + std::string{job};
+  return true;
+}
+
+void pause(int64_t &spins) {
+  if (++spins < 1024) {
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds{100});
+  }
+}
+} // namespace
+
+RankGroup::~RankGroup() {
+  if (this->is_open()) {
+    this->control->aborted.store(1, std::memory_order_release);
+    if (this->group_rank == 0) {
+      shm_unlink(this->object.c_str());
+    }
+    this->release();
+  }
+}
+
+template <typename Predicate> bool RankGroup::wait(const Predicate &done) const {
+  const auto deadline = std::chrono::steady_clock::now() + this->timeout;
+  for (int64_t spins = 0; !done(); pause(spins)) {
+    if (this->control->aborted.load(std::memory_order_acquire)) {
+      std::clog << "rank " << this->group_rank << ": another rank of the job failed" << std::endl;
+      return false;
+    }
+    if (std::chrono::steady_clock::now() > deadline) {
+      std::clog << "rank " << this->group_rank << ": timed out waiting for the other ranks"
+                << std::endl;
+      this->control->aborted.store(1, std::memory_order_release);
+      return false;
+    }
+  }
+  return true;
+}
+
+void RankGroup::release() {
+  munmap(this->control, this->size);
+  this->control = nullptr;
+  this->slots = nullptr;
+  this->size = 0;
+}
+
+bool RankGroup::open(const std::string_view &job, const int64_t ranks, const int64_t rank,
+                     const int64_t capacity, const std::chrono::milliseconds timeout) {
+  if (this->is_open()) {
+    std::clog << "rank " << this->group_rank << " already joined a job" << std::endl;
+    return false;
+  }
+  if (ranks < 1 || rank < 0 || rank >= ranks || capacity < 0) {
+    std::clog << "invalid rank " << rank << " of " << ranks << " given" << std::endl;
+    return false;
+  }
+  if (!job_object(job, this->object)) {
+    std::clog << "invalid job name '" << job << "' given" << std::endl;
+    return false;
+  }
+  const auto size = sizeof(Control) + static_cast<std::size_t>(ranks * capacity) * sizeof(double);
+
+  int fd = -1;
+  if (rank == 0) {
+    // A segment of the same name is left by a failed job
+    shm_unlink(this->object.c_str());
+    fd = shm_open(this->object.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+      std::clog << this->object << " could not create: " << std::strerror(errno) << std::endl;
+      if (fd >= 0) {
+        ::close(fd);
+        shm_unlink(this->object.c_str());
+      }
+      return false;
+    }
+  }
+
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  for (int64_t spins = 0;; pause(spins)) {
+    if (rank > 0) {
+      fd = shm_open(this->object.c_str(), O_RDWR, 0);
+    }
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= size) {
+      void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (data == MAP_FAILED) {
+        std::clog << this->object << " could not map: " << std::strerror(errno) << std::endl;
+        if (rank == 0) {
+          shm_unlink(this->object.c_str());
+        }
+        return false;
+      }
+      auto *control = static_cast<Control *>(data);
+      if (rank == 0) {
+        control->ranks = ranks;
+        control->capacity = capacity;
+        control->creator = getpid();
+        control->ready.store(1, std::memory_order_release);
+      }
+      // The segment of a failed job is skipped until the rank 0 replaces it
+      if (control->ready.load(std::memory_order_acquire) &&
+          !control->aborted.load(std::memory_order_acquire) &&
+          (rank == 0 || kill(static_cast<pid_t>(control->creator), 0) == 0 || errno != ESRCH)) {
+        if (control->ranks != ranks || control->capacity != capacity) {
+          std::clog << this->object << " is a job of " << control->ranks << " ranks" << std::endl;
+          munmap(data, size);
+          return false;
+        }
+        this->control = control;
+        this->slots = reinterpret_cast<double *>(control + 1);
+        break;
+      }
+      munmap(data, size);
+    } else if (fd >= 0) {
+      ::close(fd);
+    }
+    if (rank == 0 || std::chrono::steady_clock::now() > deadline) {
+      std::clog << this->object << " could not join" << std::endl;
+      return false;
+    }
+  }
+  this->size = size;
+  this->group_ranks = ranks;
+  this->group_rank = rank;
+  this->capacity = capacity;
+  this->timeout = timeout;
+  return true;
+}
+
+bool RankGroup::barrier() {
+  if (!this->is_open()) {
+    return true;
+  }
+  auto &control = *this->control;
+  const auto generation = control.generation.load(std::memory_order_acquire);
+  if (control.count.fetch_add(1, std::memory_order_acq_rel) == this->group_ranks - 1) {
+    control.count.store(0, std::memory_order_relaxed);
+    control.generation.store(generation + 1, std::memory_order_release);
+    return true;
+  }
+  return this->wait([&control, generation]() {
+    return control.generation.load(std::memory_order_acquire) != generation;
+  });
+}
+
+bool RankGroup::allreduce(double *data, const int64_t size) {
+  if (!this->is_open()) {
+    return true;
+  }
+  if (size > this->capacity) {
+    std::clog << "reduction of " << size << " exceeds the capacity " << this->capacity
+              << std::endl;
+    return false;
+  }
+  std::copy(data, data + size, this->slots + this->group_rank * this->capacity);
+  if (!this->barrier()) {
+    return false;
+  }
+  std::copy(this->slots, this->slots + size, data);
+  for (int64_t rank = 1; rank < this->group_ranks; ++rank) {
+    const auto *slot = this->slots + rank * this->capacity;
+    for (int64_t i = 0; i < size; ++i) {
+      data[i] += slot[i];
+    }
+  }
+  // The slots are not written by the next reduction until every rank has read them
+  return this->barrier();
+}
+
+bool RankGroup::close() {
+  if (!this->is_open()) {
+    return true;
+  }
+  if (!this->barrier()) {
+    return false;
+  }
+  if (this->group_rank == 0) {
+    shm_unlink(this->object.c_str());
+  }
+  this->release();
+  return true;
+}
+} // namespace douka::common
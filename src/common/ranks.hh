@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMON_RANKS__
+#define __DOUKA_COMMON_RANKS__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace douka::common {
+/**
+ * @brief Processes of a job on a node, each given by its rank 0 to ranks-1.
+ * The ranks exchange through a POSIX shared memory segment "/douka.ranks.<job>" created by the
+ * rank 0, the others attach to it as it appears. A sum is reduced by each rank writing its
+ * operand to its own slot, so that every rank adds up the slots in the same rank order and
+ * gets the same bits.
+ * A rank that goes away without close() marks the segment aborted, the others fail at their
+ * next barrier instead of waiting for the timeout.
+ */
+class RankGroup {
+public:
+  RankGroup() = default;
+  ~RankGroup();
+  RankGroup(const RankGroup &) = delete;
+  RankGroup &operator=(const RankGroup &) = delete;
+
+  /**
+   * @brief Join the job as the rank, reductions of up to capacity doubles are available.
+   * The job should be a plain name, the same for all the ranks and unique among the running
+   * jobs of the node. The segment left by a failed job of the same name is replaced.
+   */
+  bool open(const std::string_view &job, const int64_t ranks, const int64_t rank,
+            const int64_t capacity,
+            const std::chrono::milliseconds timeout = std::chrono::minutes{5});
+
+  /**
+   * @brief Wait for all the ranks
+   */
+  bool barrier();
+
+  /**
+   * @brief Sum of data over the ranks in place, size should not exceed the capacity
+   */
+  bool allreduce(double *data, const int64_t size);
+
+  /**
+   * @brief Wait for all the ranks and leave the job, the rank 0 removes the segment
+   */
+  bool close();
+
+  /**
+   * @brief Rows [begin, begin + size) of n rows owned by the rank, contiguous and balanced
+   */
+  struct Slice {
+    int64_t begin;
+    int64_t size;
+  };
+  inline Slice slice(const int64_t n) const {
+    const auto begin = n * this->group_rank / this->group_ranks;
+    return {begin, n * (this->group_rank + 1) / this->group_ranks - begin};
+  }
+
+  inline bool is_open() const { return this->control != nullptr; }
+  inline int64_t ranks() const { return this->group_ranks; }
+  inline int64_t rank() const { return this->group_rank; }
+
+private:
+  struct Control;
+
+  template <typename Predicate> bool wait(const Predicate &done) const;
+  void release();
+
+  std::string object;
+  Control *control = nullptr;
+  double *slots = nullptr;
+  std::size_t size = 0;
+  int64_t group_ranks = 1;
+  int64_t group_rank = 0;
+  int64_t capacity = 0;
+  std::chrono::milliseconds timeout{0};
+};
+} // namespace douka::common
+#endif
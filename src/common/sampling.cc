@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "sampling.hh"
+#include "compute.hh"
+
+#include <Eigen/Cholesky>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+
+namespace douka::common::sampling {
+namespace {
+#include "sobol_directions.inc"
+
+template <std::size_t Size>
+double polynomial(const double (&coefficients)[Size], const double x) {
+  double value = 0.0;
+  for (std::size_t i = Size; i-- > 0;) {
+    value = value * x + coefficients[i];
+  }
+  return value;
+}
+
+// Product of the polynomials a and b over GF(2) modulo the polynomial p of the given degree
+uint64_t multiply(uint64_t a, uint64_t b, const uint64_t p, const int degree) {
+  uint64_t product = 0;
+  for (; b != 0; b >>= 1) {
+    if (b & 1) {
+      product ^= a;
+    }
+    a <<= 1;
+    if ((a >> degree) & 1) {
+      a ^= p;
+    }
+  }
+  return product;
+}
+
+uint64_t power(uint64_t a, uint64_t e, const uint64_t p, const int degree) {
+  uint64_t result = 1;
+  for (; e != 0; e >>= 1) {
+    if (e & 1) {
+      result = multiply(result, a, p, degree);
+    }
+    a = multiply(a, a, p, degree);
+  }
+  return result;
+}
+
+// A polynomial of the given degree is primitive if x is of the order 2^degree - 1 modulo it
+bool is_primitive(const uint64_t p, const int degree) {
+  if ((p & 1) == 0) {
+    return false;
+  }
+  const uint64_t order = (uint64_t{1} << degree) - 1;
+  const uint64_t x = degree == 1 ? (2 ^ p) : 2;
+  if (power(x, order, p, degree) != 1) {
+    return false;
+  }
+  auto rest = order;
+  for (uint64_t q = 2; q * q <= rest; ++q) {
+    if (rest % q != 0) {
+      continue;
+    }
+    if (power(x, order / q, p, degree) == 1) {
+      return false;
+    }
+    while (rest % q == 0) {
+      rest /= q;
+    }
+  }
+  return rest == 1 || power(x, order / rest, p, degree) != 1;
+}
+
+// Advance p to the next primitive polynomial in ascending order, p = 1 before the first one
+void next_primitive(uint64_t &p, int &degree) {
+  do {
+    p += 2;
+    if (p >= (uint64_t{2} << degree)) {
+      degree++;
+      p = (uint64_t{1} << degree) + 1;
+    }
+  } while (!is_primitive(p, degree));
+}
+
+uint32_t reverse_bits(uint32_t x) {
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+// Nested uniform scrambling by a hash of the reversed bits, Burley (2020)
+uint32_t scramble(uint32_t x, const uint32_t seed) {
+  x = reverse_bits(x);
+  x ^= x * 0x3d20adeau;
+  x += seed;
+  x *= (seed >> 16) | 1u;
+  x ^= x * 0x05526c56u;
+  x ^= x * 0x53a22864u;
+  return reverse_bits(x);
+}
+
+uint64_t mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15u;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9u;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebu;
+  return x ^ (x >> 31);
+}
+
+int trailing_zeros(uint64_t x) {
+  int count = 0;
+  for (; (x & 1) == 0 && count < 64; x >>= 1) {
+    count++;
+  }
+  return count;
+}
+} // namespace
+
+double normal_quantile(const double p) {
+  static constexpr double a[] = {3.3871328727963666080e0, 1.3314166789178437745e2,
+                                 1.9715909503065514427e3, 1.3731693765509461125e4,
+                                 4.5921953931549871457e4, 6.7265770927008700853e4,
+                                 3.3430575583588128105e4, 2.5090809287301226727e3};
+  static constexpr double b[] = {1.0,
+                                 4.2313330701600911252e1, 6.8718700749205790830e2,
+                                 5.3941960214247511077e3, 2.1213794301586595867e4,
+                                 3.9307895800092710610e4, 2.8729085735721942674e4,
+                                 5.2264952788528545610e3};
+  static constexpr double c[] = {1.42343711074968357734e0, 4.63033784615654529590e0,
+                                 5.76949722146069140550e0, 3.64784832476320460504e0,
+                                 1.27045825245236838258e0, 2.41780725177450611770e-1,
+                                 2.27238449892691845833e-2, 7.74545014278341407640e-4};
+  static constexpr double d[] = {1.0,
+                                 2.05319162663775882187e0, 1.67638483018380384940e0,
+                                 6.89767334985100004550e-1, 1.48103976427480074590e-1,
+                                 1.51986665636164571966e-2, 5.47593808499534494600e-4,
+                                 1.05075007164441684324e-9};
+  static constexpr double e[] = {6.65790464350110377720e0, 5.46378491116411436990e0,
+                                 1.78482653991729133580e0, 2.96560571828504891230e-1,
+                                 2.65321895265761230930e-2, 1.24266094738807843860e-3,
+                                 2.71155556874348757815e-5, 2.01033439929228813265e-7};
+  static constexpr double f[] = {1.0,
+                                 5.99832206555887937690e-1, 1.36929880922735805310e-1,
+                                 1.48753612908506148525e-2, 7.86869131145613259100e-4,
+                                 1.84631831751005468180e-5, 1.42151175831644588870e-7,
+                                 2.04426310338993978564e-15};
+
+  if (!(p > 0.0)) {
+    return -std::numeric_limits<double>::infinity();
+  }
+  if (!(p < 1.0)) {
+    return std::numeric_limits<double>::infinity();
+  }
+  const double q = p - 0.5;
+  if (std::abs(q) <= 0.425) {
+    const double r = 0.180625 - q * q;
+    return q * polynomial(a, r) / polynomial(b, r);
+  }
+  double r = std::sqrt(-std::log(q < 0.0 ? p : 1.0 - p));
+  double value;
+  if (r <= 5.0) {
+    r -= 1.6;
+    value = polynomial(c, r) / polynomial(d, r);
+  } else {
+    r -= 5.0;
+    value = polynomial(e, r) / polynomial(f, r);
+  }
+  return q < 0.0 ? -value : value;
+}
+
+void draw_random(Eigen::Ref<Eigen::MatrixXd> Z, const uint64_t seed, const int64_t begin) {
+  for (Eigen::Index j = 0; j < Z.cols(); ++j) {
+    auto engine = compute::member_engine(seed, begin + j);
+    std::normal_distribution<> dist{0.0, 1.0};
+    for (Eigen::Index i = 0; i < Z.rows(); ++i) {
+      Z(i, j) = dist(engine);
+    }
+  }
+}
+
+void draw_antithetic(Eigen::Ref<Eigen::MatrixXd> Z, const uint64_t seed, const int64_t begin) {
+  for (Eigen::Index j = 0; j < Z.cols(); ++j) {
+    const auto id = begin + j;
+    if (id % 2 == 1 && j > 0) {
+      Z.col(j) = -Z.col(j - 1);
+      continue;
+    }
+    draw_random(Z.col(j), seed, id - id % 2);
+    if (id % 2 == 1) {
+      Z.col(j) = -Z.col(j);
+    }
+  }
+}
+
+void draw_latin_hypercube(Eigen::Ref<Eigen::RowVectorXd, 0, Eigen::InnerStride<>> z,
+                          const uint64_t seed, const int64_t row) {
+  const auto N = z.size();
+  auto engine = compute::member_engine(seed, row);
+  std::vector<int64_t> strata(N);
+  std::iota(strata.begin(), strata.end(), 0);
+  std::shuffle(strata.begin(), strata.end(), engine);
+  // A point in the open interval of the stratum, so that the quantile is finite
+  std::uniform_real_distribution<> dist{std::nextafter(0.0, 1.0), 1.0};
+  for (Eigen::Index j = 0; j < N; ++j) {
+    z[j] = normal_quantile((strata[j] + dist(engine)) / N);
+  }
+}
+
+void match_moments(Eigen::Ref<Eigen::MatrixXd> Z) {
+  const auto N = Z.cols();
+  if (N < 2) {
+    return;
+  }
+  const Eigen::VectorXd mean = Z.rowwise().mean();
+  Z.colwise() -= mean;
+
+  Eigen::MatrixXd S = Eigen::MatrixXd::Zero(Z.rows(), Z.rows());
+  compute::rank_update(S, Z, 1.0 / (N - 1.0));
+  if (N > Z.rows()) {
+    const Eigen::LLT<Eigen::MatrixXd, Eigen::Lower> llt{S};
+    if (llt.info() == Eigen::Success) {
+      llt.matrixL().solveInPlace(Z);
+      return;
+    }
+  }
+  // Fewer members than dimensions, the sample covariance is singular
+  const Eigen::VectorXd scale = S.diagonal().unaryExpr(
+      [](const double variance) { return variance > 0.0 ? 1.0 / std::sqrt(variance) : 1.0; });
+  Z = scale.asDiagonal() * Z;
+}
+
+Sobol::Sobol(const int64_t dimensions, const uint64_t seed)
+    : dimensions(dimensions), directions(dimensions * bits), scrambles(dimensions) {
+  for (int64_t dimension = 0; dimension < dimensions; ++dimension) {
+    this->scrambles[dimension] = static_cast<uint32_t>(mix(seed ^ mix(dimension)));
+  }
+  if (dimensions == 0) {
+    return;
+  }
+
+  // The first dimension is the van der Corput sequence
+  for (int i = 0; i < bits; ++i) {
+    this->directions[i] = uint32_t{1} << (bits - 1 - i);
+  }
+
+  int degree = 0;
+  uint64_t p = 1;
+  const uint16_t *initial = joe_kuo_initial;
+  for (int64_t dimension = 1; dimension < dimensions; ++dimension) {
+    next_primitive(p, degree);
+
+    // The initial direction numbers m_i are odd and less than 2^i, those of Joe and Kuo for the
+    // leading dimensions and drawn beyond them
+    auto *v = &this->directions[dimension * bits];
+    if (dimension < joe_kuo_dimensions) {
+      for (int i = 0; i < degree; ++i) {
+        v[i] = static_cast<uint32_t>(initial[i]) << (bits - 1 - i);
+      }
+      initial += degree;
+    } else {
+      std::mt19937_64 engine{static_cast<uint64_t>(dimension)};
+      for (int i = 0; i < std::min(degree, bits); ++i) {
+        const uint64_t m = (engine() & ((uint64_t{2} << i) - 1)) | 1;
+        v[i] = static_cast<uint32_t>(m << (bits - 1 - i));
+      }
+    }
+    for (int i = degree; i < bits; ++i) {
+      v[i] = v[i - degree] ^ (v[i - degree] >> degree);
+      for (int t = 1; t < degree; ++t) {
+        if ((p >> (degree - t)) & 1) {
+          v[i] ^= v[i - t];
+        }
+      }
+    }
+  }
+}
+
+void Sobol::draw(Eigen::Ref<Eigen::MatrixXd> Z, const int64_t begin) const {
+  // The points are taken in the Gray code order, the first one directly and each next one by a
+  // single direction per dimension
+  std::vector<uint32_t> x(this->dimensions, 0);
+  const auto gray = static_cast<uint64_t>(begin) ^ (static_cast<uint64_t>(begin) >> 1);
+  for (int64_t dimension = 0; dimension < this->dimensions; ++dimension) {
+    for (int i = 0; i < bits; ++i) {
+      if ((gray >> i) & 1) {
+        x[dimension] ^= this->directions[dimension * bits + i];
+      }
+    }
+  }
+
+  for (Eigen::Index j = 0; j < Z.cols(); ++j) {
+    if (j > 0) {
+      const auto i = trailing_zeros(begin + j);
+      for (int64_t dimension = 0; dimension < this->dimensions; ++dimension) {
+        x[dimension] ^= this->directions[dimension * bits + i];
+      }
+    }
+    for (int64_t dimension = 0; dimension < this->dimensions; ++dimension) {
+      const auto u = scramble(x[dimension], this->scrambles[dimension]);
+      Z(dimension, j) = normal_quantile((u + 0.5) / 4294967296.0);
+    }
+  }
+}
+} // namespace douka::common::sampling
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMON_SAMPLING__
+#define __DOUKA_COMMON_SAMPLING__
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace douka::common::sampling {
+/**
+ * @brief Samplings of the standard normal members
+ *   random:     independent draws, each member from its own stream keyed by (seed, id)
+ *   sobol:      scrambled Sobol points mapped through the inverse normal CDF
+ *   lhs:        Latin hypercube, each dimension stratified into N equal probability intervals
+ *   antithetic: pairs of z and -z, transformed to the exact zero mean and unit covariance
+ */
+enum class Sampling { random, sobol, lhs, antithetic };
+inline static constexpr std::string_view sampling_names[] = {"random", "sobol", "lhs",
+                                                             "antithetic"};
+
+/**
+ * @brief Inverse of the standard normal CDF for p in (0, 1), Wichura's AS241 (~1e-16)
+ */
+double normal_quantile(const double p);
+
+/**
+ * @brief Standard normal draws of the members begin to begin+cols-1 into the columns of Z
+ */
+void draw_random(Eigen::Ref<Eigen::MatrixXd> Z, const uint64_t seed, const int64_t begin);
+
+/**
+ * @brief The members begin to begin+cols-1 as antithetic pairs, an odd member is the negation
+ * of the previous even one, so begin should be even.
+ */
+void draw_antithetic(Eigen::Ref<Eigen::MatrixXd> Z, const uint64_t seed, const int64_t begin);
+
+/**
+ * @brief Latin hypercube of a dimension, z[j] is drawn from the stratum perm[j] of N = size.
+ * The dimensions of an ensemble are independent, each from its own stream keyed by (seed, row).
+ */
+void draw_latin_hypercube(Eigen::Ref<Eigen::RowVectorXd, 0, Eigen::InnerStride<>> z,
+                          const uint64_t seed, const int64_t row);
+
+/**
+ * @brief Center the members and transform them into the exact unit sample covariance.
+ * The covariance is factorized when N > rows, otherwise only the variances are matched.
+ */
+void match_moments(Eigen::Ref<Eigen::MatrixXd> Z);
+
+/**
+ * @brief Sobol sequence of the given number of dimensions with nested uniform (Owen)
+ * scrambling keyed by the seed.
+ * The generating polynomials are the primitive polynomials over GF(2) in ascending order, so
+ * there is no limit of the dimensions. The initial direction numbers of the first 1024
+ * dimensions are those of Joe and Kuo (2008), chosen for good two-dimensional projections.
+ * Beyond them they are drawn once, the same for every seed, which keeps the points of each
+ * dimension stratified but gives no such guarantee for the projections.
+ */
+class Sobol {
+public:
+  Sobol(const int64_t dimensions, const uint64_t seed);
+
+  /**
+   * @brief Points begin to begin+cols-1 mapped to the standard normal into the columns of Z
+   */
+  void draw(Eigen::Ref<Eigen::MatrixXd> Z, const int64_t begin) const;
+
+private:
+  static constexpr int bits = 32;
+
+  int64_t dimensions;
+  std::vector<uint32_t> directions; // bits per dimension
+  std::vector<uint32_t> scrambles;  // seed per dimension
+};
+} // namespace douka::common::sampling
+#endif
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "series.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+
+namespace douka::io {
+namespace {
+uint64_t align_up(const uint64_t size) {
+  return (size + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+}
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+  ~MappedFile() {
+    if (this->data != nullptr) {
+      munmap(this->data, this->size);
+    }
+  }
+
+  bool open(const std::filesystem::path &filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::clog << filename << " could not open: " << std::strerror(errno) << std::endl;
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(ObsSeriesHeader)) {
+      std::clog << filename << " is not an observation series" << std::endl;
+      ::close(fd);
+      return false;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      std::clog << filename << " could not map: " << std::strerror(errno) << std::endl;
+      return false;
+    }
+    this->data = data;
+    this->size = st.st_size;
+    return true;
+  }
+
+  void *data = nullptr;
+  std::size_t size = 0;
+};
+
+bool validate(const std::filesystem::path &filename, const ObsSeriesHeader &header,
+              const uint64_t size) {
+  if (std::memcmp(header.magic, obs_series_magic, sizeof(obs_series_magic)) != 0) {
+    std::clog << filename << " is not an observation series" << std::endl;
+    return false;
+  }
+  if (header.version != obs_series_version) {
+    std::clog << filename << " unsupported version " << header.version << std::endl;
+    return false;
+  }
+  if (header.byte_order != obs_series_byte_order) {
+    std::clog << filename << " written in a different byte order" << std::endl;
+    return false;
+  }
+  if (header.index_offset == 0) {
+    std::clog << filename << " not closed by the writer" << std::endl;
+    return false;
+  }
+  // The sizes are compared without overflowing, as the header may be broken
+  if (header.name_size > size || header.index_offset > size ||
+      sizeof(header) + header.name_size > header.index_offset ||
+      header.index_offset % sizeof(double) != 0 ||
+      header.count > (size - header.index_offset) / sizeof(ObsSeriesEntry) ||
+      header.count * sizeof(ObsSeriesEntry) != size - header.index_offset) {
+    std::clog << filename << " broken header" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool validate(const std::filesystem::path &filename, const ObsSeriesHeader &header,
+              const ObsSeriesEntry &entry) {
+  if (entry.offset < sizeof(header) + header.name_size || entry.offset % sizeof(double) != 0 ||
+      entry.offset > header.index_offset ||
+      entry.l > (header.index_offset - entry.offset) / sizeof(double)) {
+    std::clog << filename << " broken index" << std::endl;
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+ObsSeriesWriter::~ObsSeriesWriter() { this->discard(); }
+
+bool ObsSeriesWriter::open(const std::filesystem::path &filename, const std::string_view &name,
+                           const bool force) {
+  this->discard();
+  if (!force && std::filesystem::exists(filename)) {
+    std::clog << filename << " already exists" << std::endl;
+    return false;
+  }
+  this->stream.open(filename, std::ios::binary | std::ios::trunc);
+  if (!this->stream) {
+    std::clog << filename << " could not open" << std::endl;
+    return false;
+  }
+  this->filename = filename;
+  this->name = name;
+  this->index.clear();
+
+  // The header is left unfinished until close(), a reader rejects the series until then
+  ObsSeriesHeader header{};
+  std::memcpy(header.magic, obs_series_magic, sizeof(obs_series_magic));
+  header.version = obs_series_version;
+  header.byte_order = obs_series_byte_order;
+  header.name_size = name.size();
+  this->offset = align_up(sizeof(header) + name.size());
+  const std::string padding(this->offset - sizeof(header) - name.size(), '\0');
+  this->stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  this->stream.write(name.data(), name.size());
+  this->stream.write(padding.data(), padding.size());
+  if (!this->stream) {
+    std::clog << filename << " could not write" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ObsSeriesWriter::append(const Obs &obs) {
+  if (!this->is_open()) {
+    std::clog << "observation series not opened" << std::endl;
+    return false;
+  }
+  if (obs.name != this->name) {
+    std::clog << "observation of different name " << obs.name << " given" << std::endl;
+    return false;
+  }
+  if (!this->index.empty() && obs.obs_tim <= this->index.back().obs_tim) {
+    std::clog << "observation of obs_tim " << obs.obs_tim << " should be after "
+              << this->index.back().obs_tim << std::endl;
+    return false;
+  }
+  const auto size = obs.y.size() * sizeof(double);
+  if (!this->stream.write(reinterpret_cast<const char *>(obs.y.data()), size)) {
+    std::clog << this->filename << " could not write" << std::endl;
+    return false;
+  }
+  this->index.push_back({obs.obs_tim, this->offset, obs.y.size()});
+  this->offset += size;
+  return true;
+}
+
+bool ObsSeriesWriter::close() {
+  if (!this->is_open()) {
+    return true;
+  }
+  ObsSeriesHeader header{};
+  std::memcpy(header.magic, obs_series_magic, sizeof(obs_series_magic));
+  header.version = obs_series_version;
+  header.byte_order = obs_series_byte_order;
+  header.count = this->index.size();
+  header.index_offset = this->offset;
+  header.name_size = this->name.size();
+  this->stream.write(reinterpret_cast<const char *>(this->index.data()),
+                     this->index.size() * sizeof(ObsSeriesEntry));
+  this->stream.seekp(0);
+  this->stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  this->stream.close();
+  this->index.clear();
+  if (!this->stream) {
+    std::clog << this->filename << " could not write" << std::endl;
+    std::error_code ec;
+    std::filesystem::remove(this->filename, ec);
+    return false;
+  }
+  return true;
+}
+
+void ObsSeriesWriter::discard() {
+  if (!this->is_open()) {
+    return;
+  }
+  this->stream.close();
+  this->index.clear();
+  std::error_code ec;
+  std::filesystem::remove(this->filename, ec);
+}
+
+bool ObsSeriesReader::open(const std::filesystem::path &filename) {
+  this->filename = filename;
+  this->current = 0;
+  this->index.close();
+  this->data.close();
+  this->index.open(filename, std::ios::binary);
+  this->data.open(filename, std::ios::binary);
+  if (!this->index || !this->data) {
+    std::clog << filename << " could not open" << std::endl;
+    return false;
+  }
+  std::error_code ec;
+  const auto size = std::filesystem::file_size(filename, ec);
+  if (ec || size < sizeof(this->header) ||
+      !this->index.read(reinterpret_cast<char *>(&this->header), sizeof(this->header))) {
+    std::clog << filename << " is not an observation series" << std::endl;
+    return false;
+  }
+  if (!validate(filename, this->header, size)) {
+    return false;
+  }
+  this->series_name.resize(this->header.name_size);
+  if (!this->index.read(this->series_name.data(), this->series_name.size()) ||
+      !this->index.seekg(this->header.index_offset)) {
+    std::clog << filename << " could not read" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ObsSeriesReader::next(Obs &obs) {
+  if (this->current >= this->header.count) {
+    return false;
+  }
+  ObsSeriesEntry entry;
+  if (!this->index.read(reinterpret_cast<char *>(&entry), sizeof(entry))) {
+    std::clog << this->filename << " could not read" << std::endl;
+    return false;
+  }
+  if (!validate(this->filename, this->header, entry)) {
+    return false;
+  }
+  obs.name = this->series_name;
+  obs.obs_tim = entry.obs_tim;
+  obs.y.resize(entry.l);
+  if (!this->data.seekg(entry.offset) ||
+      !this->data.read(reinterpret_cast<char *>(obs.y.data()), entry.l * sizeof(double))) {
+    std::clog << this->filename << " could not read" << std::endl;
+    return false;
+  }
+  this->current++;
+  return true;
+}
+
+bool ObsSeriesReader::skip(const uint64_t count) {
+  if (count > this->header.count - this->current) {
+    std::clog << this->filename << " has no " << count << " more observations" << std::endl;
+    return false;
+  }
+  if (!this->index.seekg(count * sizeof(ObsSeriesEntry), std::ios::cur)) {
+    std::clog << this->filename << " could not read" << std::endl;
+    return false;
+  }
+  this->current += count;
+  return true;
+}
+
+bool is_obs_series(const std::string_view &path) {
+  return path.substr(0, obs_series_prefix.size()) == obs_series_prefix;
+}
+
+bool read_obs_series(const std::filesystem::path &filename, const int64_t obs_tim, Obs &obs) {
+  MappedFile file;
+  if (!file.open(filename)) {
+    return false;
+  }
+  const auto *data = static_cast<const char *>(file.data);
+  ObsSeriesHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (!validate(filename, header, file.size)) {
+    return false;
+  }
+
+  const auto *index = reinterpret_cast<const ObsSeriesEntry *>(data + header.index_offset);
+  const auto *end = index + header.count;
+  const auto *entry =
+      std::lower_bound(index, end, obs_tim, [](const ObsSeriesEntry &entry, const int64_t tim) {
+        return entry.obs_tim < tim;
+      });
+  if (entry == end || entry->obs_tim != obs_tim) {
+    std::clog << filename << " has no observation of obs_tim " << obs_tim << std::endl;
+    return false;
+  }
+  if (!validate(filename, header, *entry)) {
+    return false;
+  }
+
+  const auto *y = reinterpret_cast<const double *>(data + entry->offset);
+  obs.name.assign(data + sizeof(header), header.name_size);
+  obs.obs_tim = obs_tim;
+  obs.y.assign(y, y + entry->l);
+  return true;
+}
+
+bool read_obs_series(const std::string_view &path, Obs &obs) {
+  const auto at = path.rfind('@');
+  int64_t obs_tim = -1;
+  if (!is_obs_series(path) || at == std::string_view::npos || at <= obs_series_prefix.size() ||
+      std::from_chars(path.data() + at + 1, path.data() + path.size(), obs_tim).ptr !=
+          path.data() + path.size() ||
+      at + 1 == path.size() || obs_tim < 0) {
+    std::clog << "invalid observation series '" << path << "' given, series:<file>@<obs_tim>"
+              << std::endl;
+    return false;
+  }
+  const auto filename = path.substr(obs_series_prefix.size(), at - obs_series_prefix.size());
+  return read_obs_series(std::filesystem::path{filename}, obs_tim, obs);
+}
+
+std::string obs_series_filename(const std::string_view &name) {
+  return std::string{name} + "_obs.series";
+}
+} // namespace douka::io
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMON_SERIES__
+#define __DOUKA_COMMON_SERIES__
+
+#include "douka/io.hh"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace douka::io {
+/**
+ * @brief Observation time series, all observations of an experiment in a single file.
+ *
+ * Layout (native byte order, checked by the byte order mark):
+ *   0   char[8]  magic "DOUKAOBS"
+ *   8   uint32   version
+ *   12  uint32   byte order mark 0x01020304
+ *   16  uint64   number of observations
+ *   24  uint64   offset of the index, 0 until the series is closed
+ *   32  uint64   size of name
+ *   40  char[]   name
+ *   ... double[l] y of each observation, 8 byte aligned
+ *   index ObsSeriesEntry[number of observations] in ascending obs_tim
+ *
+ * The index is written last, so that the observations are appended as they are generated.
+ */
+struct ObsSeriesHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t count;
+  uint64_t index_offset;
+  uint64_t name_size;
+};
+static_assert(sizeof(ObsSeriesHeader) == 40);
+
+struct ObsSeriesEntry {
+  int64_t obs_tim;
+  uint64_t offset; // of y
+  uint64_t l;
+};
+static_assert(sizeof(ObsSeriesEntry) == 24);
+
+inline static constexpr char obs_series_magic[8] = {'D', 'O', 'U', 'K', 'A', 'O', 'B', 'S'};
+inline static constexpr uint32_t obs_series_version = 1;
+inline static constexpr uint32_t obs_series_byte_order = 0x01020304;
+
+/**
+ * @brief Writer appending the observations to a series, the index is written by close().
+ * The series is complete once close() succeeds, it is removed if the writer goes away or is
+ * opened again before, so that a failed command leaves no shorter series.
+ */
+class ObsSeriesWriter {
+public:
+  ObsSeriesWriter() = default;
+  ~ObsSeriesWriter();
+  ObsSeriesWriter(const ObsSeriesWriter &) = delete;
+  ObsSeriesWriter &operator=(const ObsSeriesWriter &) = delete;
+
+  bool open(const std::filesystem::path &filename, const std::string_view &name,
+            const bool force = false);
+
+  /**
+   * @brief Append an observation of the series name, obs_tim should be ascending
+   */
+  bool append(const Obs &obs);
+
+  /**
+   * @brief Write the index and the header
+   */
+  bool close();
+
+  /**
+   * @brief Remove the series not closed yet
+   */
+  void discard();
+
+  inline bool is_open() const { return this->stream.is_open(); }
+
+private:
+  std::filesystem::path filename;
+  std::string name;
+  std::ofstream stream;
+  uint64_t offset = 0;
+  std::vector<ObsSeriesEntry> index;
+};
+
+/**
+ * @brief Reader of the observations of a series one at a time in the order of the index.
+ * Only the current observation is held in memory, so a series larger than memory is read in a
+ * single pass. The skipped observations are not read at all.
+ */
+class ObsSeriesReader {
+public:
+  bool open(const std::filesystem::path &filename);
+
+  /**
+   * @brief Read the next observation, returns false at the end of the series or on an error
+   */
+  bool next(Obs &obs);
+
+  /**
+   * @brief Skip the next count observations
+   */
+  bool skip(const uint64_t count);
+
+  inline uint64_t size() const { return this->header.count; }
+  inline uint64_t position() const { return this->current; }
+  inline const std::string &name() const { return this->series_name; }
+
+private:
+  std::filesystem::path filename;
+  ObsSeriesHeader header = {};
+  std::string series_name;
+  std::ifstream index, data;
+  uint64_t current = 0;
+};
+
+/**
+ * @brief Observation of a series given as "series:<file>@<obs_tim>" in place of a json file
+ */
+inline static constexpr std::string_view obs_series_prefix = "series:";
+bool is_obs_series(const std::string_view &path);
+
+/**
+ * @brief Read the observation of obs_tim from the series.
+ * The file is mapped and the record is found by a binary search of the index, the other
+ * observations are not read.
+ */
+bool read_obs_series(const std::filesystem::path &filename, const int64_t obs_tim, Obs &obs);
+bool read_obs_series(const std::string_view &path, Obs &obs);
+
+std::string obs_series_filename(const std::string_view &name);
+} // namespace douka::io
+#endif
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "writer.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(DOUKA_USE_IO_URING)
+#include <liburing.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+namespace douka::io {
+namespace {
+// Number of files in flight per I/O thread
+constexpr int64_t queue_depth = 8;
+
+int open_file(const std::filesystem::path &filename, const bool force) {
+  const int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (force ? O_TRUNC : O_EXCL);
+  const int fd = ::open(filename.c_str(), flags, 0644);
+  if (fd < 0) {
+    if (errno == EEXIST) {
+      std::clog << filename << " already exists" << std::endl;
+    } else {
+      std::cerr << filename << " could not open: " << std::strerror(errno) << std::endl;
+    }
+  }
+  return fd;
+}
+
+bool write_file(const std::filesystem::path &filename, const std::string_view &data,
+                const bool force) {
+  const int fd = open_file(filename, force);
+  if (fd < 0) {
+    return false;
+  }
+  std::size_t done = 0;
+  while (done < data.size()) {
+    const auto rc = ::write(fd, data.data() + done, data.size() - done);
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rc < 0) {
+      std::cerr << filename << " failed to write: " << std::strerror(errno) << std::endl;
+      ::close(fd);
+      return false;
+    }
+    done += static_cast<std::size_t>(rc);
+  }
+  if (::close(fd) != 0) {
+    std::cerr << filename << " failed to close: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+#if defined(DOUKA_USE_IO_URING)
+struct AsyncWriter::Uring {
+  struct Request {
+    std::filesystem::path filename;
+    std::string data;
+    std::size_t done;
+    int fd;
+  };
+
+  io_uring ring;
+  unsigned depth;
+  unsigned in_flight = 0;
+  bool failed = false;
+
+  explicit Uring(const unsigned depth) : depth(depth) {}
+  ~Uring() {
+    this->drain();
+    io_uring_queue_exit(&this->ring);
+  }
+
+  bool init() { return io_uring_queue_init(this->depth, &this->ring, 0) == 0; }
+
+  // Queue the remaining part of the request, at most UINT_MAX bytes at once
+  void submit(Request *request) {
+    auto *sqe = io_uring_get_sqe(&this->ring);
+    while (sqe == nullptr) {
+      if (!this->reap()) {
+        this->finish(request);
+        return;
+      }
+      sqe = io_uring_get_sqe(&this->ring);
+    }
+    const auto size = std::min<std::size_t>(request->data.size() - request->done,
+                                            std::numeric_limits<unsigned>::max());
+    io_uring_prep_write(sqe, request->fd, request->data.data() + request->done,
+                        static_cast<unsigned>(size), request->done);
+    io_uring_sqe_set_data(sqe, request);
+    io_uring_submit(&this->ring);
+    this->in_flight++;
+  }
+
+  bool write(const std::filesystem::path &filename, std::string data, const bool force) {
+    while (this->in_flight >= this->depth && this->reap()) {
+    }
+    if (this->failed) {
+      return false;
+    }
+    const int fd = open_file(filename, force);
+    if (fd < 0) {
+      this->failed = true;
+      return false;
+    }
+    if (data.empty()) {
+      ::close(fd);
+      return true;
+    }
+    this->submit(new Request{filename, std::move(data), 0, fd});
+    return true;
+  }
+
+  // Close the file of the request once it is completed or failed
+  void finish(Request *request) {
+    if (::close(request->fd) != 0) {
+      std::cerr << request->filename << " failed to close: " << std::strerror(errno) << std::endl;
+      this->failed = true;
+    }
+    delete request;
+  }
+
+  // Complete a write, a short one is submitted again for the rest.
+  // Returns false if no completion could be waited for, the requests in flight are then left to
+  // the kernel and not freed.
+  bool reap() {
+    io_uring_cqe *cqe = nullptr;
+    int rc = io_uring_wait_cqe(&this->ring, &cqe);
+    while (rc == -EINTR) {
+      rc = io_uring_wait_cqe(&this->ring, &cqe);
+    }
+    if (rc < 0) {
+      std::cerr << "io_uring failed to wait: " << std::strerror(-rc) << std::endl;
+      this->failed = true;
+      this->in_flight = 0;
+      return false;
+    }
+    auto *request = static_cast<Request *>(io_uring_cqe_get_data(cqe));
+    const int res = cqe->res;
+    io_uring_cqe_seen(&this->ring, cqe);
+    this->in_flight--;
+
+    if (res < 0) {
+      std::cerr << request->filename << " failed to write: " << std::strerror(-res) << std::endl;
+      this->failed = true;
+    } else if (res == 0 && request->done < request->data.size()) {
+      std::cerr << request->filename << " failed to write: no byte written" << std::endl;
+      this->failed = true;
+    } else {
+      request->done += static_cast<std::size_t>(res);
+      if (request->done < request->data.size()) {
+        this->submit(request);
+        return true;
+      }
+    }
+    this->finish(request);
+    return true;
+  }
+
+  bool drain() {
+    while (this->in_flight > 0 && this->reap()) {
+    }
+    return !this->failed;
+  }
+};
+#else
+struct AsyncWriter::Uring {};
+#endif
+
+AsyncWriter::AsyncWriter(const int64_t threads) {
+#if defined(DOUKA_USE_IO_URING)
+  auto ring = std::make_unique<Uring>(static_cast<unsigned>(queue_depth * threads));
+  if (ring->init()) {
+    this->ring = std::move(ring);
+    return;
+  }
+  std::clog << "io_uring not available, fall back to threads" << std::endl;
+#endif
+  this->workers = std::make_unique<FileWorkers>(std::max<int64_t>(threads, 1),
+                                                queue_depth * std::max<int64_t>(threads, 1));
+}
+
+AsyncWriter::~AsyncWriter() = default;
+
+bool AsyncWriter::write(const std::filesystem::path &filename, std::string data,
+                        const bool force) {
+#if defined(DOUKA_USE_IO_URING)
+  if (this->ring) {
+    return this->ring->write(filename, std::move(data), force);
+  }
+#endif
+  return this->workers->submit(this->count++, [filename, data = std::move(data), force] {
+    return write_file(filename, data, force);
+  });
+}
+
+bool AsyncWriter::wait() {
+#if defined(DOUKA_USE_IO_URING)
+  if (this->ring) {
+    return this->ring->drain();
+  }
+#endif
+  return this->workers->wait();
+}
+
+bool AsyncWriter::uring() const { return this->ring != nullptr; }
+} // namespace douka::io
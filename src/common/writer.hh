@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DOUKA_COMMON_WRITER__
+#define __DOUKA_COMMON_WRITER__
+
+#include "common/parallel.hh"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+namespace douka::io {
+/**
+ * @brief Asynchronous writer of whole files.
+ * write() returns as soon as the content is queued, so that the caller can serialize the next
+ * file while the previous ones are flushed, and wait() blocks until all of them are completed.
+ *
+ * The writes are submitted to an io_uring when built with DOUKA_USE_IO_URING and the kernel
+ * allows it, otherwise they are run by the I/O threads (at least one), see set_io_threads().
+ * The number of files in flight is bounded, write() blocks while the queue is full.
+ */
+class AsyncWriter {
+public:
+  explicit AsyncWriter(const int64_t threads = io::io_threads());
+  ~AsyncWriter();
+  AsyncWriter(const AsyncWriter &) = delete;
+  AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+  /**
+   * @brief Queue the content of the file, returns false once a write has failed
+   */
+  bool write(const std::filesystem::path &filename, std::string data, const bool force = false);
+
+  /**
+   * @brief Wait for the queued writes, returns false if any of them failed
+   */
+  bool wait();
+
+  /**
+   * @brief Whether the writes go through io_uring
+   */
+  bool uring() const;
+
+private:
+  struct Uring;
+
+  int64_t count = 0;
+  std::unique_ptr<Uring> ring;
+  std::unique_ptr<FileWorkers> workers;
+};
+} // namespace douka::io
+#endif
@@ -5,6 +5,9 @@
 
 #include "enkf.hh"
 #include "common/compute.hh"
+#include "common/parallel.hh"
+#include "common/profile.hh"
+#include "common/series.hh"
 
 #include <Eigen/Core>
 #include <Eigen/QR>
@@ -12,12 +15,42 @@
 #include <algorithm>
 #include <cassert>
 #include <cinttypes>
+#include <cstdio>
+#include <functional>
 #include <filesystem>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace douka::filter::enkf {
+bool sparse_to_dense(const std::vector<int64_t> &begin, const std::vector<int64_t> &index,
+                     const std::vector<double> &value, const int64_t k, std::vector<double> &H) {
+  if (begin.size() < 2 || begin.front() != 0 ||
+      begin.back() != static_cast<int64_t>(index.size()) || index.size() != value.size()) {
+    std::clog << "invalid H_sparse given, begin should be 0 to the size of index and value"
+              << std::endl;
+    return false;
+  }
+  if (!std::is_sorted(begin.begin(), begin.end())) {
+    std::clog << "invalid H_sparse given, begin should be ascending" << std::endl;
+    return false;
+  }
+  if (!std::all_of(index.begin(), index.end(),
+                   [k](const int64_t j) { return j >= 0 && j < k; })) {
+    std::clog << "invalid H_sparse given, index should be 0 to " << k - 1 << std::endl;
+    return false;
+  }
+
+  const auto l = static_cast<int64_t>(begin.size()) - 1;
+  H.assign(l * k, 0.0);
+  for (int64_t i = 0; i < l; ++i) {
+    for (auto j = begin[i]; j < begin[i + 1]; ++j) {
+      H[i * k + index[j]] += value[j];
+    }
+  }
+  return true;
+}
+
 bool validate(const std::vector<io::State> &states, const io::Obs &obs, const Param &param) {
   if (!std::all_of(states.begin(), states.end(),
                    [](const auto &state) { return state.validate(); })) {
@@ -59,81 +92,604 @@ bool validate(const std::vector<io::State> &states, const io::Obs &obs, const Pa
   return true;
 }
 
-bool filter(std::vector<io::State> &states, const io::Obs &obs, const Param &param) {
-  static std::default_random_engine engine{static_cast<unsigned>(param.seed + obs.obs_tim)};
-  Eigen::MatrixXd X{param.k, param.N};
-  for (const auto &state : states) {
-    X.col(state.id) = Eigen::Map<const Eigen::VectorXd>{state.x.data(),
-                                                        static_cast<Eigen::Index>(state.x.size())};
+namespace {
+bool validate(const std::string_view &name, const int64_t N, const int64_t k,
+              const int64_t sys_tim, const int64_t obs_tim, const io::Obs &obs,
+              const Param &param) {
+  if (!obs.validate() || !param.validate()) {
+    return false;
+  }
+
+  if (k != param.k || N != param.N) {
+    std::clog << "invalid ensemble size " << k << " x " << N << " != " << param.k << " x "
+              << param.N << std::endl;
+    return false;
+  }
+
+  if (static_cast<std::size_t>(param.l) != obs.y.size()) {
+    std::clog << "invalid observation size" << std::endl;
+    return false;
+  }
+
+  if (param.name != obs.name || param.name != name) {
+    std::clog << "invalid name" << std::endl;
+    return false;
   }
 
-  Eigen::MatrixXd H;
-  if (param.H.empty()) {
-    H = Eigen::MatrixXd::Identity(param.l, param.k);
+  if (sys_tim != obs.obs_tim || obs_tim != obs.obs_tim - 1) {
+    std::clog << "invalid timestamp" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+} // namespace
+
+bool validate(const io::Ensemble &ensemble, const io::Obs &obs, const Param &param) {
+  return ensemble.validate() && validate(ensemble.name, ensemble.N, ensemble.k, ensemble.sys_tim,
+                                         ensemble.obs_tim, obs, param);
+}
+
+bool validate(const io::MappedEnsemble &ensemble, const io::Obs &obs, const Param &param) {
+  const auto &header = ensemble.header();
+  return validate(ensemble.name(), header.N, header.k, header.sys_tim, header.obs_tim, obs, param);
+}
+
+namespace {
+using RowMajorMatrixXd = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+common::compute::Gain to_gain(const std::string &name) {
+  const auto it = std::find(std::begin(common::compute::gain_names),
+                            std::end(common::compute::gain_names), name);
+  return static_cast<common::compute::Gain>(it - std::begin(common::compute::gain_names));
+}
+
+bool is_H_identity(const Param &param) {
+  return param.H.empty() &&
+         std::all_of(param.blocks.begin(), param.blocks.end(),
+                     [](const ObsBlock &block) { return block.H.empty(); }) &&
+         param.l <= param.k;
+}
+
+bool is_R_diagonal(const Param &param) {
+  if (param.blocks.empty()) {
+    return param.R.size() != static_cast<std::size_t>(param.l * param.l) || param.l == 1;
+  }
+  return std::all_of(param.blocks.begin(), param.blocks.end(), [](const ObsBlock &block) {
+    return block.R.size() != static_cast<std::size_t>(block.l * block.l) || block.l == 1;
+  });
+}
+
+// Run f(block) for the observation blocks [first, last), concurrently if more than one
+template <typename Function>
+bool for_each_block(Workspace &ws, const std::size_t first, const std::size_t last,
+                    const Function &f) {
+  if (last - first == 1) {
+    return f(ws.blocks[first]);
+  }
+  return ws.pool->parallel_for(static_cast<int64_t>(last - first), [&](const int64_t i,
+                                                                       const int64_t) {
+    return f(ws.blocks[first + i]);
+  });
+}
+} // namespace
+
+Workspace::Workspace(const Param &param, const bool by_rows)
+    : seed(param.seed), block_rows(param.block_rows), by_rows(by_rows || param.block_rows > 0),
+      serial(param.serial),
+      H_identity(is_H_identity(param)), R_diagonal(is_R_diagonal(param)),
+      engine(static_cast<unsigned>(param.seed)),
+      pool(std::make_unique<common::ThreadPool>(common::compute_threads())) {
+  using common::compute::Gain;
+  const auto N = static_cast<Eigen::Index>(param.N);
+  const auto k = static_cast<Eigen::Index>(param.k);
+  const auto l = static_cast<Eigen::Index>(param.l);
+
+  /* The blocks of the observations, R and H are stacked from them */
+  std::vector<double> R_given, H_given;
+  if (param.blocks.empty()) {
+    blocks.resize(1);
+    blocks[0].size = l;
+    R_given = param.R;
+    H_given = param.H;
   } else {
-    H = Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>{
-        param.H.data(), static_cast<Eigen::Index>(param.l), static_cast<Eigen::Index>(param.k)};
+    blocks.resize(param.blocks.size());
+    int64_t offset = 0;
+    for (std::size_t i = 0; i < blocks.size(); ++i) {
+      const auto &block = param.blocks[i];
+      blocks[i].offset = offset;
+      blocks[i].size = block.l;
+      offset += block.l;
+      H_given.insert(H_given.end(), block.H.begin(), block.H.end());
+    }
+  }
+
+  if (H_given.empty()) {
+    H = Eigen::MatrixXd::Identity(H_identity ? 0 : l, H_identity ? 0 : k);
+  } else {
+    H = Eigen::Map<const RowMajorMatrixXd>{H_given.data(), l, k};
+  }
+
+  bool R_invertible = true;
+  if (R_diagonal) {
+    R_diag = Eigen::VectorXd::Zero(l);
+    if (param.blocks.empty() && !R_given.empty()) {
+      R_diag = Eigen::Map<const Eigen::VectorXd>{R_given.data(), l};
+    }
+    for (std::size_t i = 0; i < param.blocks.size(); ++i) {
+      const auto &R_block = param.blocks[i].R;
+      if (!R_block.empty()) {
+        R_diag.segment(blocks[i].offset, blocks[i].size) =
+            Eigen::Map<const Eigen::VectorXd>{R_block.data(), blocks[i].size};
+      }
+    }
+    R_invertible = (R_diag.array() > 0.0).all();
+    R_diag_inv = R_diag.cwiseInverse();
+    R_diag_inv_sqrt = R_diag_inv.cwiseSqrt();
+    R_diag_sqrt = R_diag.cwiseMax(0.0).cwiseSqrt();
+  } else {
+    if (param.blocks.empty()) {
+      R = Eigen::Map<const RowMajorMatrixXd>{R_given.data(), l, l};
+    } else {
+      R = Eigen::MatrixXd::Zero(l, l);
+      for (std::size_t i = 0; i < param.blocks.size(); ++i) {
+        const auto &R_block = param.blocks[i].R;
+        const auto offset = blocks[i].offset, size = blocks[i].size;
+        if (R_block.size() == static_cast<std::size_t>(size * size)) {
+          R.block(offset, offset, size, size) =
+              Eigen::Map<const RowMajorMatrixXd>{R_block.data(), size, size};
+        } else if (!R_block.empty()) {
+          R.diagonal().segment(offset, size) =
+              Eigen::Map<const Eigen::VectorXd>{R_block.data(), size};
+        }
+      }
+    }
+    // Each diagonal block of R is factorized on its own
+    for_each_block(*this, 0, blocks.size(), [this](ObservationBlock &block) {
+      block.R_llt.compute(R.block(block.offset, block.offset, block.size, block.size));
+      return true;
+    });
+    R_invertible = std::all_of(blocks.begin(), blocks.end(), [](const ObservationBlock &block) {
+      return block.R_llt.info() == Eigen::Success;
+    });
+  }
+
+  /* Choose the formulation */
+  costs = common::compute::gain_costs(static_cast<double>(N), static_cast<double>(k),
+                                      static_cast<double>(l), {H_identity, R_diagonal, R_invertible});
+  if (this->by_rows || serial) {
+    // The k x k system can not be blocked by rows nor by observations
+    costs[static_cast<int>(Gain::state)].available = false;
+  }
+  gain = param.gain == "auto" ? common::compute::select_gain(costs).gain : to_gain(param.gain);
+
+  if (!this->by_rows) {
+    Z.resize(k, N);
+    x_mean.resize(k);
+  }
+  S.resize(l, N);
+  D.resize(l, N);
+  E.resize(l, N);
+  d_mean.resize(l);
+  e_mean.resize(l);
+  if (!costs[static_cast<int>(gain)].available) {
+    return;
+  }
+
+  switch (gain) {
+  case Gain::state: {
+    const Eigen::MatrixXd H_dense = H_identity ? Eigen::MatrixXd::Identity(l, k) : H;
+    if (R_diagonal) {
+      F = H_dense.transpose() * R_diag_inv.asDiagonal();
+    } else {
+      Eigen::MatrixXd G = H_dense;
+      for_each_block(*this, 0, blocks.size(), [&G](const ObservationBlock &block) {
+        block.R_llt.solveInPlace(G.middleRows(block.offset, block.size));
+        return true;
+      });
+      F = G.transpose();
+    }
+    B = F * H_dense;
+    P.resize(k, k);
+    A.resize(k, k);
+    U.resize(k, N);
+    W.resize(k, N);
+    lu = Eigen::PartialPivLU<Eigen::MatrixXd>(k);
+    break;
+  }
+  case Gain::observation:
+    if (serial) {
+      for (auto &block : blocks) {
+        block.C.resize(block.size, block.size);
+        block.llt = Eigen::LLT<Eigen::MatrixXd>(block.size);
+      }
+    } else {
+      C.resize(l, l);
+      llt = Eigen::LLT<Eigen::MatrixXd>(l);
+    }
+    M.resize(N, N);
+    break;
+  case Gain::ensemble:
+    T.resize(l, N);
+    Q.resize(N, N);
+    M.resize(N, N);
+    llt = Eigen::LLT<Eigen::MatrixXd>(N);
+    break;
+  }
+}
+
+namespace {
+bool available(const Workspace &ws) {
+  if (!ws.costs[static_cast<int>(ws.gain)].available) {
+    std::clog << "gain formulation '" << common::compute::gain_names[static_cast<int>(ws.gain)]
+              << "' requires an invertible R";
+    if (ws.by_rows || ws.serial) {
+      std::clog << " and is not available with block_rows, ranks or serial blocks";
+    }
+    std::clog << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Perturbed innovation D = Y + mean_diff(W) - HX from S and d_mean of the observations of the
+ * blocks [first, last)
+ */
+void perturbed_innovation(Workspace &ws, const std::size_t first, const std::size_t last) {
+  const auto N = ws.S.cols();
+  const auto offset = ws.blocks[first].offset;
+  const auto size = ws.blocks[last - 1].offset + ws.blocks[last - 1].size - offset;
+  auto E = ws.E.middleRows(offset, size);
+  auto D = ws.D.middleRows(offset, size);
+  auto e_mean = ws.e_mean.segment(offset, size);
+  E = Eigen::MatrixXd::NullaryExpr(size, N, [&ws]() { return ws.dist(ws.engine); });
+  e_mean.noalias() = E.rowwise().mean();
+  E.colwise() -= e_mean;
+  if (ws.R_diagonal) {
+    D = ws.R_diag_sqrt.segment(offset, size).asDiagonal() * E;
+  } else {
+    for_each_block(ws, first, last, [&ws](const ObservationBlock &block) {
+      ws.D.middleRows(block.offset, block.size).noalias() =
+          block.R_llt.matrixL() * ws.E.middleRows(block.offset, block.size);
+      return true;
+    });
+  }
+  D.colwise() += ws.d_mean.segment(offset, size);
+  D -= std::sqrt(N - 1.0) * ws.S.middleRows(offset, size);
+}
+
+/*
+ * Ensemble weights M of the update X += Z M (observation, ensemble) by the observations of the
+ * blocks [first, last), D is overwritten
+ */
+void ensemble_weights(Workspace &ws, const std::size_t first, const std::size_t last) {
+  using common::compute::Gain;
+  const auto offset = ws.blocks[first].offset;
+  const auto size = ws.blocks[last - 1].offset + ws.blocks[last - 1].size - offset;
+  const auto S = ws.S.middleRows(offset, size);
+  auto D = ws.D.middleRows(offset, size);
+  switch (ws.gain) {
+  case Gain::state:
+    break;
+  case Gain::observation: {
+    /* M = S^T (S S^T + R)^-1 D, only the lower triangle of C is formed */
+    // A serial block has its own system
+    auto &C = ws.serial ? ws.blocks[first].C : ws.C;
+    auto &llt = ws.serial ? ws.blocks[first].llt : ws.llt;
+    if (ws.R_diagonal) {
+      C.setZero();
+      C.diagonal() = ws.R_diag.segment(offset, size);
+    } else {
+      C = ws.R.block(offset, offset, size, size);
+    }
+    common::compute::rank_update(C, S);
+    llt.compute(C);
+    if (llt.info() == Eigen::Success) {
+      llt.solveInPlace(D);
+    } else {
+      // Singular innovation covariance, e.g. no R given
+      common::compute::symmetrize(C);
+      D = C.completeOrthogonalDecomposition().pseudoInverse() * D;
+    }
+    ws.M.noalias() = S.transpose() * D;
+    break;
+  }
+  case Gain::ensemble: {
+    /* M = (I + T^T T)^-1 T^T L^-1 D with R = L L^T and T = L^-1 S */
+    auto T = ws.T.middleRows(offset, size);
+    if (ws.R_diagonal) {
+      const auto R_diag_inv_sqrt = ws.R_diag_inv_sqrt.segment(offset, size);
+      T = R_diag_inv_sqrt.asDiagonal() * S;
+      D.array().colwise() *= R_diag_inv_sqrt.array();
+    } else {
+      // L is block diagonal, each block is whitened by its own factor
+      T = S;
+      for_each_block(ws, first, last, [&ws](const ObservationBlock &block) {
+        block.R_llt.matrixL().solveInPlace(ws.T.middleRows(block.offset, block.size));
+        block.R_llt.matrixL().solveInPlace(ws.D.middleRows(block.offset, block.size));
+        return true;
+      });
+    }
+    ws.Q.setIdentity();
+    common::compute::rank_update(ws.Q, T.transpose());
+    ws.M.noalias() = T.transpose() * D;
+    ws.llt.compute(ws.Q);
+    ws.llt.solveInPlace(ws.M);
+    break;
+  }
+  }
+}
+
+/*
+ * Scaled anomaly Z = mean_diff(X) / sqrt(N-1), S = H Z and d_mean = y - H mean(X) of the
+ * observations [offset, offset + size)
+ */
+void observed_anomaly(Workspace &ws, const Eigen::Ref<const Eigen::MatrixXd> &X,
+                      const Eigen::Ref<const Eigen::VectorXd> &y, const int64_t offset,
+                      const int64_t size) {
+  const auto N = X.cols();
+  ws.x_mean.noalias() = X.rowwise().mean();
+  ws.Z = (X.colwise() - ws.x_mean) * (1.0 / std::sqrt(N - 1.0));
+  auto S = ws.S.middleRows(offset, size);
+  auto d_mean = ws.d_mean.segment(offset, size);
+  d_mean = y.segment(offset, size);
+  if (ws.H_identity) {
+    S = ws.Z.middleRows(offset, size);
+    d_mean -= ws.x_mean.segment(offset, size);
+  } else {
+    S.noalias() = ws.H.middleRows(offset, size) * ws.Z;
+    d_mean.noalias() -= ws.H.middleRows(offset, size) * ws.x_mean;
+  }
+}
+} // namespace
+
+bool filter(Workspace &ws, Eigen::Ref<Eigen::MatrixXd> X,
+            const Eigen::Ref<const Eigen::VectorXd> &y) {
+  using common::compute::Gain;
+  if (ws.by_rows) {
+    return filter(ws, X, X, y);
+  }
+  if (!available(ws)) {
+    return false;
+  }
+  const auto l = y.size();
+
+  if (ws.serial) {
+    /* The blocks one after another, each from the ensemble updated by the previous ones */
+    for (std::size_t block = 0; block < ws.blocks.size(); ++block) {
+      observed_anomaly(ws, X, y, ws.blocks[block].offset, ws.blocks[block].size);
+      perturbed_innovation(ws, block, block + 1);
+      ensemble_weights(ws, block, block + 1);
+      X.noalias() += ws.Z * ws.M;
+    }
+    return true;
+  }
+
+  observed_anomaly(ws, X, y, 0, l);
+  perturbed_innovation(ws, 0, ws.blocks.size());
+
+  if (ws.gain == Gain::state) {
+    /* X += (I + P B)^-1 P F D with P = Z Z^T */
+    ws.U.noalias() = ws.F * ws.D;
+    ws.P.setZero();
+    common::compute::rank_update(ws.P, ws.Z);
+    common::compute::symmetrize(ws.P);
+    ws.A.setIdentity();
+    ws.A.noalias() += ws.P * ws.B;
+    ws.W.noalias() = ws.P * ws.U;
+    ws.lu.compute(ws.A);
+    ws.U.noalias() = ws.lu.solve(ws.W);
+    X += ws.U;
+    return true;
+  }
+  ensemble_weights(ws, 0, ws.blocks.size());
+  X.noalias() += ws.Z * ws.M;
+  return true;
+}
+
+namespace {
+/*
+ * Two pass update of the rows [row, row + X.rows()) of the state.
+ * The observed members of the rows are summed over the ranks of the group if given.
+ */
+bool update_rows(Workspace &ws, const Eigen::Ref<const Eigen::MatrixXd> &X,
+                 Eigen::Ref<Eigen::MatrixXd> X_next, const Eigen::Ref<const Eigen::VectorXd> &y,
+                 const int64_t row, common::RankGroup *group) {
+  if (!available(ws)) {
+    return false;
+  }
+  if (ws.gain == common::compute::Gain::state) {
+    std::clog << "gain formulation 'state' is not available with the update by rows"
+              << std::endl;
+    return false;
   }
+  const auto k = X.rows();
+  const auto N = X.cols();
+  const auto l = y.size();
+  const auto rows = ws.block_rows > 0 ? ws.block_rows : std::max<int64_t>(k, 1);
+  const auto blocks = (k + rows - 1) / rows;
+  const auto threads = std::min(ws.pool->size(), std::max<int64_t>(blocks, 1));
 
-  Eigen::MatrixXd R;
-  if (param.R.empty()) {
-    R = Eigen::MatrixXd::Zero(param.l, param.l);
-  } else if (param.R.size() == static_cast<std::size_t>(param.l)) {
-    R = Eigen::Map<const Eigen::VectorXd>{param.R.data(), static_cast<Eigen::Index>(param.l)}
-            .asDiagonal();
+  /* First pass: the observed members HX of the rows, the state rows are only read */
+  Eigen::MatrixXd HX;
+  if (ws.H_identity) {
+    // The observed states among the rows, the others are zero
+    const auto begin = std::clamp<int64_t>(row, 0, l), end = std::clamp<int64_t>(row + k, 0, l);
+    if (begin == 0 && end == l) {
+      HX = X.topRows(l);
+    } else {
+      HX = Eigen::MatrixXd::Zero(l, N);
+      if (begin < end) {
+        HX.middleRows(begin, end - begin) = X.middleRows(begin - row, end - begin);
+      }
+    }
   } else {
-    R = Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>{
-        param.R.data(), static_cast<Eigen::Index>(param.l), static_cast<Eigen::Index>(param.l)};
+    std::vector<Eigen::MatrixXd> partial(threads, Eigen::MatrixXd::Zero(l, N));
+    ws.pool->parallel_for(blocks, [&](const int64_t block, const int64_t thread) {
+      const auto begin = block * rows, size = std::min(rows, k - begin);
+      partial[thread].noalias() += ws.H.middleCols(row + begin, size) * X.middleRows(begin, size);
+      return true;
+    });
+    HX = std::move(partial[0]);
+    for (int64_t thread = 1; thread < threads; ++thread) {
+      HX += partial[thread];
+    }
+  }
+  if (group != nullptr && !group->allreduce(HX.data(), HX.size())) {
+    return false;
   }
 
-  const bool is_tall = param.N < param.l && param.N < param.k;
-  const Eigen::MatrixXd K = is_tall ? common::compute::kalman_gain_tall(X, H, R).eval()
-                                    : common::compute::kalman_gain(X, H, R).eval();
+  /* The observation space, S = mean_diff(HX) / sqrt(N-1) and d_mean = y - mean(HX) */
+  const Eigen::VectorXd hx_mean = HX.rowwise().mean();
+  ws.S = (HX.colwise() - hx_mean) * (1.0 / std::sqrt(N - 1.0));
+  ws.d_mean = y - hx_mean;
+  perturbed_innovation(ws, 0, ws.blocks.size());
+  ensemble_weights(ws, 0, ws.blocks.size());
 
-  const auto Y =
-      Eigen::Map<const Eigen::VectorXd>{obs.y.data(), static_cast<Eigen::Index>(obs.y.size())}
-          .replicate(1, param.N);
-  const auto W = common::compute::rand(R, param.N, engine);
-  const auto X_next = X + K * (Y + common::compute::mean_diff(W) - H * X);
+  /* Second pass: X += Z M = X + (X - mean) M / sqrt(N-1) block by block of rows */
+  const Eigen::MatrixXd W = ws.M * (1.0 / std::sqrt(N - 1.0));
+  const Eigen::RowVectorXd w = W.colwise().sum();
+  std::vector<Eigen::MatrixXd> blocks_in(threads), blocks_out(threads);
+  ws.pool->parallel_for(blocks, [&](const int64_t block, const int64_t thread) {
+    const auto begin = block * rows, size = std::min(rows, k - begin);
+    auto &x = blocks_in[thread];
+    auto &x_next = blocks_out[thread];
+    x = X.middleRows(begin, size);
+    x_next = x;
+    x_next.noalias() += x * W;
+    x_next.noalias() -= x.rowwise().mean() * w;
+    X_next.middleRows(begin, size) = x_next;
+    return true;
+  });
+  return true;
+}
+} // namespace
+
+bool filter(Workspace &ws, const Eigen::Ref<const Eigen::MatrixXd> &X,
+            Eigen::Ref<Eigen::MatrixXd> X_next, const Eigen::Ref<const Eigen::VectorXd> &y) {
+  return update_rows(ws, X, X_next, y, 0, nullptr);
+}
+
+bool filter(Workspace &ws, const Eigen::Ref<const Eigen::MatrixXd> &X,
+            Eigen::Ref<Eigen::MatrixXd> X_next, const Eigen::Ref<const Eigen::VectorXd> &y,
+            const int64_t row, common::RankGroup &group) {
+  return update_rows(ws, X, X_next, y, row, &group);
+}
+
+bool filter(Workspace &ws, std::vector<io::State> &states, const io::Obs &obs) {
+  ws.engine.seed(static_cast<unsigned>(ws.seed + obs.obs_tim));
+
+  // Z is not allocated for the update by rows, the size is taken from the states
+  const auto N = static_cast<Eigen::Index>(states.size());
+  const auto k = static_cast<Eigen::Index>(states.empty() ? 0 : states.front().x.size());
+  Eigen::MatrixXd X{k, N};
+  for (const auto &state : states) {
+    if (state.id < 0 || state.id >= N || static_cast<Eigen::Index>(state.x.size()) != k) {
+      std::clog << "invalid state of id " << state.id << " given" << std::endl;
+      return false;
+    }
+    X.col(state.id) = Eigen::Map<const Eigen::VectorXd>{state.x.data(),
+                                                        static_cast<Eigen::Index>(state.x.size())};
+  }
+
+  const auto y =
+      Eigen::Map<const Eigen::VectorXd>{obs.y.data(), static_cast<Eigen::Index>(obs.y.size())};
+  if (!filter(ws, X, y)) {
+    return false;
+  }
 
   for (auto &state : states) {
     Eigen::Map<Eigen::VectorXd>{state.x.data(), static_cast<Eigen::Index>(state.x.size())} =
-        X_next.col(state.id);
+        X.col(state.id);
     state.obs_tim++;
   }
 
   return true;
 }
 
+bool filter(Workspace &ws, io::Ensemble &ensemble, const io::Obs &obs) {
+  ws.engine.seed(static_cast<unsigned>(ws.seed + obs.obs_tim));
+
+  auto X = Eigen::Map<Eigen::MatrixXd>{ensemble.X.data(), ensemble.k, ensemble.N};
+  const auto y =
+      Eigen::Map<const Eigen::VectorXd>{obs.y.data(), static_cast<Eigen::Index>(obs.y.size())};
+  if (!filter(ws, X, y)) {
+    return false;
+  }
+  ensemble.obs_tim++;
+  return true;
+}
+
+bool filter(Workspace &ws, io::MappedEnsemble &ensemble, const io::Obs &obs) {
+  ws.engine.seed(static_cast<unsigned>(ws.seed + obs.obs_tim));
+
+  const auto y =
+      Eigen::Map<const Eigen::VectorXd>{obs.y.data(), static_cast<Eigen::Index>(obs.y.size())};
+  auto X = ensemble.X();
+  if (!filter(ws, X, y)) {
+    return false;
+  }
+  ensemble.header().obs_tim++;
+  return true;
+}
+
+bool filter(Workspace &ws, const io::MappedEnsemble &input, io::MappedEnsemble &output,
+            const io::Obs &obs) {
+  ws.engine.seed(static_cast<unsigned>(ws.seed + obs.obs_tim));
+
+  const auto y =
+      Eigen::Map<const Eigen::VectorXd>{obs.y.data(), static_cast<Eigen::Index>(obs.y.size())};
+  if (!filter(ws, input.X(), output.X(), y)) {
+    return false;
+  }
+  output.header().obs_tim = input.header().obs_tim + 1;
+  return true;
+}
+
+bool filter(Workspace &ws, const io::MappedEnsemble &input, io::MappedEnsemble &output,
+            const io::Obs &obs, common::RankGroup &group) {
+  ws.engine.seed(static_cast<unsigned>(ws.seed + obs.obs_tim));
+
+  const auto obs_tim = input.header().obs_tim;
+  const auto slice = group.slice(input.header().k);
+  const auto y =
+      Eigen::Map<const Eigen::VectorXd>{obs.y.data(), static_cast<Eigen::Index>(obs.y.size())};
+  if (!filter(ws, input.X().middleRows(slice.begin, slice.size),
+              output.X().middleRows(slice.begin, slice.size), y, slice.begin, group)) {
+    return false;
+  }
+  // Every rank has validated the input once the observed members are reduced
+  if (group.rank() == 0) {
+    output.header().obs_tim = obs_tim + 1;
+  }
+  return true;
+}
+
+bool filter(std::vector<io::State> &states, const io::Obs &obs, const Param &param) {
+  Workspace ws{param};
+  return filter(ws, states, obs);
+}
+
 int entry(const command::filter::Args &args) {
-  if (!std::filesystem::exists(args.output) && !std::filesystem::create_directories(args.output)) {
+  if (!io::create_output_directory(args.output)) {
     return EXIT_FAILURE;
   }
 
   /* Parse filename */
-  std::vector<std::string> state_files;
-  if (!io::parse_filename(args.state, state_files)) {
-    return EXIT_FAILURE;
-  }
+  common::profile::Phase phase{"parse_filename"};
+  const bool is_ensemble = io::is_ensemble(args.state);
   std::vector<std::string> param_filenames;
   for (const auto &param : args.param) {
-    if (!io::parse_filename(param, param_filenames)) {
+    if (!io::parse_filename(param, param_filenames, io::layout())) {
       return EXIT_FAILURE;
     }
   }
   /* filename -> json */
-  std::vector<nlohmann::json> state_jsons;
-  state_jsons.reserve(state_files.size());
-  for (const auto &state_file : state_files) {
-    nlohmann::json state_json;
-    if (!io::read_json(state_file, state_json)) {
-      return EXIT_FAILURE;
-    }
-    state_jsons.emplace_back(state_json);
-  }
-  state_files.clear();
+  phase.next("read_json");
   nlohmann::json obs_json, param_json;
-  if (!io::read_json(args.obs, obs_json)) {
+  const bool is_obs_series = io::is_obs_series(args.obs);
+  if (!is_obs_series && !io::read_json(args.obs, obs_json)) {
     return EXIT_FAILURE;
   }
   for (const auto &param_filename : param_filenames) {
@@ -144,25 +700,22 @@ int entry(const command::filter::Args &args) {
   param_filenames.clear();
 
   /* json -> object */
-  std::vector<io::State> states;
-  states.reserve(state_jsons.size());
-  for (const auto &state_json : state_jsons) {
+  phase.next("json_to_object");
+  Param param;
+  io::Obs obs;
+  if (is_obs_series) {
+    // Only the record of the observation time is read from the series
+    if (!io::read_obs_series(args.obs, obs)) {
+      return EXIT_FAILURE;
+    }
+  } else {
     try {
-      states.emplace_back(state_json);
+      obs = obs_json;
     } catch (const nlohmann::json::exception &e) {
-      std::clog << "failed to parse state json " << e.what() << std::endl;
+      std::clog << "failed to parse obs json " << e.what() << std::endl;
       return EXIT_FAILURE;
     }
   }
-  state_jsons.clear();
-  Param param;
-  io::Obs obs;
-  try {
-    obs = obs_json;
-  } catch (const nlohmann::json::exception &e) {
-    std::clog << "failed to parse obs json " << e.what() << std::endl;
-    return EXIT_FAILURE;
-  }
   try {
     param = param_json;
   } catch (const nlohmann::json::exception &e) {
@@ -175,21 +728,166 @@ int entry(const command::filter::Args &args) {
   if (param_json.contains("H") && param_json["H"].is_array()) {
     param.H = param_json["H"].get<std::vector<double>>();
   }
+  if (param_json.contains("H_sparse") && param_json["H_sparse"].is_object()) {
+    if (!param.H.empty()) {
+      std::clog << "H and H_sparse should not be given together" << std::endl;
+      return EXIT_FAILURE;
+    }
+    const auto &sparse = param_json["H_sparse"];
+    if (!sparse_to_dense(sparse.value("begin", std::vector<int64_t>{}),
+                         sparse.value("index", std::vector<int64_t>{}),
+                         sparse.value("value", std::vector<double>{}), param.k, param.H)) {
+      return EXIT_FAILURE;
+    }
+  }
+  if (param_json.contains("gain") && param_json["gain"].is_string()) {
+    param.gain = param_json["gain"].get<std::string>();
+  }
+  if (param_json.contains("block_rows") && param_json["block_rows"].is_number_integer()) {
+    param.block_rows = param_json["block_rows"].get<int64_t>();
+  }
+  if (param_json.contains("blocks") && param_json["blocks"].is_array()) {
+    for (const auto &block_json : param_json["blocks"]) {
+      ObsBlock block{block_json.value("l", int64_t{0}), {}, {}};
+      if (block_json.contains("R") && block_json["R"].is_array()) {
+        block.R = block_json["R"].get<std::vector<double>>();
+      }
+      if (block_json.contains("H") && block_json["H"].is_array()) {
+        block.H = block_json["H"].get<std::vector<double>>();
+      }
+      param.blocks.emplace_back(std::move(block));
+    }
+  }
+  if (param_json.contains("serial") && param_json["serial"].is_boolean()) {
+    param.serial = param_json["serial"].get<bool>();
+  }
 
-  /* Check integrity */
-  if (!validate(states, obs, param)) {
+  /* Read states */
+  io::MappedEnsemble input;
+  io::Ensemble ensemble;
+  // A store filtered into itself is attached writable and updated without any copy
+  const bool in_place = io::is_store(args.state) && args.state == args.output;
+  const auto format = io::to_format(args.format);
+  const bool mapped_output =
+      (format == io::Format::binary && !io::is_stdio(args.output)) || io::is_store(args.output);
+  if (args.ranks > 1 && (!is_ensemble || !(in_place || mapped_output))) {
+    // The ranks share the mappings of the input and the output
+    std::clog << "--ranks requires a binary ensemble or a store given by --state and a binary "
+                 "or store output"
+              << std::endl;
     return EXIT_FAILURE;
   }
+  if (is_ensemble) {
+    phase.next("read_ensemble");
+    if (!input.open(args.state, in_place)) {
+      return EXIT_FAILURE;
+    }
+    input.advise_sequential();
+  } else {
+    // The members are streamed into the k x N block, see io::read_state()
+    phase.next("read_state");
+    if (!io::read_states(args.state, ensemble)) {
+      return EXIT_FAILURE;
+    }
+  }
 
-  if (!filter(states, obs, param)) {
+  /* Check integrity */
+  phase.next("validate");
+  if (is_ensemble ? !validate(input, obs, param) : !validate(ensemble, obs, param)) {
     return EXIT_FAILURE;
   }
 
-  for (const auto &state : states) {
-    const auto &filename = std::filesystem::path(args.output) / io::state_filename(state);
-    if (!io::write_json(filename, state, args.force)) {
+  // The ranks of a job are told apart by the experiment, the observation and the output
+  common::RankGroup group;
+  if (args.ranks > 1) {
+    phase.next("join");
+    char job[256];
+    std::snprintf(job, sizeof(job), "%s.%" PRId64 ".%zx", param.name.c_str(), obs.obs_tim,
+                  std::hash<std::string>{}(args.output));
+    if (!group.open(job, args.ranks, args.rank, param.l * param.N)) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  phase.next("compute");
+  Workspace ws{param, group.is_open()};
+  // The standard output is kept for the states
+  auto &log = io::is_stdio(args.output) ? std::clog : std::cout;
+  if (group.rank() == 0) {
+    log << "gain formulation (" << param.gain << ")" << std::endl;
+    for (const auto &cost : ws.costs) {
+      log << (cost.gain == ws.gain ? " * " : "   ") << cost << std::endl;
+    }
+  }
+  io::MappedEnsemble output;
+  if (!is_ensemble) {
+    if (!filter(ws, ensemble, obs)) {
+      return EXIT_FAILURE;
+    }
+  } else if (in_place) {
+    if (group.is_open() ? !filter(ws, input, input, obs, group) : !filter(ws, input, obs)) {
+      return EXIT_FAILURE;
+    }
+  } else if (mapped_output) {
+    // The analysis is computed in place on the mapping of the output file or store
+    const auto &header = input.header();
+    const bool store = io::is_store(args.output);
+    const auto filename =
+        store ? std::filesystem::path(args.output)
+              : std::filesystem::path(args.output) /
+                    io::ensemble_filename(input.name(), header.sys_tim, header.obs_tim + 1);
+    // The output is created by the rank 0, the others map it once it is there
+    if (group.rank() == 0 &&
+        !output.create(filename, input.name(), header.N, header.k, header.sys_tim, header.obs_tim,
+                       args.force || store)) {
+      return EXIT_FAILURE;
+    }
+    if (group.is_open() &&
+        (!group.barrier() || (group.rank() > 0 && !output.open(filename, true)))) {
+      return EXIT_FAILURE;
+    }
+    output.advise_sequential();
+    if (group.is_open()) {
+      // Each rank reads and writes its own rows
+      if (!filter(ws, input, output, obs, group)) {
+        return EXIT_FAILURE;
+      }
+      input.close();
+    } else if (ws.block_rows > 0) {
+      // The rows are read from the input and written to the output block by block
+      if (!filter(ws, input, output, obs)) {
+        return EXIT_FAILURE;
+      }
+      input.close();
+    } else {
+      io::copy_blocks(input.X().data(), output.X().data(), input.X().size());
+      input.close();
+      if (!filter(ws, output, obs)) {
+        return EXIT_FAILURE;
+      }
+    }
+  } else {
+    if (!io::to_ensemble(input, ensemble) || !filter(ws, ensemble, obs)) {
       return EXIT_FAILURE;
     }
+    input.close();
+  }
+
+  phase.next("write_" + args.format);
+  auto &mapped = in_place ? input : output;
+  // The output is completed by the rank 0 once all the ranks have written their rows, it is
+  // removed if any of them failed
+  const auto rank = group.rank();
+  if (rank > 0 && !mapped.close()) {
+    return EXIT_FAILURE;
+  }
+  if (!group.close()) {
+    return EXIT_FAILURE;
+  }
+  if (rank == 0 && (mapped.is_open()
+                        ? !mapped.close()
+                        : !io::write_states(args.output, ensemble, format, args.force))) {
+    return EXIT_FAILURE;
   }
 
   return EXIT_SUCCESS;
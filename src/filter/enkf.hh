@@ -7,20 +7,40 @@
 #define __DOUKA_FILTER_ENKF__
 
 #include "command/filter.hh"
+#include "common/compute.hh"
+#include "common/ensemble.hh"
 #include "common/io.hh"
+#include "common/parallel.hh"
+#include "common/ranks.hh"
 #include "douka/io.hh"
 
+#include <Eigen/Cholesky>
 #include <Eigen/Core>
+#include <Eigen/LU>
 
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
+#include <array>
 #include <iostream>
+#include <memory>
+#include <random>
 #include <vector>
 
 namespace douka::filter::enkf {
 inline static constexpr std::string_view name = "enkf";
 inline static constexpr std::string_view description = "Ensemble Kalman Filter.";
 
+/**
+ * @brief Observations whose errors are independent of the other observations, a diagonal block
+ * of R with the rows of H observing them
+ */
+struct ObsBlock {
+  int64_t l;
+  std::vector<double> R; // Optional, l or l x l
+  std::vector<double> H; // Optional, l x k
+};
+
 struct Param {
   std::string name;
   int64_t seed;
@@ -28,8 +48,12 @@ struct Param {
   int64_t k;
   int64_t l;
 
-  std::vector<double> R; // Optional
-  std::vector<double> H; // Optional
+  std::vector<double> R;    // Optional
+  std::vector<double> H;    // Optional
+  std::string gain = "auto"; // Optional
+  int64_t block_rows = 0;    // Optional, rows of X per block of the out-of-core update
+  std::vector<ObsBlock> blocks = {}; // Optional, in place of R and H
+  bool serial = false;               // Optional, assimilate the blocks one after another
 
   NLOHMANN_DEFINE_TYPE_INTRUSIVE(Param, name, seed, N, k, l);
 
@@ -60,11 +84,179 @@ struct Param {
       std::clog << "invalid size of H given " << H.size() << " != " << k * l << std::endl;
       return false;
     }
+    if (gain != "auto" && std::find(std::begin(common::compute::gain_names),
+                                    std::end(common::compute::gain_names),
+                                    gain) == std::end(common::compute::gain_names)) {
+      std::clog << "invalid gain formulation '" << gain << "' given" << std::endl;
+      return false;
+    }
+    if (block_rows < 0) {
+      std::clog << "invalid block_rows " << block_rows << " given" << std::endl;
+      return false;
+    }
+    if (block_rows > 0 && gain == "state") {
+      std::clog << "gain formulation 'state' is not available with block_rows" << std::endl;
+      return false;
+    }
+    if (!blocks.empty()) {
+      if (!R.empty() || !H.empty()) {
+        std::clog << "R and H should be given by the blocks" << std::endl;
+        return false;
+      }
+      int64_t size = 0;
+      for (const auto &block : blocks) {
+        if (block.l <= 0) {
+          std::clog << "invalid size of block given " << block.l << std::endl;
+          return false;
+        }
+        if (!block.R.empty() && block.R.size() != static_cast<std::size_t>(block.l) &&
+            block.R.size() != static_cast<std::size_t>(block.l * block.l)) {
+          std::clog << "invalid size of R of block given " << block.R.size() << " != " << block.l
+                    << " or " << block.l * block.l << std::endl;
+          return false;
+        }
+        if (block.H.empty() != blocks.front().H.empty()) {
+          std::clog << "H should be given for all the blocks or none" << std::endl;
+          return false;
+        }
+        if (!block.H.empty() && block.H.size() != static_cast<std::size_t>(k * block.l)) {
+          std::clog << "invalid size of H of block given " << block.H.size()
+                    << " != " << k * block.l << std::endl;
+          return false;
+        }
+        size += block.l;
+      }
+      if (size != l) {
+        std::clog << "invalid size of blocks given " << size << " != " << l << std::endl;
+        return false;
+      }
+    }
+    if (serial && (block_rows > 0 || gain == "state")) {
+      std::clog << "serial blocks are not available with block_rows or gain formulation 'state'"
+                << std::endl;
+      return false;
+    }
     return true;
   }
 };
 
+/**
+ * @brief Observations [offset, offset + size) of a block and its factor of R
+ */
+struct ObservationBlock {
+  int64_t offset = 0;
+  int64_t size = 0;
+  Eigen::LLT<Eigen::MatrixXd> R_llt; // size x size lower Cholesky factor of R (if not R_diagonal)
+  Eigen::MatrixXd C;                 // size x size innovation covariance (observation, serial)
+  Eigen::LLT<Eigen::MatrixXd> llt;   // (observation, serial)
+};
+
+/**
+ * @brief Buffers of the analysis update.
+ * Sized once from Param and reused across cycles, so that a cycle does not allocate.
+ * Only the buffers of the selected gain formulation are allocated.
+ */
+struct Workspace {
+  int64_t seed;
+  int64_t block_rows; // Rows of X per block of the out-of-core update if positive
+  bool by_rows;       // Two pass update by rows, Z and the state gain are not allocated
+  bool serial;        // The blocks are assimilated one after another
+  common::compute::Gain gain;
+  std::array<common::compute::GainCost, 3> costs;
+
+  bool H_identity;   // No H given, the first l states are observed
+  bool R_diagonal;   // R is diagonal or not given
+  Eigen::MatrixXd H; // l x k (if not H_identity)
+  Eigen::MatrixXd R; // l x l (if not R_diagonal), block diagonal if the blocks are given
+  Eigen::VectorXd R_diag, R_diag_inv, R_diag_sqrt, R_diag_inv_sqrt;
+  // The blocks of Param, or a single block of all the observations. R is factorized block by
+  // block, and the blocks are whitened concurrently.
+  std::vector<ObservationBlock> blocks;
+
+  Eigen::MatrixXd Z; // k x N scaled anomaly (X - mean) / sqrt(N - 1)
+  Eigen::MatrixXd S; // l x N observed anomaly H Z
+  Eigen::MatrixXd D; // l x N perturbed innovation
+  Eigen::MatrixXd E; // l x N standard normal draw
+  Eigen::MatrixXd M; // N x N ensemble weight (observation, ensemble)
+  Eigen::VectorXd x_mean, d_mean, e_mean;
+
+  Eigen::MatrixXd C; // l x l innovation covariance, lower triangle (observation)
+  Eigen::MatrixXd T; // l x N whitened observed anomaly L^-1 S (ensemble)
+  Eigen::MatrixXd Q; // N x N I + T^T T, lower triangle (ensemble)
+  Eigen::LLT<Eigen::MatrixXd> llt;
+
+  Eigen::MatrixXd F; // k x l H^T R^-1 (state)
+  Eigen::MatrixXd B; // k x k H^T R^-1 H (state)
+  Eigen::MatrixXd P; // k x k Z Z^T (state)
+  Eigen::MatrixXd A; // k x k I + P B (state)
+  Eigen::MatrixXd U; // k x N (state)
+  Eigen::MatrixXd W; // k x N (state)
+  Eigen::PartialPivLU<Eigen::MatrixXd> lu;
+
+  std::default_random_engine engine;
+  std::normal_distribution<double> dist{0.0, 1.0};
+
+  // Compute threads of the blocks, kept across cycles
+  std::unique_ptr<common::ThreadPool> pool;
+
+  /**
+   * @brief by_rows tells that the update goes by rows of the state, as the ranks of a group do,
+   * for which the k x k system of the state gain is not available
+   */
+  explicit Workspace(const Param &param, const bool by_rows = false);
+};
+
+/**
+ * @brief Dense l x k H of a sparse one in CSR form, as given by "H_sparse" of the parameters.
+ * The row i has value[j] at the column index[j] for j in begin[i] to begin[i + 1] - 1.
+ */
+bool sparse_to_dense(const std::vector<int64_t> &begin, const std::vector<int64_t> &index,
+                     const std::vector<double> &value, const int64_t k, std::vector<double> &H);
+
 bool validate(const std::vector<io::State> &states, const io::Obs &obs, const Param &param);
+bool validate(const io::Ensemble &ensemble, const io::Obs &obs, const Param &param);
+bool validate(const io::MappedEnsemble &ensemble, const io::Obs &obs, const Param &param);
+
+/**
+ * @brief Analysis update of the k x N ensemble X in place
+ */
+bool filter(Workspace &ws, Eigen::Ref<Eigen::MatrixXd> X,
+            const Eigen::Ref<const Eigen::VectorXd> &y);
+
+/**
+ * @brief Out-of-core analysis update of X into X_next, which may be X itself.
+ * The update X += Z M is independent for each state row once the N x N weight M is known.
+ * A first pass over the rows computes the observed members HX, M is solved in the observation
+ * space, then a second pass updates the rows in blocks of block_rows (all rows if not
+ * positive). Only a block of rows per thread is held besides the l x N and N x N quantities, so
+ * X and X_next may be mappings of files larger than memory.
+ * The state gain is not available.
+ */
+bool filter(Workspace &ws, const Eigen::Ref<const Eigen::MatrixXd> &X,
+            Eigen::Ref<Eigen::MatrixXd> X_next, const Eigen::Ref<const Eigen::VectorXd> &y);
+
+/**
+ * @brief Analysis update of a state decomposed by rows across the ranks of the group, X and
+ * X_next are the rows [row, row + X.rows()) owned by the rank.
+ * The observed members of the rows are summed over the ranks, the only exchange of l x N
+ * doubles, so that every rank solves the same weight M from the same perturbation and updates
+ * its own rows as by the out-of-core update.
+ */
+bool filter(Workspace &ws, const Eigen::Ref<const Eigen::MatrixXd> &X,
+            Eigen::Ref<Eigen::MatrixXd> X_next, const Eigen::Ref<const Eigen::VectorXd> &y,
+            const int64_t row, common::RankGroup &group);
+bool filter(Workspace &ws, std::vector<io::State> &states, const io::Obs &obs);
+bool filter(Workspace &ws, io::Ensemble &ensemble, const io::Obs &obs);
+bool filter(Workspace &ws, io::MappedEnsemble &ensemble, const io::Obs &obs);
+bool filter(Workspace &ws, const io::MappedEnsemble &input, io::MappedEnsemble &output,
+            const io::Obs &obs);
+
+/**
+ * @brief Update of the rows of the rank, see RankGroup::slice(), input and output may be the
+ * same mapping. The header of the output is written by the rank 0.
+ */
+bool filter(Workspace &ws, const io::MappedEnsemble &input, io::MappedEnsemble &output,
+            const io::Obs &obs, common::RankGroup &group);
 bool filter(std::vector<io::State> &states, const io::Obs &obs, const Param &param);
 int entry(const command::filter::Args &args);
 } // namespace douka::filter::enkf
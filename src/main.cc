@@ -4,12 +4,22 @@
  */
 
 #include "command.hh"
+#include "common/io.hh"
+#include "common/json.hh"
+#include "common/parallel.hh"
+#include "common/profile.hh"
 
 #include <cassert>
 #include <cinttypes>
+#include <cstdlib>
 #include <cstring>
 #include <filesystem>
+#include <iomanip>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 // Generated by cmake
 #include "douka_version.hh"
@@ -29,8 +39,21 @@ static bool show_help(const int argc, char const *const argv[]) {
     }
     os << std::endl;
     os << "Options:" << std::endl;
-    os << "   --help      (Opt) Print help message" << std::endl;
-    os << "   --version   (Opt) Print version" << std::endl;
+    const std::pair<std::string_view, std::string> options[] = {
+        {"--help", "Print help message"},
+        {"--version", "Print version"},
+        {"--profile", "Write Chrome trace of the command phases to the given file"},
+        {"--io-threads", "Number of threads reading and writing the member files (default=1)"},
+        {"--threads", "Number of threads of the computations (default=number of cores)"},
+        {"--file-index", "Cache the listing of the member directories in " +
+                             std::string{io::filename_index}},
+        {"--id-width", "Number of digits of the member id in the file name (default=4)"},
+        {"--layout", "Layout of the member files [flat|sharded] (default=flat)"},
+        {"--json-style", "Style of the member files [compact|pretty] (default=compact)"},
+    };
+    for (const auto &[name, description] : options) {
+      os << "   " << std::left << std::setw(13) << name << "(Opt) " << description << std::endl;
+    }
   };
 
   if (argc <= 1) {
@@ -68,6 +91,12 @@ static command::id get_args(const int argc, const char *const argv[]) {
     return command::id::filter;
   } else if (command::obsgen::name == argv[1]) {
     return command::id::obsgen;
+  } else if (command::convert::name == argv[1]) {
+    return command::id::convert;
+  } else if (command::store::name == argv[1]) {
+    return command::id::store;
+  } else if (command::obsprep::name == argv[1]) {
+    return command::id::obsprep;
   }
 
   if (!strncmp(argv[1], "--", 2)) {
@@ -75,29 +104,109 @@ static command::id get_args(const int argc, const char *const argv[]) {
   }
   throw std::invalid_argument("unknown command" + std::string{argv[1]} + " given");
 }
+
+// Value of the global option at argv[i + 1]
+static const char *global_option_value(const int argc, char *argv[], const int i) {
+  if (i + 1 >= argc || !strncmp(argv[i + 1], "--", 2)) {
+    throw std::invalid_argument("required option for '" + std::string{argv[i]} + "' not given");
+  }
+  return argv[i + 1];
+}
+
+static int64_t to_positive(const char *option, const char *value) {
+  char *end = nullptr;
+  const auto number = std::strtoll(value, &end, 10);
+  if (*end != '\0' || number < 1) {
+    throw std::invalid_argument("invalid value '" + std::string{value} + "' given for '" +
+                                std::string{option} + "'");
+  }
+  return number;
+}
+
+// Remove global options from argv so that each command only sees its own options
+static std::vector<char *> strip_global_options(const int argc, char *argv[]) {
+  std::vector<char *> args;
+  args.reserve(argc);
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--profile")) {
+      common::profile::enable(global_option_value(argc, argv, i++));
+      continue;
+    }
+    if (!strcmp(argv[i], "--file-index")) {
+      io::use_filename_index() = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--io-threads")) {
+      io::set_io_threads(to_positive(argv[i], global_option_value(argc, argv, i)));
+      i++;
+      continue;
+    }
+    if (!strcmp(argv[i], "--threads")) {
+      common::set_compute_threads(to_positive(argv[i], global_option_value(argc, argv, i)));
+      i++;
+      continue;
+    }
+    if (!strcmp(argv[i], "--id-width")) {
+      io::layout().id_width = to_positive(argv[i], global_option_value(argc, argv, i));
+      i++;
+      continue;
+    }
+    if (!strcmp(argv[i], "--layout")) {
+      const std::string layout = global_option_value(argc, argv, i++);
+      if (layout != "flat" && layout != "sharded") {
+        throw std::invalid_argument("unknown layout '" + layout + "' given");
+      }
+      io::layout().sharded = layout == "sharded";
+      continue;
+    }
+    if (!strcmp(argv[i], "--json-style")) {
+      io::set_json_style(io::to_json_style(global_option_value(argc, argv, i++)));
+      continue;
+    }
+    args.emplace_back(argv[i]);
+  }
+  return args;
+}
+
+static int run(const int argc, char *argv[]) {
+  if (show_help(argc, argv) || show_version(argc, argv)) {
+    return EXIT_SUCCESS;
+  }
+  const auto id = get_args(argc, argv);
+  const common::profile::Scope scope{argv[1]};
+  switch (id) {
+  case command::id::init:
+    return command::init::entry(argc, argv);
+  case command::id::predict:
+    return command::predict::entry(argc, argv);
+  case command::id::filter:
+    return command::filter::entry(argc, argv);
+  case command::id::obsgen:
+    return command::obsgen::entry(argc, argv);
+  case command::id::convert:
+    return command::convert::entry(argc, argv);
+  case command::id::store:
+    return command::store::entry(argc, argv);
+  case command::id::obsprep:
+    return command::obsprep::entry(argc, argv);
+  default:
+    break;
+  }
+  return EXIT_FAILURE;
+}
 } // namespace douka
 
 int main(int argc, char *argv[]) {
+  int rc = EXIT_FAILURE;
   try {
-    if (douka::show_help(argc, argv) || douka::show_version(argc, argv)) {
-      return EXIT_SUCCESS;
-    }
-    const auto id = douka::get_args(argc, argv);
-    switch (id) {
-    case douka::command::id::init:
-      return douka::command::init::entry(argc, argv);
-    case douka::command::id::predict:
-      return douka::command::predict::entry(argc, argv);
-    case douka::command::id::filter:
-      return douka::command::filter::entry(argc, argv);
-    case douka::command::id::obsgen:
-      return douka::command::obsgen::entry(argc, argv);
-    default:
-      break;
-    }
+    auto args = douka::strip_global_options(argc, argv);
+    rc = douka::run(static_cast<int>(args.size()), args.data());
   } catch (const std::exception &e) {
     std::clog << e.what() << std::endl;
+    rc = EXIT_FAILURE;
+  }
+  if (!douka::common::profile::write()) {
     return EXIT_FAILURE;
   }
-  return EXIT_FAILURE;
+  return rc;
 }
\ No newline at end of file
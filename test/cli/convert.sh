@@ -0,0 +1,76 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+cat <<EOF > $t/init.json
+{
+  "name": "valid",
+  "N": 3,
+  "seed": 1,
+  "k": 3,
+  "x0": [1.0, 2.0, 3.0],
+  "V0": [1.0, 2.0, 3.0]
+}
+EOF
+
+# json -> binary -> json
+$exe init --param $t/init.json --output $t/json > $t/log
+$exe convert --state $t/json/valid_%04d_000000_000000.json --output $t/binary >> $t/log
+test -f $t/binary/valid_000000_000000.bin
+$exe convert --state $t/binary/valid_000000_000000.bin --output $t/back >> $t/log
+for id in 0000 0001 0002; do
+  cmp $t/json/valid_${id}_000000_000000.json $t/back/valid_${id}_000000_000000.json
+done
+
+# init writes the same snapshot
+$exe init --param $t/init.json --output $t/init-binary --format binary >> $t/log
+cmp $t/binary/valid_000000_000000.bin $t/init-binary/valid_000000_000000.bin
+
+# filter gives the same analysis for both inputs
+cat <<EOF > $t/filter.json
+{
+  "name": "valid",
+  "N": 3,
+  "seed": 1,
+  "k": 3,
+  "l": 2,
+  "R": [1.0, 1.0]
+}
+EOF
+
+cat <<EOF > $t/obs.json
+{
+  "name": "valid",
+  "obs_tim": 1,
+  "y": [2.0, 3.0]
+}
+EOF
+
+mkdir -p $t/predicted
+for id in 0 1 2; do
+  cat <<EOF > $t/predicted/valid_000${id}_000001_000000.json
+{
+  "name": "valid",
+  "id": ${id},
+  "sys_tim": 1,
+  "obs_tim": 0,
+  "x": [1.${id}, 2.${id}, 3.${id}]
+}
+EOF
+done
+$exe convert --state $t/predicted/valid_%04d_000001_000000.json --output $t/predicted >> $t/log
+
+$exe filter --state $t/predicted/valid_%04d_000001_000000.json --param $t/filter.json \
+  --obs $t/obs.json --output $t/filtered-json >> $t/log
+$exe filter --state $t/predicted/valid_000001_000000.bin --param $t/filter.json \
+  --obs $t/obs.json --output $t/filtered-binary --format binary >> $t/log
+$exe convert --state $t/filtered-binary/valid_000001_000001.bin --output $t/filtered-binary >> $t/log
+for id in 0000 0001 0002; do
+  cmp $t/filtered-json/valid_${id}_000001_000001.json $t/filtered-binary/valid_${id}_000001_000001.json
+done
+
+# Unknown format
+! $exe convert --state $t/binary/valid_000000_000000.bin --format xml 2> /dev/null || false
@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+for id in 0 1 2 3 4 5 6 7; do
+  cat <<EOF > $t/valid_000${id}_000001_000000.json
+{
+  "name": "valid",
+  "id": ${id},
+  "sys_tim": 1,
+  "obs_tim": 0,
+  "x": [1.${id}, 2.0, 3.${id}, 4.0, 5.${id}]
+}
+EOF
+done
+
+cat <<EOF > $t/filter.json
+{
+  "name": "valid",
+  "N": 8,
+  "seed": 1,
+  "k": 5,
+  "l": 2,
+  "R": [1.0, 1.0],
+  "block_rows": 2
+}
+EOF
+
+cat <<EOF > $t/obs.json
+{
+  "name": "valid",
+  "obs_tim": 1,
+  "y": [2.0, 3.0]
+}
+EOF
+
+$exe convert --state $t/valid_%04d_000001_000000.json --output $t/init > $t/log
+
+# The rows are read from the input and written to the output block by block
+$exe filter --state $t/init/valid_000001_000000.bin --param $t/filter.json --obs $t/obs.json \
+  --output $t/binary --format binary >> $t/log
+test -f $t/binary/valid_000001_000001.bin
+$exe filter --state $t/init/valid_000001_000000.bin --param $t/filter.json --obs $t/obs.json \
+  --output $t/json >> $t/log
+test $(find $t/json -type f -name "valid_*.json" | wc -l) -eq 8
+
+# The state gain is not blocked
+sed -i 's/"block_rows": 2/"block_rows": 2, "gain": "state"/' $t/filter.json
+! $exe filter --state $t/init/valid_000001_000000.bin --param $t/filter.json --obs $t/obs.json \
+  --output $t/fail 2> $t/err || false
@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+for id in 0 1 2 3; do
+  cat <<EOF > $t/valid_000${id}_000001_000000.json
+{
+  "name": "valid",
+  "id": ${id},
+  "sys_tim": 1,
+  "obs_tim": 0,
+  "x": [1.${id}, 2.0, 3.${id}]
+}
+EOF
+done
+
+cat <<EOF > $t/filter.json
+{
+  "name": "valid",
+  "N": 4,
+  "seed": 1,
+  "k": 3,
+  "l": 3,
+  "blocks": [
+    {"l": 1, "R": [1.0], "H": [1, 0, 0]},
+    {"l": 2, "R": [1.0, 0.5, 0.5, 2.0], "H": [0, 1, 0, 0, 0.5, 0.5]}
+  ]
+}
+EOF
+
+cat <<EOF > $t/obs.json
+{
+  "name": "valid",
+  "obs_tim": 1,
+  "y": [1.0, 2.0, 3.0]
+}
+EOF
+
+# The blocks are assimilated at once, and one after another
+$exe filter --state $t/valid_%04d_000001_000000.json --param $t/filter.json --obs $t/obs.json \
+  --output $t/joint > $t/log
+test $(find $t/joint -type f -name "valid_*.json" | wc -l) -eq 4
+sed -i 's/"l": 3,/"l": 3, "serial": true,/' $t/filter.json
+$exe filter --state $t/valid_%04d_000001_000000.json --param $t/filter.json --obs $t/obs.json \
+  --output $t/serial >> $t/log
+test $(find $t/serial -type f -name "valid_*.json" | wc -l) -eq 4
+! diff -r $t/joint $t/serial > /dev/null || false
+
+# The blocks should cover the observations
+sed -i 's/"l": 1,/"l": 2,/' $t/filter.json
+! $exe filter --state $t/valid_%04d_000001_000000.json --param $t/filter.json \
+  --obs $t/obs.json --output $t/fail 2> $t/err || false
+grep -q "invalid size of R of block" $t/err
@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+store=shm:douka-test-$$
+trap "$exe store destroy --name $store 2> /dev/null || true" EXIT
+
+for id in 0 1 2 3 4 5 6 7; do
+  cat <<EOF > $t/valid_000${id}_000001_000000.json
+{
+  "name": "valid",
+  "id": ${id},
+  "sys_tim": 1,
+  "obs_tim": 0,
+  "x": [1.${id}, 2.0, 3.${id}, 4.0, 5.${id}]
+}
+EOF
+done
+
+cat <<EOF > $t/filter.json
+{
+  "name": "valid",
+  "N": 8,
+  "seed": 1,
+  "k": 5,
+  "l": 2,
+  "R": [1.0, 1.0],
+  "gain": "ensemble",
+  "block_rows": 2
+}
+EOF
+
+cat <<EOF > $t/obs.json
+{
+  "name": "valid",
+  "obs_tim": 1,
+  "y": [2.0, 3.0]
+}
+EOF
+
+$exe convert --state $t/valid_%04d_000001_000000.json --output $t/init > $t/log
+input=$t/init/valid_000001_000000.bin
+
+# The ranks launched on this node give the out-of-core analysis of a single process
+$exe filter --state $input --param $t/filter.json --obs $t/obs.json --output $t/single \
+  --format binary >> $t/log
+$exe filter --state $input --param $t/filter.json --obs $t/obs.json --output $t/ranks \
+  --format binary --ranks 3 >> $t/log
+cmp $t/single/valid_000001_000001.bin $t/ranks/valid_000001_000001.bin
+test -z "$(ls /dev/shm | grep douka.ranks.valid)"
+
+# A store is updated in place by the ranks
+$exe store create --name $store --state $input > /dev/null
+$exe filter --state $store --param $t/filter.json --obs $t/obs.json --output $store \
+  --ranks 2 >> $t/log
+$exe store persist --name $store --output $t/store > /dev/null
+cmp $t/single/valid_000001_000001.bin $t/store/valid_000001_000001.bin
+
+# The ranks are given one by one, e.g. by a job scheduler
+sed -i 's/"gain": "ensemble",/"H": [0, 1, 0, 0, 0, 0, 0, 0.5, 0.5, 0],/' $t/filter.json
+pids=()
+for rank in 0 1; do
+  $exe filter --state $input --param $t/filter.json --obs $t/obs.json --output $t/manual \
+    --format binary --ranks 2 --rank $rank >> $t/log &
+  pids+=($!)
+done
+for pid in ${pids[@]}; do
+  wait $pid
+done
+test -f $t/manual/valid_000001_000001.bin
+
+# The ranks share the mappings of the binary ensembles
+! $exe filter --state $input --param $t/filter.json --obs $t/obs.json --output $t/json \
+  --ranks 2 2> $t/err || false
+grep -q "requires a binary ensemble" $t/err
+! $exe filter --state $input --param $t/filter.json --obs $t/obs.json --output $t/fail \
+  --format binary --ranks 2 --rank 2 2> $t/err || false
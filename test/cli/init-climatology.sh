@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+if test "$#" -ne 1; then
+  echo "Plugin is not given"
+  exit 1;
+fi
+plugin=$1
+
+# A free run observed by the identity is the trajectory of the states
+cat <<EOF > $t/obsgen.json
+{
+  "name": "valid",
+  "seed": 10,
+  "k": 3,
+  "l": 3,
+  "t": 20,
+  "x0": [ 1.0, 3.0, 5.0 ]
+}
+EOF
+
+cat <<EOF > $t/init.json
+{
+  "name": "valid",
+  "N": 4,
+  "seed": 1,
+  "k": 3,
+  "trajectory": "$t/run/valid_obs.series"
+}
+EOF
+
+$exe obsgen --param $t/obsgen.json --plugin $plugin --output $t/run --format series > $t/log
+$exe init --param $t/init.json --output $t/output >> $t/log
+test $(find $t/output -type f -name "valid_*.json" | wc -l) -eq 4
+$exe init --param $t/init.json --output $t/binary --format binary >> $t/log
+$exe convert --state $t/binary/valid_000000_000000.bin --output $t/converted --format json \
+  >> $t/log
+diff -r $t/output $t/converted
+
+# Longer than the trajectory
+sed -i 's/"N": 4/"N": 100/' $t/init.json
+! $exe init --param $t/init.json --output $t/fail 2> $t/err || false
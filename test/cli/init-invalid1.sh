@@ -16,3 +16,19 @@ cat <<EOF > $t/input1.json
 EOF
 
 ! $exe init --param $t/invalid1.json --output $t/output 2> /dev/null || false
+
+# A failed initialization leaves no binary ensemble
+cat <<EOF > $t/input2.json
+{
+  "name": "invalid",
+  "N": 3,
+  "seed": 1,
+  "k": 2,
+  "x0": [1.0, 2.0],
+  "V0": [1.0, 2.0, 2.0, 1.0]
+}
+EOF
+
+! $exe init --param $t/input2.json --output $t/binary --format binary 2> $t/err || false
+grep -q "not positive definite" $t/err
+test ! -e $t/binary/invalid_000000_000000.bin
@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+cat <<EOF > $t/input1.json
+{
+  "name": "valid",
+  "N": 200,
+  "seed": 1,
+  "k": 3,
+  "x0": [1.0, 2.0, 3.0],
+  "V0": [2.0, 0.5, 0.0,
+         0.5, 1.0, 0.0,
+         0.0, 0.0, 3.0]
+}
+EOF
+
+# The members do not depend on the number of threads
+$exe --threads 1 init --param $t/input1.json --output $t/serial > $t/log
+$exe --threads 4 init --param $t/input1.json --output $t/parallel >> $t/log
+diff -r $t/serial $t/parallel
+
+# The binary ensemble is drawn into its mapping, the same members as the files
+$exe --threads 4 init --param $t/input1.json --output $t/binary --format binary >> $t/log
+$exe convert --state $t/binary/valid_000000_000000.bin --output $t/converted --format json \
+  >> $t/log
+diff -r $t/serial $t/converted
@@ -0,0 +1,66 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+cat <<EOF > $t/init.json
+{
+  "name": "valid",
+  "N": 16,
+  "seed": 1,
+  "k": 3,
+  "x0": [1.0, 2.0, 3.0],
+  "V0": [1.0, 2.0, 3.0]
+}
+EOF
+
+cat <<EOF > $t/filter.json
+{
+  "name": "valid",
+  "N": 16,
+  "seed": 1,
+  "k": 3,
+  "l": 2
+}
+EOF
+
+cat <<EOF > $t/obs.json
+{
+  "name": "valid",
+  "obs_tim": 1,
+  "y": [2.0, 3.0]
+}
+EOF
+
+# The outputs do not depend on the number of I/O threads
+for threads in 1 4; do
+  $exe --io-threads $threads init --param $t/init.json --output $t/init$threads > $t/log
+  # Advance the simulation time as predict would do
+  mkdir -p $t/state$threads
+  for f in $t/init$threads/*.json; do
+    sed 's/"sys_tim":0/"sys_tim":1/' $f > $t/state$threads/$(basename $f | sed 's/_000000_000000/_000001_000000/')
+  done
+  $exe --io-threads $threads filter \
+    --state $t/state$threads/valid_%04d_000001_000000.json \
+    --param $t/filter.json \
+    --obs $t/obs.json \
+    --output $t/filter$threads > $t/log
+  $exe --io-threads $threads convert --state $t/filter$threads/valid_%04d_000001_000001.json \
+    --output $t/binary$threads > $t/log
+done
+test $(find $t/filter4 -type f -name "valid_*.json" | wc -l) -eq 16
+diff -r $t/init1 $t/init4
+diff -r $t/filter1 $t/filter4
+diff -r $t/binary1 $t/binary4
+
+# A missing member fails the read
+rm $t/state4/valid_0007_000001_000000.json
+! $exe --io-threads 4 filter \
+  --state $t/state4/valid_%04d_000001_000000.json \
+  --param $t/filter.json \
+  --obs $t/obs.json \
+  --output $t/fail 2> $t/err || false
+
+! $exe --io-threads 0 init --param $t/init.json --output $t/init0 2> /dev/null || false
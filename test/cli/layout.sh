@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+cat <<EOF > $t/init.json
+{
+  "name": "valid",
+  "N": 2100,
+  "seed": 1,
+  "k": 1,
+  "x0": [1.0],
+  "V0": [1.0]
+}
+EOF
+
+# Sharded by 1000 members in the directory of the time step
+$exe --layout sharded --id-width 5 init --param $t/init.json --output $t/sharded > $t/log
+test $(find $t/sharded/000000 -mindepth 1 -maxdepth 1 -type d | wc -l) -eq 3
+test $(find $t/sharded/000000/2 -type f -name "valid_*.json" | wc -l) -eq 100
+test -f $t/sharded/000000/2/valid_02099_000000_000000.json
+
+# Read back through the shards
+$exe --layout sharded --id-width 5 convert \
+  --state $t/sharded/000000/valid_%05d_000000_000000.json --output $t/binary > $t/log
+test -f $t/binary/valid_000000_000000.bin
+
+# Flat layout with the same width
+$exe --id-width 5 convert --state $t/binary/valid_000000_000000.bin --output $t/flat > $t/log
+test $(find $t/flat -type f -name "valid_?????_000000_000000.json" | wc -l) -eq 2100
+diff $t/flat/valid_01234_000000_000000.json $t/sharded/000000/1/valid_01234_000000_000000.json
+
+! $exe --layout tree init --param $t/init.json --output $t/tree 2> /dev/null || false
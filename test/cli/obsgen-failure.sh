@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+if test "$#" -ne 1; then
+  echo "Plugin is not given"
+  exit 1;
+fi
+plugin=$1
+
+cat <<EOF > $t/obsgen.json
+{
+  "name": "valid",
+  "seed": 10,
+  "k": 3,
+  "l": 3,
+  "t": 5,
+  "x0": [ 1.0, 3.0, 5.0 ]
+}
+EOF
+
+# The plugin fails partway, no shorter series is left behind
+! $exe obsgen --param $t/obsgen.json --plugin $plugin --output $t/series --format series \
+  2> $t/err || false
+test ! -e $t/series/valid_obs.series
+test $(find $t/series -type f | wc -l) -eq 0
@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+if test "$#" -ne 1; then
+  echo "Plugin is not given"
+  exit 1;
+fi
+plugin=$1
+
+cat <<EOF > $t/obsgen.json
+{
+  "name": "valid",
+  "seed": 10,
+  "k": 3,
+  "l": 3,
+  "t": 5,
+  "x0": [ 1.0, 3.0, 5.0 ]
+}
+EOF
+
+cat <<EOF > $t/filter.json
+{
+  "name": "valid",
+  "N": 3,
+  "seed": 1,
+  "k": 3,
+  "l": 3
+}
+EOF
+
+for id in 0 1 2; do
+  cat <<EOF > $t/valid_000${id}_000001_000000.json
+{
+  "name": "valid",
+  "id": ${id},
+  "sys_tim": 1,
+  "obs_tim": 0,
+  "x": [${id}.0, 2.0, 4.0]
+}
+EOF
+done
+
+$exe obsgen --param $t/obsgen.json --plugin $plugin --output $t/json > $t/log
+$exe obsgen --param $t/obsgen.json --plugin $plugin --output $t/series --format series >> $t/log
+test $(find $t/series -type f | wc -l) -eq 1
+test -f $t/series/valid_obs.series
+
+# The record of the series is the same observation as its json file
+$exe filter --state $t/valid_%04d_000001_000000.json --param $t/filter.json \
+  --obs $t/json/valid_obs_000001.json --output $t/from-json >> $t/log
+$exe filter --state $t/valid_%04d_000001_000000.json --param $t/filter.json \
+  --obs series:$t/series/valid_obs.series@1 --output $t/from-series >> $t/log
+diff -r $t/from-json $t/from-series
+
+! $exe filter --state $t/valid_%04d_000001_000000.json --param $t/filter.json \
+  --obs series:$t/series/valid_obs.series@9 --output $t/fail 2> $t/err || false
+! $exe obsgen --param $t/obsgen.json --plugin $plugin --output $t/series --format series \
+  2> $t/err || false
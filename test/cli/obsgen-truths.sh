@@ -0,0 +1,63 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+if test "$#" -ne 2; then
+  echo "Concurrent and non-concurrent plugins are not given"
+  exit 1;
+fi
+plugin=$1
+serial_plugin=$2
+
+cat <<EOF > $t/truths.json
+{
+  "name": "valid",
+  "seed": 10,
+  "k": 3,
+  "l": 3,
+  "t": 4,
+  "x0": [
+    [ 1.0, 3.0, 5.0 ],
+    [ 2.0, 4.0, 6.0 ],
+    [ 3.0, 5.0, 7.0 ]
+  ]
+}
+EOF
+
+cat <<EOF > $t/truth1.json
+{
+  "name": "valid",
+  "seed": 10,
+  "k": 3,
+  "l": 3,
+  "t": 4,
+  "x0": [ 2.0, 4.0, 6.0 ]
+}
+EOF
+
+# Each truth is written to its own directory, the same as a single truth of its x0
+for threads in 1 2; do
+  $exe --threads $threads obsgen --param $t/truths.json --plugin $plugin --output $t/truths$threads \
+    > $t/log
+  for truth in 0 1 2; do
+    test $(find $t/truths$threads/truth_000$truth -type f -name "valid_obs_*.json" | wc -l) -eq 5
+  done
+done
+diff -r $t/truths1 $t/truths2
+$exe obsgen --param $t/truth1.json --plugin $plugin --output $t/truth1 >> $t/log
+diff -r $t/truths2/truth_0001 $t/truth1
+
+# A non-concurrent plugin runs the truths one after another on a single instance
+$exe --threads 2 obsgen --param $t/truths.json --plugin $serial_plugin --output $t/serial >> $t/log
+diff -r $t/truths1 $t/serial
+
+$exe --threads 2 obsgen --param $t/truths.json --plugin $plugin --output $t/series --format series \
+  >> $t/log
+test -f $t/series/truth_0002/valid_obs.series
+
+# All truths should have the size of the state
+sed 's/\[ 3.0, 5.0, 7.0 \]/[ 3.0, 5.0 ]/' $t/truths.json > $t/invalid.json
+! $exe obsgen --param $t/invalid.json --plugin $plugin --output $t/invalid 2> $t/err || false
@@ -0,0 +1,119 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+$exe obsprep --help > $t/log
+
+cat <<EOF > $t/filter.json
+{
+  "name": "valid",
+  "N": 3,
+  "seed": 1,
+  "k": 4,
+  "l": 4,
+  "R": [1.0, 1.0, 1.0, 1.0]
+}
+EOF
+
+cat <<EOF > $t/obsprep.json
+{
+  "coords": [0.2, 0.7, 1.5, 2.5],
+  "gross_error": 3.0,
+  "superob": [1.0]
+}
+EOF
+
+cat <<EOF > $t/obs.json
+{
+  "name": "valid",
+  "obs_tim": 1,
+  "y": [1.1, 1.3, 2.1, 100.0]
+}
+EOF
+
+mkdir -p $t/predicted
+for id in 0 1 2; do
+  cat <<EOF > $t/predicted/valid_000${id}_000001_000000.json
+{
+  "name": "valid",
+  "id": ${id},
+  "sys_tim": 1,
+  "obs_tim": 0,
+  "x": [1.${id}, 1.${id}, 2.${id}, 3.${id}]
+}
+EOF
+done
+
+# The observation 3 fails the gross error check, the observations 0 and 1 are super-obbed
+$exe obsprep --param $t/filter.json $t/obsprep.json --obs $t/obs.json \
+  --state $t/predicted/valid_%04d_000001_000000.json --output $t/obsprep >> $t/log
+grep -q "4 -> 2 observations, 1 rejected, 0 thinned" $t/log
+test -f $t/obsprep/valid_obs_000001.json
+test -f $t/obsprep/valid_obsprep_000001.json
+grep -q '"l": 2' $t/obsprep/valid_obsprep_000001.json
+# The identity H is averaged into a sparse H instead of a dense one
+grep -q '"H_sparse"' $t/obsprep/valid_obsprep_000001.json
+! grep -q '"H":' $t/obsprep/valid_obsprep_000001.json || false
+
+# The reduced observations and their l, R and H override the filter parameters
+$exe filter --state $t/predicted/valid_%04d_000001_000000.json \
+  --param $t/filter.json $t/obsprep/valid_obsprep_000001.json \
+  --obs $t/obsprep/valid_obs_000001.json --output $t/filtered >> $t/log
+for id in 0000 0001 0002; do
+  test -f $t/filtered/valid_${id}_000001_000001.json
+done
+
+# The filter reads H_sparse, a column out of the state is rejected
+cat <<EOF > $t/sparse.json
+{
+  "l": 2,
+  "R": [1.0, 1.0],
+  "H_sparse": { "begin": [0, 1, 2], "index": [0, 9], "value": [1.0, 1.0] }
+}
+EOF
+! $exe filter --state $t/predicted/valid_%04d_000001_000000.json --param $t/filter.json $t/sparse.json \
+  --obs $t/obsprep/valid_obs_000001.json --output $t/sparse 2> $t/err || false
+grep -q "index should be 0 to 3" $t/err
+
+# The blocks of the filter parameters are merged, the reduced observations replace them
+cat <<EOF > $t/blocks.json
+{
+  "name": "valid",
+  "N": 3,
+  "seed": 1,
+  "k": 4,
+  "l": 4,
+  "blocks": [
+    {"l": 2, "R": [1.0, 0.5, 0.5, 1.0]},
+    {"l": 2, "R": [1.0, 1.0]}
+  ]
+}
+EOF
+$exe obsprep --param $t/blocks.json $t/obsprep.json --obs $t/obs.json \
+  --state $t/predicted/valid_%04d_000001_000000.json --output $t/blocks >> $t/log
+$exe filter --state $t/predicted/valid_%04d_000001_000000.json \
+  --param $t/blocks.json $t/blocks/valid_obsprep_000001.json \
+  --obs $t/blocks/valid_obs_000001.json --output $t/blocks_filtered >> $t/log
+test -f $t/blocks_filtered/valid_0002_000001_000001.json
+
+# Thinning keeps the observation 1 nearest to the center of [0, 1)
+cat <<EOF > $t/thin.json
+{
+  "coords": [0.2, 0.6, 1.5, 2.5],
+  "thin": [1.0]
+}
+EOF
+$exe obsprep --param $t/filter.json $t/thin.json --obs $t/obs.json --output $t/thin > $t/thin.log
+grep -q "4 -> 3 observations, 0 rejected, 1 thinned" $t/thin.log
+
+# The gross error check requires the states
+! $exe obsprep --param $t/filter.json $t/obsprep.json --obs $t/obs.json \
+  --output $t/invalid 2> $t/err || false
+grep -q "required option '--state' not given" $t/err
+
+# Existing outputs are kept without --force
+! $exe obsprep --param $t/filter.json $t/thin.json --obs $t/obs.json --output $t/thin \
+  2> /dev/null || false
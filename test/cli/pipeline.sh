@@ -0,0 +1,89 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+if test "$#" -ne 1; then
+  echo "Plugin is not given"
+  exit 1;
+fi
+plugin=$1
+set -o pipefail
+
+cat <<EOF > $t/init.json
+{
+  "name": "valid",
+  "N": 8,
+  "seed": 1,
+  "k": 3,
+  "x0": [1.0, 2.0, 3.0],
+  "V0": [1.0, 2.0, 3.0]
+}
+EOF
+
+cat <<EOF > $t/predict.json
+{
+  "name": "valid",
+  "seed": 1,
+  "k": 3,
+  "Q": [1.0, 1.0, 1.0]
+}
+EOF
+
+cat <<EOF > $t/filter.json
+{
+  "name": "valid",
+  "N": 8,
+  "seed": 1,
+  "k": 3,
+  "l": 2
+}
+EOF
+
+cat <<EOF > $t/obs.json
+{
+  "name": "valid",
+  "obs_tim": 1,
+  "y": [2.0, 3.0]
+}
+EOF
+
+for id in 0 1 2 3 4 5 6 7; do
+  cat <<EOF > $t/valid_000${id}_000000_000000.json
+{
+  "name": "valid",
+  "id": ${id},
+  "sys_tim": 0,
+  "obs_tim": 0,
+  "x": [1.0, 2.0, 3.0]
+}
+EOF
+done
+
+# The same cycle through the files and through the pipes
+$exe convert --state $t/valid_%04d_000000_000000.json --output $t/binary > $t/log
+$exe predict --state $t/binary/valid_000000_000000.bin --param $t/predict.json \
+  --plugin $plugin --output $t/predict --format binary >> $t/log
+$exe filter --state $t/predict/valid_000001_000000.bin --param $t/filter.json \
+  --obs $t/obs.json --output $t/files >> $t/log
+
+for format in json binary; do
+  $exe convert --state $t/valid_%04d_000000_000000.json --output - --format $format |
+    $exe predict --state - --param $t/predict.json --plugin $plugin --output - --format $format |
+    $exe filter --state - --param $t/filter.json --obs $t/obs.json --output $t/pipe$format \
+      >> $t/log
+  diff -r $t/files $t/pipe$format
+done
+
+# One compact state per line, the same members as the files
+$exe init --param $t/init.json --output $t/init >> $t/log
+$exe init --param $t/init.json --output - > $t/states.ndjson
+test $(wc -l < $t/states.ndjson) -eq 8
+$exe convert --state - --output $t/stdin --format json < $t/states.ndjson >> $t/log
+diff -r $t/init $t/stdin
+
+# A broken line fails the read
+head -c 20 $t/states.ndjson > $t/broken.ndjson
+! $exe convert --state - --output $t/fail < $t/broken.ndjson 2> $t/err || false
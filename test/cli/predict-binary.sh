@@ -0,0 +1,52 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+if test "$#" -ne 1; then
+  echo "Plugin is not given"
+  exit 1;
+fi
+
+cat <<EOF > $t/param1.json
+{
+  "name": "valid",
+  "seed": 1,
+  "k": 3,
+  "Q": [1.0, 1.0, 1.0]
+}
+EOF
+
+for id in 0 1 2; do
+  cat <<EOF > $t/valid_000${id}_000000_000000.json
+{
+  "name": "valid",
+  "id": ${id},
+  "sys_tim": 0,
+  "obs_tim": 0,
+  "x": [1.0, 2.0, 3.0]
+}
+EOF
+done
+$exe convert --state $t/valid_%04d_000000_000000.json --output $t/binary > $t/log
+
+plugin=$1
+
+# All members of the snapshot are predicted
+$exe predict \
+  --state $t/binary/valid_000000_000000.bin \
+  --param $t/param1.json \
+  --plugin $plugin \
+  --output $t/output \
+  --format binary \
+  >> $t/log
+test -f $t/output/valid_000001_000000.bin
+
+$exe convert --state $t/output/valid_000001_000000.bin --output $t/output >> $t/log
+file_num=$(find $t/output -type f -name "valid_*_000001_000000.json" | wc -l)
+if test $file_num -ne 3; then
+  echo "invalid number of file crated"
+  exit 1
+fi
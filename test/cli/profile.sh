@@ -0,0 +1,28 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+cat <<EOF > $t/input1.json
+{
+  "name": "valid",
+  "N": 4,
+  "seed": 1,
+  "k": 3,
+  "x0": [1.0, 2.0, 3.0],
+  "V0": [1.0, 2.0, 3.0]
+}
+EOF
+
+$exe --profile $t/trace.json init --param $t/input1.json --output $t/output > $t/log
+
+test -f $t/trace.json
+for phase in init parse_filename read_json json_to_object validate compute write_json; do
+  grep -q "\"name\": \"$phase\"" $t/trace.json
+done
+
+# Trace should be written even if the command failed
+! $exe init --param $t/not_exist.json --output $t/output --profile $t/trace-fail.json 2> /dev/null || false
+test -f $t/trace-fail.json
@@ -0,0 +1,76 @@
+#!/usr/bin/env bash
+
+# Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+# SPDX-License-Identifier: Apache-2.0
+
+. $(dirname $0)/inc/common.sh
+
+if test "$#" -ne 1; then
+  echo "Plugin is not given"
+  exit 1;
+fi
+plugin=$1
+store=shm:douka-test-$$
+trap "$exe store destroy --name $store 2> /dev/null || true" EXIT
+
+cat <<EOF > $t/predict.json
+{
+  "name": "valid",
+  "seed": 1,
+  "k": 3,
+  "Q": [1.0, 1.0, 1.0]
+}
+EOF
+
+cat <<EOF > $t/filter.json
+{
+  "name": "valid",
+  "N": 4,
+  "seed": 1,
+  "k": 3,
+  "l": 2
+}
+EOF
+
+cat <<EOF > $t/obs.json
+{
+  "name": "valid",
+  "obs_tim": 1,
+  "y": [2.0, 3.0]
+}
+EOF
+
+for id in 0 1 2 3; do
+  cat <<EOF > $t/valid_000${id}_000000_000000.json
+{
+  "name": "valid",
+  "id": ${id},
+  "sys_tim": 0,
+  "obs_tim": 0,
+  "x": [1.0, 2.0, 3.0]
+}
+EOF
+done
+
+# Reference cycle through the files
+$exe convert --state $t/valid_%04d_000000_000000.json --output $t/binary > $t/log
+$exe predict --state $t/binary/valid_000000_000000.bin --param $t/predict.json \
+  --plugin $plugin --output $t/predict --format binary >> $t/log
+$exe filter --state $t/predict/valid_000001_000000.bin --param $t/filter.json \
+  --obs $t/obs.json --output $t/files >> $t/log
+
+# The same cycle through the store, the filter updates it in place
+$exe store create --name $store --state $t/valid_%04d_000000_000000.json >> $t/log
+! $exe store create --name $store --state $t/valid_%04d_000000_000000.json 2> $t/err || false
+$exe predict --state $store --param $t/predict.json --plugin $plugin --output $store >> $t/log
+$exe filter --state $store --param $t/filter.json --obs $t/obs.json --output $store >> $t/log
+$exe store attach --name $store > $t/attach
+grep -q "obs_tim  1" $t/attach
+$exe store persist --name $store --output $t/persist --format json >> $t/log
+diff -r $t/files $t/persist
+$exe store persist --name $store --output $t/persist >> $t/log
+test -f $t/persist/valid_000001_000001.bin
+
+$exe store destroy --name $store
+! $exe store attach --name $store 2> $t/err || false
+! $exe store create --name shm:a/b --state $t/binary/valid_000000_000000.bin 2> $t/err || false
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <command/convert.hh>
+#include <gtest/gtest.h>
+
+namespace convert = douka::command::convert;
+
+TEST(command_convert, show_help) {
+  const char *argv[] = {"douka", "convert", "--help"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  convert::Args args;
+  ASSERT_THROW(args = convert::get_args(argc, argv), std::invalid_argument);
+}
+
+TEST(command_convert, missing_requirements1) {
+  const char *argv[] = {"douka", "convert", "--output", "out"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  convert::Args args;
+  ASSERT_THROW(args = convert::get_args(argc, argv), std::invalid_argument);
+}
+
+TEST(command_convert, invalid_format) {
+  const char *argv[] = {"douka", "convert", "--state", "state1", "--format", "xml"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  convert::Args args;
+  ASSERT_THROW(args = convert::get_args(argc, argv), std::invalid_argument);
+}
+
+TEST(command_convert, ok1) {
+  const char *argv[] = {"douka",    "convert", "--state",  "state1", "--output",
+                        "out",      "--format", "binary",  "--force"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  convert::Args args;
+  ASSERT_NO_THROW(args = convert::get_args(argc, argv));
+
+  ASSERT_EQ(args.state, "state1");
+  ASSERT_EQ(args.output, "out");
+  ASSERT_EQ(args.format, "binary");
+  ASSERT_TRUE(args.force);
+}
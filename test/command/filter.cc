@@ -37,4 +37,22 @@ TEST(command_filter, ok1) {
   ASSERT_EQ(args.filter, "enkf");
   ASSERT_EQ(args.output, "out");
   ASSERT_TRUE(args.force);
-}
\ No newline at end of file
+}
+TEST(command_filter, ranks) {
+  const char *argv[] = {"douka", "filter",  "--state", "state1", "--param", "param1",
+                        "--obs", "obs1",    "--ranks", "4",      "--rank",  "3"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  filter::Args args;
+  ASSERT_NO_THROW(args = filter::get_args(argc, argv));
+  ASSERT_EQ(args.ranks, 4);
+  ASSERT_EQ(args.rank, 3);
+
+  // The rank should be less than the ranks
+  argv[9] = "3";
+  ASSERT_THROW(args = filter::get_args(argc, argv), std::invalid_argument);
+  argv[9] = "0";
+  ASSERT_THROW(args = filter::get_args(argc, argv), std::invalid_argument);
+  argv[9] = "4";
+  argv[11] = "-1";
+  ASSERT_THROW(args = filter::get_args(argc, argv), std::invalid_argument);
+}
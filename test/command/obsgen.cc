@@ -38,4 +38,11 @@ TEST(command_obsgen, ok1) {
   ASSERT_EQ(args.plugin_param, "plugin_param1");
   ASSERT_EQ(args.output, "out");
   ASSERT_TRUE(args.force);
-}
\ No newline at end of file
+}
+TEST(command_obsgen, invalid_format) {
+  const char *argv[] = {"douka", "obsgen", "--param", "param1", "--plugin", "plugin1", "--format",
+                        "binary"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  obsgen::Args args;
+  ASSERT_THROW(args = obsgen::get_args(argc, argv), std::invalid_argument);
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <command/obsprep.hh>
+#include <gtest/gtest.h>
+
+namespace obsprep = douka::command::obsprep;
+
+TEST(command_obsprep, show_help) {
+  const char *argv[] = {"douka", "obsprep", "--help"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  obsprep::Args args;
+  ASSERT_THROW(args = obsprep::get_args(argc, argv), std::invalid_argument);
+}
+
+TEST(command_obsprep, missing_requirements1) {
+  const char *argv[] = {"douka", "obsprep", "--param", "param1"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  obsprep::Args args;
+  ASSERT_THROW(args = obsprep::get_args(argc, argv), std::invalid_argument);
+}
+
+TEST(command_obsprep, missing_requirements2) {
+  const char *argv[] = {"douka", "obsprep", "--obs", "obs1"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  obsprep::Args args;
+  ASSERT_THROW(args = obsprep::get_args(argc, argv), std::invalid_argument);
+}
+
+TEST(command_obsprep, ok1) {
+  const char *argv[] = {"douka", "obsprep", "--param",  "param1", "param2", "--obs", "obs1",
+                        "--state", "state1", "--output", "out",    "--force"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  obsprep::Args args;
+  ASSERT_NO_THROW(args = obsprep::get_args(argc, argv));
+
+  ASSERT_EQ(args.param, (std::vector<std::string>{"param1", "param2"}));
+  ASSERT_EQ(args.obs, "obs1");
+  ASSERT_EQ(args.state, "state1");
+  ASSERT_EQ(args.output, "out");
+  ASSERT_TRUE(args.force);
+}
+
+TEST(command_obsprep, validate) {
+  obsprep::Param param{"test", 3, 2, {1.0, 1.0}};
+  ASSERT_TRUE(param.validate());
+
+  param.thin = {1.0};
+  ASSERT_FALSE(param.validate()); // no coords
+  param.coords = {0.0, 1.0};
+  ASSERT_TRUE(param.validate());
+  param.superob = {1.0, 1.0};
+  ASSERT_FALSE(param.validate()); // of different dimensions
+  param.superob = {0.0};
+  ASSERT_FALSE(param.validate());
+  param.superob = {2.0};
+  ASSERT_TRUE(param.validate());
+
+  param.gross_error = -1.0;
+  ASSERT_FALSE(param.validate());
+  param.gross_error = 3.0;
+  param.R = {1.0, 1.0, 1.0};
+  ASSERT_FALSE(param.validate());
+}
+
+TEST(command_obsprep, check_gross_error) {
+  // Members of mean 0 and variance 1 at both observations
+  Eigen::MatrixXd HX(2, 3);
+  HX << -1.0, 0.0, 1.0, //
+      -1.0, 0.0, 1.0;
+  const Eigen::Vector2d R_diag{3.0, 3.0};
+  // |y - mean| against 2 x sqrt(3 + 1)
+  ASSERT_EQ(obsprep::check_gross_error(Eigen::Vector2d{3.9, -4.1}, HX, R_diag, 2.0),
+            (std::vector<int64_t>{0}));
+  ASSERT_EQ(obsprep::check_gross_error(Eigen::Vector2d{-4.0, 0.0}, HX, R_diag, 2.0),
+            (std::vector<int64_t>{0, 1}));
+}
+
+TEST(command_obsprep, thin) {
+  Eigen::MatrixXd coords(6, 1);
+  coords << 0.1, 0.45, 0.7, 1.2, 1.9, 3.5;
+  // The observation 0 is rejected, the nearest to the center of each cell is kept
+  ASSERT_EQ(obsprep::thin(coords, {1, 2, 3, 4, 5}, {1.0}), (std::vector<int64_t>{1, 3, 5}));
+  ASSERT_EQ(obsprep::thin(coords, {0, 2, 4}, {1.0}), (std::vector<int64_t>{2, 4}));
+  ASSERT_EQ(obsprep::thin(coords, {0, 2, 4}, {}), (std::vector<int64_t>{0, 2, 4}));
+
+  // Cells of negative coordinates in 2 dimensions
+  Eigen::MatrixXd coords2(3, 2);
+  coords2 << -0.5, -0.5, //
+      -0.1, -0.9,        //
+      0.5, -0.5;
+  ASSERT_EQ(obsprep::thin(coords2, {0, 1, 2}, {1.0, 1.0}), (std::vector<int64_t>{0, 2}));
+}
+
+TEST(command_obsprep, superob) {
+  Eigen::MatrixXd coords(5, 1);
+  coords << 0.1, 1.2, 0.4, 1.9, 3.0;
+  const auto groups = obsprep::superob(coords, {0, 1, 2, 3, 4}, {1.0});
+  ASSERT_EQ(groups.size(), 3);
+  ASSERT_EQ(groups.begin, (std::vector<int64_t>{0, 2, 4, 5}));
+  ASSERT_EQ(groups.index, (std::vector<int64_t>{0, 2, 1, 3, 4}));
+
+  const auto singles = obsprep::superob(coords, {1, 4}, {});
+  ASSERT_EQ(singles.size(), 2);
+  ASSERT_EQ(singles.begin, (std::vector<int64_t>{0, 1, 2}));
+  ASSERT_EQ(singles.index, (std::vector<int64_t>{1, 4}));
+}
+
+TEST(command_obsprep, obsprep) {
+  const int64_t k = 5, l = 4;
+  obsprep::Param param{"test", k, l, {1.0, 2.0, 3.0, 4.0}};
+  param.coords = {0.25, 0.75, 1.5, 2.5};
+  param.superob = {1.0};
+  const douka::io::Obs obs{"test", 1, {1.0, 2.0, 3.0, 4.0}};
+
+  obsprep::Result diagonal;
+  ASSERT_TRUE(obsprep::obsprep(param, obs, nullptr, diagonal));
+  ASSERT_EQ(diagonal.obs.y, (std::vector<double>{1.5, 3.0, 4.0}));
+  ASSERT_EQ(diagonal.R, (std::vector<double>{0.75, 3.0, 4.0}));
+  ASSERT_EQ(diagonal.coords, (std::vector<double>{0.5, 1.5, 2.5}));
+  // The identity H is not formed, the groups give the sparse H' = A [I 0]
+  ASSERT_TRUE(diagonal.H.empty());
+  ASSERT_EQ(diagonal.groups.begin, (std::vector<int64_t>{0, 2, 3, 4}));
+  ASSERT_EQ(diagonal.groups.index, (std::vector<int64_t>{0, 1, 2, 3}));
+  const auto reduced = obsprep::reduced_param(diagonal, false);
+  ASSERT_FALSE(reduced.contains("H"));
+  ASSERT_FALSE(reduced.contains("blocks"));
+  ASSERT_EQ(reduced["H_sparse"]["value"], (std::vector<double>{0.5, 0.5, 1.0, 1.0}));
+
+  // R' = A R A^T of a full R and H' = A H of an explicit H
+  using RowMajorMatrixXd = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+  RowMajorMatrixXd R(l, l), H = RowMajorMatrixXd::Random(l, k), A(3, l);
+  R << 2.0, 0.5, 0.1, 0.0, //
+      0.5, 3.0, 0.2, 0.1,  //
+      0.1, 0.2, 1.0, 0.3,  //
+      0.0, 0.1, 0.3, 4.0;
+  A << 0.5, 0.5, 0.0, 0.0, //
+      0.0, 0.0, 1.0, 0.0,  //
+      0.0, 0.0, 0.0, 1.0;
+  param.R.assign(R.data(), R.data() + R.size());
+  param.H.assign(H.data(), H.data() + H.size());
+  obsprep::Result full;
+  ASSERT_TRUE(obsprep::obsprep(param, obs, nullptr, full));
+  ASSERT_EQ(full.obs.y, diagonal.obs.y);
+  const RowMajorMatrixXd R_expected = A * R * A.transpose();
+  const RowMajorMatrixXd H_expected = A * H;
+  ASSERT_TRUE(Eigen::Map<const RowMajorMatrixXd>(full.R.data(), 3, 3).isApprox(R_expected));
+  ASSERT_TRUE(Eigen::Map<const RowMajorMatrixXd>(full.H.data(), 3, k).isApprox(H_expected));
+  ASSERT_FALSE(obsprep::reduced_param(full, true).contains("H_sparse"));
+  ASSERT_TRUE(obsprep::reduced_param(full, true)["blocks"].is_null());
+}
+
+TEST(command_obsprep, merge_blocks) {
+  nlohmann::json param = {{"l", 3},
+                          {"blocks",
+                           {{{"l", 1}, {"R", {2.0}}, {"H", {1.0, 0.0}}},
+                            {{"l", 2}, {"R", {1.0, 0.5, 0.5, 3.0}}, {"H", {0.0, 1.0, 1.0, 1.0}}}}}};
+  ASSERT_TRUE(obsprep::merge_blocks(param));
+  ASSERT_FALSE(param.contains("blocks"));
+  ASSERT_EQ(param["R"], (std::vector<double>{2.0, 0.0, 0.0, //
+                                             0.0, 1.0, 0.5, //
+                                             0.0, 0.5, 3.0}));
+  ASSERT_EQ(param["H"], (std::vector<double>{1.0, 0.0, 0.0, 1.0, 1.0, 1.0}));
+
+  // Diagonal blocks without H
+  nlohmann::json diagonal = {{"blocks", {{{"l", 1}, {"R", {2.0}}}, {{"l", 2}, {"R", {1.0, 3.0}}}}}};
+  ASSERT_TRUE(obsprep::merge_blocks(diagonal));
+  ASSERT_EQ(diagonal["R"], (std::vector<double>{2.0, 1.0, 3.0}));
+  ASSERT_FALSE(diagonal.contains("H"));
+
+  nlohmann::json mixed = {{"blocks", {{{"l", 1}, {"H", {1.0}}}, {{"l", 1}}}}};
+  ASSERT_FALSE(obsprep::merge_blocks(mixed));
+  nlohmann::json both = {{"R", {1.0}}, {"blocks", {{{"l", 1}}}}};
+  ASSERT_FALSE(obsprep::merge_blocks(both));
+}
+
+TEST(command_obsprep, obsprep_gross_error) {
+  obsprep::Param param{"test", 3, 3, {1.0, 1.0, 1.0}};
+  param.gross_error = 3.0;
+  const douka::io::Obs obs{"test", 1, {0.5, 10.0, -0.5}};
+  const Eigen::MatrixXd X = Eigen::MatrixXd::Zero(3, 4);
+
+  obsprep::Result result;
+  ASSERT_FALSE(obsprep::obsprep(param, obs, nullptr, result));
+  ASSERT_TRUE(obsprep::obsprep(param, obs, &X, result));
+  ASSERT_EQ(result.rejected, 1);
+  ASSERT_EQ(result.obs.y, (std::vector<double>{0.5, -0.5}));
+  ASSERT_EQ(result.groups.index, (std::vector<int64_t>{0, 2}));
+
+  // Nothing is left
+  param.gross_error = 0.1;
+  ASSERT_FALSE(obsprep::obsprep(param, obs, &X, result));
+}
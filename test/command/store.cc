@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <command/store.hh>
+#include <gtest/gtest.h>
+
+namespace store = douka::command::store;
+
+TEST(command_store, missing_action) {
+  const char *argv[] = {"douka", "store", "--name", "exp"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  store::Args args;
+  ASSERT_THROW(args = store::get_args(argc, argv), std::invalid_argument);
+}
+
+TEST(command_store, missing_requirements1) {
+  const char *argv[] = {"douka", "store", "attach"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  store::Args args;
+  ASSERT_THROW(args = store::get_args(argc, argv), std::invalid_argument);
+}
+
+TEST(command_store, missing_requirements2) {
+  const char *argv[] = {"douka", "store", "create", "--name", "exp"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  store::Args args;
+  ASSERT_THROW(args = store::get_args(argc, argv), std::invalid_argument);
+}
+
+TEST(command_store, ok1) {
+  const char *argv[] = {"douka",    "store",  "persist",  "--name", "exp",
+                        "--output", "out",    "--format", "json",   "--force"};
+  const int argc = sizeof(argv) / sizeof(char *);
+  store::Args args;
+  ASSERT_NO_THROW(args = store::get_args(argc, argv));
+
+  ASSERT_EQ(args.action, store::Action::persist);
+  ASSERT_EQ(args.store, "shm:exp");
+  ASSERT_EQ(args.output, "out");
+  ASSERT_EQ(args.format, "json");
+  ASSERT_TRUE(args.force);
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <common/alloc.hh>
+#include <common/compute.hh>
+#include <common/json.hh>
+#include <douka/io.hh>
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <malloc.h>
+#include <memory>
+
+namespace alloc = douka::common::alloc;
+
+TEST(common, alloc_disabled) {
+  if (alloc::enabled()) {
+    GTEST_SKIP() << "built with DOUKA_USE_ALLOC_COUNTER";
+  }
+  const auto before = alloc::stats();
+  const auto ptr = std::make_unique<double[]>(1024);
+  ASSERT_EQ((alloc::stats() - before).count, 0);
+}
+
+TEST(common, alloc_new) {
+  if (!alloc::enabled()) {
+    GTEST_SKIP() << "built without DOUKA_USE_ALLOC_COUNTER";
+  }
+  alloc::reset_peak();
+  const auto before = alloc::stats();
+  {
+    const auto ptr = std::make_unique<double[]>(1024);
+    const auto allocs = alloc::stats() - before;
+    ASSERT_EQ(allocs.count, 1);
+    ASSERT_GE(allocs.bytes, 1024 * sizeof(double));
+    ASSERT_GE(allocs.current, before.current + static_cast<int64_t>(1024 * sizeof(double)));
+  }
+  const auto after = alloc::stats();
+  ASSERT_EQ(after.current, before.current);
+  ASSERT_GE(after.peak, before.current + static_cast<int64_t>(1024 * sizeof(double)));
+}
+
+TEST(common, alloc_valloc) {
+  if (!alloc::enabled()) {
+    GTEST_SKIP() << "built without DOUKA_USE_ALLOC_COUNTER";
+  }
+  auto before = alloc::stats();
+  void *ptr = valloc(4096);
+  ASSERT_EQ((alloc::stats() - before).count, 1u);
+  free(ptr);
+
+  before = alloc::stats();
+  ptr = pvalloc(1);
+  ASSERT_EQ((alloc::stats() - before).count, 1u);
+  free(ptr);
+
+  before = alloc::stats();
+  ptr = reallocarray(nullptr, 16, sizeof(double));
+  ASSERT_EQ((alloc::stats() - before).count, 1u);
+  free(ptr);
+  ASSERT_EQ(alloc::stats().current, before.current);
+}
+
+TEST(common, alloc_eigen) {
+  if (!alloc::enabled()) {
+    GTEST_SKIP() << "built without DOUKA_USE_ALLOC_COUNTER";
+  }
+  const auto before = alloc::stats();
+  Eigen::MatrixXd m(64, 64);
+  ASSERT_EQ((alloc::stats() - before).count, 1);
+
+  // Assignment of the same size does not reallocate
+  const auto resized = alloc::stats();
+  m = Eigen::MatrixXd::Identity(64, 64);
+  ASSERT_EQ((alloc::stats() - resized).count, 0);
+}
+
+// Allocation budget of the compute kernels: mean_diff is a lazy expression
+TEST(common, alloc_budget_mean_diff) {
+  if (!alloc::enabled()) {
+    GTEST_SKIP() << "built without DOUKA_USE_ALLOC_COUNTER";
+  }
+  const Eigen::MatrixXd x = Eigen::MatrixXd::Random(16, 8);
+  Eigen::MatrixXd md(16, 8);
+  const auto before = alloc::stats();
+  md.noalias() = douka::common::compute::mean_diff(x);
+  ASSERT_LE((alloc::stats() - before).count, 1);
+}
+
+// Allocation budget of the I/O path: the state is read into a single json tree
+TEST(common, alloc_budget_io) {
+  if (!alloc::enabled()) {
+    GTEST_SKIP() << "built without DOUKA_USE_ALLOC_COUNTER";
+  }
+  const auto filename = std::filesystem::temp_directory_path() / "douka-alloc-test.json";
+  const douka::io::State state{"test", 0, 0, 0, std::vector<double>(128, 1.0)};
+  ASSERT_TRUE(douka::io::write_json(filename, state, true));
+
+  nlohmann::json json;
+  const auto before = alloc::stats();
+  ASSERT_TRUE(douka::io::read_json(filename, json));
+  const auto allocs = alloc::stats() - before;
+  ASSERT_GT(allocs.count, 0);
+  ASSERT_LE(allocs.count, 2 * 128 + 64);
+  std::filesystem::remove(filename);
+}
+
+// Allocation budget of the streaming reader: the file buffer, independent of the state size
+TEST(common, alloc_budget_read_state) {
+  if (!alloc::enabled()) {
+    GTEST_SKIP() << "built without DOUKA_USE_ALLOC_COUNTER";
+  }
+  const auto filename = std::filesystem::temp_directory_path() / "douka-alloc-test.json";
+  const douka::io::State state{"test", 0, 0, 0, std::vector<double>(128, 1.0)};
+  ASSERT_TRUE(douka::io::write_json(filename, state, true));
+
+  douka::io::StateHeader header;
+  Eigen::VectorXd x(128);
+  const auto before = alloc::stats();
+  ASSERT_TRUE(douka::io::read_state(filename, header, x));
+  ASSERT_LE((alloc::stats() - before).count, 16);
+  std::filesystem::remove(filename);
+}
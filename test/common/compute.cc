@@ -6,6 +6,8 @@
 #include <common/compute.hh>
 #include <gtest/gtest.h>
 
+#include <Eigen/LU>
+
 namespace compute = douka::common::compute;
 
 TEST(common, compute_mean_diff) {
@@ -125,3 +127,51 @@ TEST(common, compute_kalman_gain_tall) {
   const auto K_mat = compute::kalman_gain_tall(X_mat, H_mat, R_mat);
   ASSERT_TRUE(K_mat.isApprox(K_expect_mat, 1.0e-6));
 }
+
+TEST(common, compute_select_gain) {
+  using compute::Gain;
+  // Few members, many observations: the ensemble space is the smallest system
+  ASSERT_EQ(compute::select_gain(compute::gain_costs(16, 1000, 800, {true, true, true})).gain,
+            Gain::ensemble);
+  // Few observations: the observation space is the smallest system
+  ASSERT_EQ(compute::select_gain(compute::gain_costs(64, 1000, 4, {false, true, true})).gain,
+            Gain::observation);
+  // Few states, many observations with a dense R: the state space is the smallest system
+  ASSERT_EQ(compute::select_gain(compute::gain_costs(200, 4, 400, {false, false, true})).gain,
+            Gain::state);
+  // state and ensemble need R^-1
+  const auto costs = compute::gain_costs(16, 1000, 800, {true, true, false});
+  ASSERT_FALSE(costs[static_cast<int>(Gain::state)].available);
+  ASSERT_FALSE(costs[static_cast<int>(Gain::ensemble)].available);
+  ASSERT_EQ(compute::select_gain(costs).gain, Gain::observation);
+}
+
+TEST(common, compute_rank_update) {
+  const Eigen::MatrixXd A = Eigen::MatrixXd::Random(4, 7);
+  Eigen::MatrixXd C = Eigen::MatrixXd::Identity(4, 4);
+  compute::rank_update(C, A, 0.5);
+  compute::symmetrize(C);
+  const Eigen::MatrixXd expect = Eigen::MatrixXd::Identity(4, 4) + 0.5 * A * A.transpose();
+  ASSERT_TRUE(C.isApprox(expect, 1.0e-12));
+}
+
+TEST(common, compute_solve_symmetric) {
+  const Eigen::MatrixXd A = Eigen::MatrixXd::Random(4, 7);
+  const Eigen::MatrixXd B = Eigen::MatrixXd::Random(4, 3);
+  const Eigen::MatrixXd expect = (A * A.transpose()).inverse() * B;
+
+  // Only the lower triangle is referenced
+  Eigen::MatrixXd C = A * A.transpose();
+  C.triangularView<Eigen::StrictlyUpper>().setZero();
+  Eigen::MatrixXd X = B;
+  compute::solve_symmetric(C, X);
+  ASSERT_TRUE(X.isApprox(expect, 1.0e-10));
+
+  // Singular: pseudo inverse
+  Eigen::MatrixXd D = Eigen::MatrixXd::Zero(4, 4);
+  D(0, 0) = 2.0;
+  Eigen::MatrixXd Y = B;
+  compute::solve_symmetric(D, Y);
+  ASSERT_DOUBLE_EQ(Y(0, 0), 0.5 * B(0, 0));
+  ASSERT_DOUBLE_EQ(Y(1, 0), 0.0);
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <common/ensemble.hh>
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+TEST(common, ensemble_roundtrip) {
+  const auto filename = std::filesystem::temp_directory_path() / "douka-ensemble-test.bin";
+  const douka::io::Ensemble ensemble{"test", 2, 3, 4, 5, {1.0, 2.0, 3.0, 4.0, 5.0, 6.0}};
+  ASSERT_TRUE(douka::io::write_ensemble(filename, ensemble, true));
+  ASSERT_FALSE(douka::io::write_ensemble(filename, ensemble));
+  ASSERT_TRUE(douka::io::is_ensemble(filename));
+
+  // The state block is page aligned
+  ASSERT_EQ(std::filesystem::file_size(filename),
+            douka::io::ensemble_alignment + ensemble.X.size() * sizeof(double));
+
+  douka::io::Ensemble read;
+  ASSERT_TRUE(douka::io::read_ensemble(filename, read));
+  EXPECT_EQ(read.name, ensemble.name);
+  EXPECT_EQ(read.N, ensemble.N);
+  EXPECT_EQ(read.k, ensemble.k);
+  EXPECT_EQ(read.sys_tim, ensemble.sys_tim);
+  EXPECT_EQ(read.obs_tim, ensemble.obs_tim);
+  EXPECT_EQ(read.X, ensemble.X);
+
+  // Truncated
+  std::filesystem::resize_file(filename, std::filesystem::file_size(filename) - 1);
+  ASSERT_FALSE(douka::io::read_ensemble(filename, read));
+  std::filesystem::remove(filename);
+}
+
+TEST(common, ensemble_broken_header) {
+  const auto filename = std::filesystem::temp_directory_path() / "douka-ensemble-broken.bin";
+  const douka::io::Ensemble ensemble{"test", 2, 3, 4, 5, {1.0, 2.0, 3.0, 4.0, 5.0, 6.0}};
+  const auto patch = [&filename](const std::size_t offset, const auto value) {
+    std::fstream stream{filename, std::ios::binary | std::ios::in | std::ios::out};
+    stream.seekp(static_cast<std::streamoff>(offset));
+    stream.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+
+  // k x N wraps around to the size of no state
+  ASSERT_TRUE(douka::io::write_ensemble(filename, ensemble, true));
+  patch(offsetof(douka::io::EnsembleHeader, N), int64_t{1} << 32);
+  patch(offsetof(douka::io::EnsembleHeader, k), int64_t{1} << 32);
+  std::filesystem::resize_file(filename, douka::io::ensemble_alignment);
+  douka::io::Ensemble read;
+  ASSERT_FALSE(douka::io::read_ensemble(filename, read));
+
+  // The end of the name wraps around
+  ASSERT_TRUE(douka::io::write_ensemble(filename, ensemble, true));
+  patch(offsetof(douka::io::EnsembleHeader, name_size), ~uint64_t{0} - 16);
+  ASSERT_FALSE(douka::io::read_ensemble(filename, read));
+  std::filesystem::remove(filename);
+
+  // The standard input has no size, k x N is bounded before it is multiplied
+  std::stringstream written;
+  ASSERT_TRUE(douka::io::write_ensemble(written, ensemble));
+  const auto broken = [&written](const int64_t N, const int64_t k) {
+    auto bytes = written.str();
+    std::memcpy(bytes.data() + offsetof(douka::io::EnsembleHeader, N), &N, sizeof(N));
+    std::memcpy(bytes.data() + offsetof(douka::io::EnsembleHeader, k), &k, sizeof(k));
+    return std::istringstream{bytes};
+  };
+  auto stream = broken(2, 3);
+  ASSERT_TRUE(douka::io::read_ensemble(stream, read));
+  stream = broken(int64_t{1} << 32, int64_t{1} << 32);
+  ASSERT_FALSE(douka::io::read_ensemble(stream, read));
+  stream = broken(int64_t{1} << 62, 4);
+  ASSERT_FALSE(douka::io::read_ensemble(stream, read));
+  stream = broken(2, -3);
+  ASSERT_FALSE(douka::io::read_ensemble(stream, read));
+}
+
+TEST(common, ensemble_not_binary) {
+  const auto filename = std::filesystem::temp_directory_path() / "douka-ensemble-test.json";
+  const douka::io::State state{"test", 0, 0, 0, {1.0}};
+  ASSERT_TRUE(douka::io::write_json(filename, state, true));
+  ASSERT_FALSE(douka::io::is_ensemble(filename));
+  douka::io::Ensemble ensemble;
+  ASSERT_FALSE(douka::io::read_ensemble(filename, ensemble));
+  std::filesystem::remove(filename);
+}
+
+TEST(common, ensemble_states) {
+  const std::vector<douka::io::State> states = {
+      {"test", 1, 2, 3, {4.0, 5.0}},
+      {"test", 0, 2, 3, {1.0, 2.0}},
+  };
+  douka::io::Ensemble ensemble;
+  ASSERT_TRUE(douka::io::to_ensemble(states, ensemble));
+  EXPECT_EQ(ensemble.N, 2);
+  EXPECT_EQ(ensemble.k, 2);
+  EXPECT_EQ(ensemble.X, (std::vector<double>{1.0, 2.0, 4.0, 5.0}));
+
+  std::vector<douka::io::State> converted;
+  ASSERT_TRUE(douka::io::to_states(ensemble, converted));
+  ASSERT_EQ(converted.size(), 2);
+  EXPECT_EQ(converted[0].id, 0);
+  EXPECT_EQ(converted[1].x, states[0].x);
+  EXPECT_EQ(converted[1].sys_tim, 2);
+  EXPECT_EQ(converted[1].obs_tim, 3);
+
+  // Members should share the timestamp and cover the ids
+  ASSERT_FALSE(douka::io::to_ensemble({{"test", 0, 2, 3, {1.0, 2.0}}, {"test", 1, 2, 4, {1.0, 2.0}}},
+                                      ensemble));
+  ASSERT_FALSE(douka::io::to_ensemble({{"test", 0, 2, 3, {1.0, 2.0}}, {"test", 2, 2, 3, {1.0, 2.0}}},
+                                      ensemble));
+}
+
+TEST(common, ensemble_format) {
+  ASSERT_EQ(douka::io::to_format("json"), douka::io::Format::json);
+  ASSERT_EQ(douka::io::to_format("binary"), douka::io::Format::binary);
+  ASSERT_THROW(douka::io::to_format("xml"), std::invalid_argument);
+}
+
+TEST(common, ensemble_mapped) {
+  const auto filename = std::filesystem::temp_directory_path() / "douka-ensemble-mapped.bin";
+  {
+    douka::io::MappedEnsemble mapped;
+    ASSERT_TRUE(mapped.create(filename, "test", 3, 2, 1, 0, true));
+    auto X = mapped.X();
+    ASSERT_EQ(X.rows(), 2);
+    ASSERT_EQ(X.cols(), 3);
+    // The states are a view on the page aligned block of the mapping
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(X.data()) % douka::io::ensemble_alignment, 0);
+    X << 1.0, 2.0, 3.0, 4.0, 5.0, 6.0;
+    mapped.header().obs_tim = 1;
+    ASSERT_TRUE(mapped.close());
+  }
+
+  douka::io::Ensemble ensemble;
+  ASSERT_TRUE(douka::io::read_ensemble(filename, ensemble));
+  EXPECT_EQ(ensemble.name, "test");
+  EXPECT_EQ(ensemble.sys_tim, 1);
+  EXPECT_EQ(ensemble.obs_tim, 1);
+  EXPECT_EQ(ensemble.X, (std::vector<double>{1.0, 4.0, 2.0, 5.0, 3.0, 6.0}));
+
+  // Update in place
+  {
+    douka::io::MappedEnsemble mapped;
+    ASSERT_TRUE(mapped.open(filename, true));
+    EXPECT_EQ(mapped.name(), "test");
+    mapped.X()(1, 2) = -1.0;
+  }
+  douka::io::MappedEnsemble mapped;
+  ASSERT_TRUE(mapped.open(filename));
+  EXPECT_DOUBLE_EQ(mapped.X()(1, 2), -1.0);
+
+  // The members are copied straight out of the mapping
+  std::vector<douka::io::State> states;
+  ASSERT_TRUE(douka::io::to_states(mapped, states));
+  ASSERT_EQ(states.size(), 3);
+  EXPECT_EQ(states[2].name, "test");
+  EXPECT_EQ(states[2].id, 2);
+  EXPECT_EQ(states[2].obs_tim, 1);
+  EXPECT_EQ(states[2].x, (std::vector<double>{3.0, -1.0}));
+  ASSERT_TRUE(mapped.close());
+
+  // and written straight into the mapping of a new ensemble
+  const auto dir = std::filesystem::temp_directory_path() / "douka-ensemble-mapped";
+  std::filesystem::create_directories(dir);
+  ASSERT_TRUE(douka::io::write_states(dir, states, douka::io::Format::binary, true));
+  ASSERT_TRUE(douka::io::read_ensemble(dir / douka::io::ensemble_filename("test", 1, 1), ensemble));
+  EXPECT_EQ(ensemble.X, (std::vector<double>{1.0, 4.0, 2.0, 5.0, 3.0, -1.0}));
+  std::filesystem::remove_all(dir);
+
+  // An ensemble created and not closed is incomplete and removed
+  {
+    douka::io::MappedEnsemble created;
+    ASSERT_TRUE(created.create(filename, "test", 3, 2, 1, 0, true));
+  }
+  EXPECT_FALSE(std::filesystem::exists(filename));
+}
+
+TEST(common, ensemble_stream) {
+  const douka::io::Ensemble ensemble{"test", 2, 3, 4, 5, {1.0, 2.0, 3.0, 4.0, 5.0, 6.0}};
+  std::stringstream stream;
+  ASSERT_TRUE(douka::io::write_ensemble(stream, ensemble));
+  ASSERT_EQ(stream.str().size(),
+            douka::io::ensemble_alignment + ensemble.X.size() * sizeof(double));
+
+  douka::io::Ensemble read;
+  ASSERT_TRUE(douka::io::read_ensemble(stream, read));
+  EXPECT_EQ(read.name, ensemble.name);
+  EXPECT_EQ(read.N, ensemble.N);
+  EXPECT_EQ(read.k, ensemble.k);
+  EXPECT_EQ(read.sys_tim, ensemble.sys_tim);
+  EXPECT_EQ(read.obs_tim, ensemble.obs_tim);
+  EXPECT_EQ(read.X, ensemble.X);
+
+  // A truncated stream fails
+  std::stringstream truncated{stream.str().substr(0, douka::io::ensemble_alignment + 8)};
+  ASSERT_FALSE(douka::io::read_ensemble(truncated, read));
+  ASSERT_TRUE(douka::io::is_stdio("-"));
+  ASSERT_FALSE(douka::io::is_stdio("./-"));
+}
+
+TEST(common, ensemble_store) {
+  const auto store = "shm:douka-test-" + std::to_string(getpid());
+  const douka::io::Ensemble ensemble{"test", 2, 3, 4, 5, {1.0, 2.0, 3.0, 4.0, 5.0, 6.0}};
+  ASSERT_TRUE(douka::io::is_store(store));
+  ASSERT_FALSE(douka::io::exists_store(store));
+  ASSERT_TRUE(douka::io::write_ensemble(store, ensemble));
+  ASSERT_FALSE(douka::io::write_ensemble(store, ensemble));
+  ASSERT_TRUE(douka::io::exists_store(store));
+  ASSERT_TRUE(douka::io::is_ensemble(store));
+
+  // The store outlives the mapping of the writer
+  {
+    douka::io::MappedEnsemble mapped;
+    ASSERT_TRUE(mapped.open(store, true));
+    EXPECT_EQ(mapped.name(), "test");
+    mapped.X()(1, 0) = -1.0;
+  }
+  douka::io::MappedEnsemble attached;
+  ASSERT_TRUE(attached.open(store));
+
+  // A replaced store leaves the previous mapping intact
+  const douka::io::Ensemble next{"next", 1, 2, 0, 0, {7.0, 8.0}};
+  ASSERT_TRUE(douka::io::write_ensemble(store, next, true));
+  EXPECT_EQ(attached.name(), "test");
+  EXPECT_DOUBLE_EQ(attached.X()(1, 0), -1.0);
+
+  douka::io::Ensemble read;
+  ASSERT_TRUE(douka::io::read_ensemble(store, read));
+  EXPECT_EQ(read.name, next.name);
+  EXPECT_EQ(read.X, next.X);
+
+  ASSERT_TRUE(douka::io::destroy_store(store));
+  ASSERT_FALSE(douka::io::exists_store(store));
+  ASSERT_FALSE(douka::io::read_ensemble(store, read));
+  ASSERT_FALSE(douka::io::destroy_store(store));
+  ASSERT_FALSE(douka::io::exists_store("shm:a/b"));
+}
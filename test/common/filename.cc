@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <common/io.hh>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+namespace {
+std::filesystem::path make_dir(const std::string &name, const std::vector<std::string> &files) {
+  const auto dir = std::filesystem::temp_directory_path() / name;
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  for (const auto &file : files) {
+    std::ofstream{dir / file};
+  }
+  return dir;
+}
+} // namespace
+
+TEST(common, filename_scan) {
+  const auto dir =
+      make_dir("douka-filename-scan", {"s_0003.json", "s_0001.json", "s_0002.json", "s_00004.json",
+                                       "s_0005.txt", "t_0004.json", "s_7.json"});
+  std::vector<std::string> files;
+  ASSERT_TRUE(douka::io::parse_filename((dir / "s_%04d.json").string(), files));
+  // Sorted by id from the first one, the names not given back by the placeholder are ignored
+  ASSERT_EQ(files, (std::vector<std::string>{(dir / "s_0001.json").string(),
+                                             (dir / "s_0002.json").string(),
+                                             (dir / "s_0003.json").string()}));
+
+  files.clear();
+  ASSERT_TRUE(douka::io::parse_filename((dir / "s_%d.json").string(), files));
+  ASSERT_EQ(files, (std::vector<std::string>{(dir / "s_7.json").string()}));
+
+  // Single file
+  files.clear();
+  ASSERT_TRUE(douka::io::parse_filename((dir / "s_0005.txt").string(), files));
+  ASSERT_EQ(files.size(), 1u);
+
+  ASSERT_FALSE(douka::io::parse_filename((dir / "u_%04d.json").string(), files));
+  ASSERT_FALSE(douka::io::parse_filename((dir / "s_%04d_%04d.json").string(), files));
+  ASSERT_FALSE(douka::io::parse_filename((dir / "not-exists" / "s_%04d.json").string(), files));
+  std::filesystem::remove_all(dir);
+}
+
+TEST(common, filename_large_ids) {
+  // Ids beyond 9 digits and the range of int
+  const auto dir = make_dir("douka-filename-large-ids", {"s_9999999999.json", "s_10000000000.json",
+                                                          "s_99999999999999999999.json"});
+  std::vector<std::string> files;
+  ASSERT_TRUE(douka::io::parse_filename((dir / "s_%d.json").string(), files));
+  ASSERT_EQ(files, (std::vector<std::string>{(dir / "s_9999999999.json").string(),
+                                             (dir / "s_10000000000.json").string()}));
+
+  // No name is given back by the padding
+  ASSERT_FALSE(douka::io::parse_filename((dir / "s_%012d.json").string(), files));
+  std::filesystem::remove_all(dir);
+}
+
+TEST(common, filename_gap) {
+  const auto dir = make_dir("douka-filename-gap", {"s_0000.json", "s_0001.json", "s_0003.json"});
+  std::vector<std::string> files;
+  ASSERT_FALSE(douka::io::parse_filename((dir / "s_%04d.json").string(), files));
+  std::filesystem::remove_all(dir);
+}
+
+TEST(common, filename_index) {
+  const auto dir = make_dir("douka-filename-index", {"s_0000.json", "s_0001.json"});
+  douka::io::use_filename_index() = true;
+  std::vector<std::string> files;
+  ASSERT_TRUE(douka::io::parse_filename((dir / "s_%04d.json").string(), files,
+                                        douka::io::layout()));
+  ASSERT_EQ(files.size(), 2u);
+  ASSERT_TRUE(std::filesystem::exists(dir / douka::io::filename_index));
+
+  // The index is trusted while the directory is unchanged, once it is newer than the directory
+  std::string header;
+  std::getline(std::ifstream{dir / douka::io::filename_index}, header);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  std::ofstream{dir / douka::io::filename_index} << header << "\ns_0000.json\nother\n";
+  files.clear();
+  ASSERT_TRUE(douka::io::parse_filename((dir / "s_%04d.json").string(), files,
+                                        douka::io::layout()));
+  ASSERT_EQ(files.size(), 1u);
+
+  // but not when it holds fewer names than it was written with
+  std::ofstream{dir / douka::io::filename_index} << header << "\ns_0000.json\n";
+  files.clear();
+  ASSERT_TRUE(douka::io::parse_filename((dir / "s_%04d.json").string(), files,
+                                        douka::io::layout()));
+  ASSERT_EQ(files.size(), 2u);
+
+  // and listed again once a file is added
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  std::ofstream{dir / "s_0002.json"};
+  files.clear();
+  ASSERT_TRUE(douka::io::parse_filename((dir / "s_%04d.json").string(), files,
+                                        douka::io::layout()));
+  ASSERT_EQ(files.size(), 3u);
+  douka::io::use_filename_index() = false;
+  std::filesystem::remove_all(dir);
+}
+
+TEST(common, filename_layout) {
+  const auto dir = make_dir("douka-filename-layout", {});
+  auto &layout = douka::io::layout();
+  layout = {6, true, 2};
+
+  douka::io::State state{"s", 0, 1, 0, {1.0}};
+  EXPECT_EQ(douka::io::state_filename(state), "s_0000_000001_000000.json");
+  EXPECT_EQ(douka::io::state_filename(state, layout.id_width), "s_000000_000001_000000.json");
+  EXPECT_EQ(douka::io::state_filename_with_id_place_holder(state, layout.id_width),
+            "s_%06d_000001_000000.json");
+  state.id = 5;
+  EXPECT_EQ(douka::io::state_path(state), "000001/2/s_000005_000001_000000.json");
+
+  for (int64_t id = 0; id < 5; ++id) {
+    state.id = id;
+    std::filesystem::create_directories(dir / douka::io::state_directory(state));
+    std::ofstream{dir / douka::io::state_path(state)};
+  }
+  // A member in the wrong shard is not found
+  std::ofstream{dir / "000001" / "0" / "s_000005_000001_000000.json"};
+
+  std::vector<std::string> files;
+  ASSERT_TRUE(douka::io::parse_filename((dir / "000001" / "s_%06d_000001_000000.json").string(),
+                                        files, layout));
+  ASSERT_EQ(files.size(), 5u);
+  for (int64_t id = 0; id < 5; ++id) {
+    state.id = id;
+    EXPECT_EQ(files[id], (dir / douka::io::state_path(state)).string());
+  }
+  layout = {};
+  std::filesystem::remove_all(dir);
+}
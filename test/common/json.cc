@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <common/ensemble.hh>
+#include <common/io.hh>
+#include <common/json.hh>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <random>
+
+namespace {
+std::filesystem::path write_text(const std::string &name, const std::string &text) {
+  const auto filename = std::filesystem::temp_directory_path() / name;
+  std::ofstream{filename} << text;
+  return filename;
+}
+} // namespace
+
+TEST(common, json_read_state) {
+  const auto filename = std::filesystem::temp_directory_path() / "douka-json-test.json";
+  const douka::io::State state{"test", 3, 4, 5, {1.0, -2.5, 3e-8}};
+  ASSERT_TRUE(douka::io::write_json(filename, state, true));
+
+  douka::io::StateHeader header;
+  Eigen::VectorXd x(3);
+  ASSERT_TRUE(douka::io::read_state(filename, header, x));
+  EXPECT_EQ(header.name, state.name);
+  EXPECT_EQ(header.id, state.id);
+  EXPECT_EQ(header.sys_tim, state.sys_tim);
+  EXPECT_EQ(header.obs_tim, state.obs_tim);
+  EXPECT_EQ(std::vector<double>(x.begin(), x.end()), state.x);
+
+  douka::io::State read;
+  ASSERT_TRUE(douka::io::read_state(filename, read));
+  EXPECT_EQ(read.name, state.name);
+  EXPECT_EQ(read.id, state.id);
+  EXPECT_EQ(read.x, state.x);
+
+  // The destination size must match
+  Eigen::VectorXd small(2), large(4);
+  ASSERT_FALSE(douka::io::read_state(filename, header, small));
+  ASSERT_FALSE(douka::io::read_state(filename, header, large));
+  std::filesystem::remove(filename);
+}
+
+TEST(common, json_read_state_order) {
+  // Any key order, integers in x and unknown fields are accepted
+  const auto filename =
+      write_text("douka-json-order.json", R"({"x": [1, 2.5], "extra": {"x": [[0]], "id": "a"},
+        "obs_tim": 2, "sys_tim": 3, "id": 1, "name": "test"})");
+  douka::io::StateHeader header;
+  Eigen::VectorXd x(2);
+  ASSERT_TRUE(douka::io::read_state(filename, header, x));
+  EXPECT_EQ(header.name, "test");
+  EXPECT_EQ(header.id, 1);
+  EXPECT_EQ(header.sys_tim, 3);
+  EXPECT_EQ(header.obs_tim, 2);
+  EXPECT_EQ(x, Eigen::Vector2d(1.0, 2.5));
+  std::filesystem::remove(filename);
+}
+
+TEST(common, json_read_state_invalid) {
+  const std::string texts[] = {
+      R"({"name": "test", "id": 0, "sys_tim": 0, "x": [1.0]})",
+      R"({"name": "test", "id": 0, "sys_tim": 0, "obs_tim": 0})",
+      R"({"name": 1, "id": 0, "sys_tim": 0, "obs_tim": 0, "x": [1.0]})",
+      R"({"name": "test", "id": 0.5, "sys_tim": 0, "obs_tim": 0, "x": [1.0]})",
+      R"({"name": "test", "id": 0, "sys_tim": 0, "obs_tim": 0, "x": [[1.0]]})",
+      R"({"name": "test", "id": 0, "sys_tim": 0, "obs_tim": 0, "x": [1.0, "a"]})",
+      R"({"name": "test", "id": 0, "sys_tim": 0, "obs_tim": 0, "x": [1.0)",
+  };
+  for (const auto &text : texts) {
+    const auto filename = write_text("douka-json-invalid.json", text);
+    douka::io::State state;
+    EXPECT_FALSE(douka::io::read_state(filename, state)) << text;
+    std::filesystem::remove(filename);
+  }
+  douka::io::State state;
+  ASSERT_FALSE(douka::io::read_state("douka-json-not-exists.json", state));
+}
+
+TEST(common, json_read_states_ensemble) {
+  // Members are placed by id whatever the file order is
+  const auto dir = std::filesystem::temp_directory_path() / "douka-json-ensemble";
+  std::filesystem::create_directories(dir);
+  const int64_t N = 4, k = 3;
+  for (int64_t i = 0; i < N; ++i) {
+    const int64_t id = (i + 1) % N;
+    char filename[32];
+    std::snprintf(filename, sizeof(filename), "member_%02ld.json", static_cast<long>(i));
+    const douka::io::State state{"test", id, 1, 0, std::vector<double>(k, static_cast<double>(id))};
+    ASSERT_TRUE(douka::io::write_json(dir / filename, state, true));
+  }
+
+  douka::io::Ensemble ensemble;
+  ASSERT_TRUE(douka::io::read_states((dir / "member_%02d.json").string(), ensemble));
+  EXPECT_EQ(ensemble.name, "test");
+  EXPECT_EQ(ensemble.N, N);
+  EXPECT_EQ(ensemble.k, k);
+  EXPECT_EQ(ensemble.sys_tim, 1);
+  EXPECT_EQ(ensemble.obs_tim, 0);
+  for (int64_t id = 0; id < N; ++id) {
+    for (int64_t j = 0; j < k; ++j) {
+      EXPECT_EQ(ensemble.X[id * k + j], static_cast<double>(id));
+    }
+  }
+
+  // Written back one member at a time
+  const auto output = dir / "output";
+  std::filesystem::create_directories(output);
+  ASSERT_TRUE(douka::io::write_states(output, ensemble, douka::io::Format::json, true));
+  std::vector<douka::io::State> states;
+  const auto pattern = douka::io::state_filename_with_id_place_holder(douka::io::State{
+      ensemble.name, 0, ensemble.sys_tim, ensemble.obs_tim, {}});
+  ASSERT_TRUE(douka::io::read_states((output / pattern).string(), states));
+  ASSERT_EQ(states.size(), static_cast<std::size_t>(N));
+  for (const auto &state : states) {
+    EXPECT_EQ(state.x, std::vector<double>(k, static_cast<double>(state.id)));
+  }
+
+  // Duplicated id
+  const douka::io::State state{"test", 0, 1, 0, std::vector<double>(k, 0.0)};
+  ASSERT_TRUE(douka::io::write_json(dir / "member_01.json", state, true));
+  ASSERT_FALSE(douka::io::read_states((dir / "member_%02d.json").string(), ensemble));
+  std::filesystem::remove_all(dir);
+}
+
+TEST(common, json_to_text) {
+  std::mt19937_64 engine{1};
+  std::uniform_int_distribution<uint64_t> bits;
+  douka::io::State state{"te\"st", 12, 3, 4, {0.0, -0.0, 1.0, 0.1, 1e-300, 1.7976931348623157e308}};
+  state.x.emplace_back(std::numeric_limits<double>::denorm_min());
+  while (state.x.size() < 1000) {
+    // Random bit patterns cover all exponents
+    double value;
+    const auto b = bits(engine);
+    std::memcpy(&value, &b, sizeof(value));
+    if (std::isfinite(value)) {
+      state.x.emplace_back(value);
+    }
+  }
+
+  const auto compact = douka::io::to_text(state, douka::io::JsonStyle::compact);
+  const auto pretty = douka::io::to_text(state, douka::io::JsonStyle::pretty);
+  ASSERT_EQ(std::count(compact.begin(), compact.end(), '\n'), 1);
+  ASSERT_LT(compact.size(), pretty.size());
+  // Same document, the values read back bit for bit
+  ASSERT_EQ(nlohmann::json::parse(compact), nlohmann::json::parse(pretty));
+
+  const auto filename = write_text("douka-json-compact.json", compact);
+  douka::io::State read;
+  ASSERT_TRUE(douka::io::read_state(filename, read));
+  EXPECT_EQ(read.name, state.name);
+  EXPECT_EQ(read.id, state.id);
+  ASSERT_EQ(read.x.size(), state.x.size());
+  for (std::size_t i = 0; i < state.x.size(); ++i) {
+    ASSERT_EQ(std::memcmp(&read.x[i], &state.x[i], sizeof(double)), 0) << state.x[i];
+  }
+  std::filesystem::remove(filename);
+
+  ASSERT_EQ(douka::io::to_json_style("pretty"), douka::io::JsonStyle::pretty);
+  ASSERT_THROW(douka::io::to_json_style("tight"), std::invalid_argument);
+}
+
+TEST(common, json_parse_state) {
+  const douka::io::State state{"test", 2, 3, 4, {1.0, -0.5, 2.0}};
+  douka::io::State read{"old", 0, 0, 0, {9.0, 9.0, 9.0, 9.0}};
+  ASSERT_TRUE(douka::io::parse_state(douka::io::to_text(state), read));
+  EXPECT_EQ(read.name, state.name);
+  EXPECT_EQ(read.id, state.id);
+  EXPECT_EQ(read.sys_tim, state.sys_tim);
+  EXPECT_EQ(read.obs_tim, state.obs_tim);
+  EXPECT_EQ(read.x, state.x);
+
+  ASSERT_FALSE(douka::io::parse_state(R"({"name":"test","id":2,"sys_tim":3,"x":[1.0]})", read));
+  ASSERT_FALSE(douka::io::parse_state(R"({"name":"test","id":2,"sys_tim":3,"obs_tim":4,"x":[)",
+                                      read));
+}
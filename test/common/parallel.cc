@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <common/ensemble.hh>
+#include <common/io.hh>
+#include <common/parallel.hh>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+
+TEST(common, parallel_for_each_file) {
+  for (const int64_t threads : {1, 4}) {
+    douka::io::set_io_threads(threads);
+    std::vector<std::atomic<int64_t>> counts(100);
+    ASSERT_TRUE(douka::io::for_each_file(100, [&](const int64_t i) {
+      counts[i]++;
+      return true;
+    }));
+    for (const auto &count : counts) {
+      ASSERT_EQ(count, 1);
+    }
+  }
+  douka::io::set_io_threads(1);
+}
+
+TEST(common, parallel_for_each_file_failure) {
+  for (const int64_t threads : {1, 4}) {
+    douka::io::set_io_threads(threads);
+    std::atomic<int64_t> count = 0;
+    ASSERT_FALSE(douka::io::for_each_file(100, [&](const int64_t i) {
+      count++;
+      return i != 10;
+    }));
+    // The remaining files are not processed after the failure, up to the bounded queue
+    ASSERT_LE(count, 11 + 3 * threads);
+
+    // An exception of a task is rethrown in the calling thread
+    ASSERT_THROW(douka::io::for_each_file(100,
+                                          [&](const int64_t i) {
+                                            if (i == 10) {
+                                              throw std::runtime_error("task failed");
+                                            }
+                                            return true;
+                                          }),
+                 std::runtime_error);
+  }
+  douka::io::set_io_threads(1);
+}
+
+TEST(common, parallel_workers_bounded) {
+  // The producer is blocked while the queue is full
+  douka::io::FileWorkers workers{2, 2};
+  std::atomic<int64_t> done = 0, in_flight = 0, peak = 0;
+  for (int64_t i = 0; i < 64; ++i) {
+    ASSERT_TRUE(workers.submit(i, [&] {
+      done++;
+      return true;
+    }));
+    const auto current = ++in_flight - done;
+    peak = std::max<int64_t>(peak, current);
+  }
+  ASSERT_TRUE(workers.wait());
+  ASSERT_EQ(done, 64);
+  ASSERT_LE(peak, 2 + 2 + 1);
+}
+
+TEST(common, parallel_states) {
+  const auto dir = std::filesystem::temp_directory_path() / "douka-parallel-test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  douka::io::Ensemble ensemble{"test", 32, 5, 1, 0, std::vector<double>(32 * 5)};
+  for (std::size_t i = 0; i < ensemble.X.size(); ++i) {
+    ensemble.X[i] = static_cast<double>(i);
+  }
+
+  douka::io::set_io_threads(4);
+  ASSERT_TRUE(douka::io::write_states(dir, ensemble, douka::io::Format::json));
+  ASSERT_TRUE(douka::io::write_states(dir, ensemble, douka::io::Format::binary));
+  // Existing files are reported without force
+  ASSERT_FALSE(douka::io::write_states(dir, ensemble, douka::io::Format::json));
+
+  const auto pattern = douka::io::state_filename_with_id_place_holder(
+      douka::io::State{ensemble.name, 0, ensemble.sys_tim, ensemble.obs_tim, {}});
+  douka::io::Ensemble json, binary;
+  ASSERT_TRUE(douka::io::read_states((dir / pattern).string(), json));
+  const auto filename = dir / douka::io::ensemble_filename(ensemble);
+  ASSERT_TRUE(douka::io::read_states(filename.string(), binary));
+  EXPECT_EQ(json.X, ensemble.X);
+  EXPECT_EQ(binary.X, ensemble.X);
+
+  std::vector<douka::io::State> states;
+  ASSERT_TRUE(douka::io::read_states((dir / pattern).string(), states));
+  ASSERT_EQ(states.size(), 32u);
+  for (int64_t id = 0; id < 32; ++id) {
+    // Deterministic order of the files
+    EXPECT_EQ(states[id].id, id);
+  }
+  douka::io::set_io_threads(1);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(common, parallel_for) {
+  for (const int64_t threads : {1, 4}) {
+    std::vector<std::atomic<int64_t>> counts(100);
+    std::atomic<int64_t> max_thread = 0;
+    ASSERT_TRUE(douka::common::parallel_for(
+        100,
+        [&](const int64_t i, const int64_t thread) {
+          counts[i]++;
+          max_thread = std::max<int64_t>(max_thread, thread);
+          return true;
+        },
+        threads));
+    for (const auto &count : counts) {
+      ASSERT_EQ(count, 1);
+    }
+    ASSERT_LT(max_thread, threads);
+
+    // The remaining indices are not run after a failure, except those already taken
+    std::atomic<int64_t> count = 0;
+    ASSERT_FALSE(douka::common::parallel_for(
+        100,
+        [&](const int64_t i, const int64_t) {
+          count++;
+          return i != 10;
+        },
+        threads));
+    ASSERT_LE(count, 11 + threads);
+
+    ASSERT_THROW(douka::common::parallel_for(
+                     100,
+                     [&](const int64_t i, const int64_t) {
+                       if (i % 7 == 3) {
+                         throw std::runtime_error("task failed");
+                       }
+                       return true;
+                     },
+                     threads),
+                 std::runtime_error);
+  }
+  ASSERT_GE(douka::common::compute_threads(), 1);
+}
+
+TEST(common, parallel_thread_pool) {
+  for (const int64_t threads : {1, 4}) {
+    douka::common::ThreadPool pool{threads};
+    ASSERT_EQ(pool.size(), threads);
+    // The threads are reused by the calls, with fewer tasks than threads as well
+    for (const int64_t n : {100, 2, 0, 100}) {
+      std::vector<std::atomic<int64_t>> counts(n);
+      std::atomic<int64_t> max_thread = 0;
+      ASSERT_TRUE(pool.parallel_for(n, [&](const int64_t i, const int64_t thread) {
+        counts[i]++;
+        max_thread = std::max<int64_t>(max_thread, thread);
+        return true;
+      }));
+      for (const auto &count : counts) {
+        ASSERT_EQ(count, 1);
+      }
+      ASSERT_LT(max_thread, std::min<int64_t>(threads, std::max<int64_t>(n, 1)));
+    }
+
+    std::atomic<int64_t> count = 0;
+    ASSERT_FALSE(pool.parallel_for(100, [&](const int64_t i, const int64_t) {
+      count++;
+      return i != 10;
+    }));
+    ASSERT_LE(count, 11 + threads);
+
+    ASSERT_THROW(pool.parallel_for(100,
+                                   [&](const int64_t i, const int64_t) {
+                                     if (i % 7 == 3) {
+                                       throw std::runtime_error("task failed");
+                                     }
+                                     return true;
+                                   }),
+                 std::runtime_error);
+    // and the pool is still usable after the failures
+    ASSERT_TRUE(pool.parallel_for(10, [](const int64_t, const int64_t) { return true; }));
+  }
+}
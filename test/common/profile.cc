@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <common/alloc.hh>
+#include <common/profile.hh>
+#include <douka/io.hh>
+#include <gtest/gtest.h>
+
+#include <map>
+#include <memory>
+
+namespace profile = douka::common::profile;
+
+static std::vector<std::string> complete_event_names(const nlohmann::json &trace) {
+  std::vector<std::string> names;
+  for (const auto &event : trace.at("traceEvents")) {
+    if (event.at("ph") == "X") {
+      names.emplace_back(event.at("name").get<std::string>());
+    }
+  }
+  return names;
+}
+
+TEST(common, profile_disabled) {
+  ASSERT_FALSE(profile::enabled());
+  { const profile::Scope scope{"disabled"}; }
+  ASSERT_TRUE(complete_event_names(profile::trace()).empty());
+  ASSERT_TRUE(profile::write());
+}
+
+TEST(common, profile_phase) {
+  const auto filename = std::filesystem::temp_directory_path() / "douka-profile-test.json";
+  profile::enable(filename);
+  ASSERT_TRUE(profile::enabled());
+  {
+    const profile::Scope scope{"command"};
+    profile::Phase phase{"read_json"};
+    phase.next("compute");
+    phase.next("write_json");
+  }
+
+  const auto trace = profile::trace();
+  const std::vector<std::string> expect = {"read_json", "compute", "write_json", "command"};
+  ASSERT_EQ(complete_event_names(trace), expect);
+  for (const auto &event : trace.at("traceEvents")) {
+    ASSERT_GE(event.at("ts").get<double>(), 0.0);
+    ASSERT_TRUE(event.at("args").contains("peak_rss_kb"));
+  }
+
+  ASSERT_TRUE(profile::write());
+  nlohmann::json written;
+  ASSERT_TRUE(douka::io::read_json(filename, written));
+  ASSERT_EQ(written, trace);
+  std::filesystem::remove(filename);
+}
+
+TEST(common, profile_heap_peak) {
+  if (!douka::common::alloc::enabled()) {
+    GTEST_SKIP() << "built without DOUKA_USE_ALLOC_COUNTER";
+  }
+  const auto filename = std::filesystem::temp_directory_path() / "douka-profile-test.json";
+  profile::enable(filename);
+  const int64_t size = 1 << 24;
+  {
+    const profile::Scope scope{"command"};
+    profile::Phase phase{"large"};
+    { const auto buffer = std::make_unique<char[]>(size); }
+    phase.next("small");
+  }
+
+  // The peak of a phase does not carry over to the next one, the scope takes the largest
+  std::map<std::string, int64_t> peaks;
+  const auto trace = profile::trace();
+  for (const auto &event : trace.at("traceEvents")) {
+    if (event.at("ph") == "X") {
+      peaks[event.at("name").get<std::string>()] = event.at("args").at("heap_peak");
+    }
+  }
+  ASSERT_GE(peaks.at("large") - peaks.at("small"), size / 2);
+  ASSERT_EQ(peaks.at("command"), peaks.at("large"));
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <common/ranks.hh>
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using douka::common::RankGroup;
+
+TEST(ranks, allreduce) {
+  // The ranks are threads here, the segment is shared all the same
+  const int64_t ranks = 3, size = 4;
+  std::vector<std::vector<double>> data(ranks);
+  std::vector<int> ok(ranks, 0);
+  std::vector<RankGroup::Slice> slices(ranks);
+  std::vector<std::thread> threads;
+  for (int64_t rank = 0; rank < ranks; ++rank) {
+    threads.emplace_back([&, rank]() {
+      RankGroup group;
+      if (!group.open("test-allreduce", ranks, rank, size)) {
+        return;
+      }
+      slices[rank] = group.slice(10);
+      for (int cycle = 0; cycle < 3; ++cycle) {
+        data[rank].assign(size, 0.0);
+        for (int64_t i = 0; i < size; ++i) {
+          data[rank][i] = (rank + 1) * (i + cycle);
+        }
+        if (!group.allreduce(data[rank].data(), size)) {
+          return;
+        }
+      }
+      ok[rank] = group.close();
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (int64_t rank = 0; rank < ranks; ++rank) {
+    ASSERT_TRUE(ok[rank]);
+    for (int64_t i = 0; i < size; ++i) {
+      EXPECT_EQ(data[rank][i], 6.0 * (i + 2));
+    }
+  }
+
+  // The slices cover the rows in order and differ by at most a row
+  int64_t next = 0;
+  for (const auto &slice : slices) {
+    EXPECT_EQ(slice.begin, next);
+    EXPECT_GE(slice.size, 3);
+    EXPECT_LE(slice.size, 4);
+    next += slice.size;
+  }
+  EXPECT_EQ(next, 10);
+}
+
+TEST(ranks, abort) {
+  // A rank leaving without close() fails the others instead of the timeout
+  std::vector<int> ok(2, 1);
+  std::thread other([&ok]() {
+    RankGroup group;
+    ok[1] = group.open("test-abort", 2, 1, 1, std::chrono::seconds{60}) && group.barrier() &&
+            group.barrier();
+  });
+  {
+    RankGroup group;
+    ASSERT_TRUE(group.open("test-abort", 2, 0, 1, std::chrono::seconds{60}));
+    ASSERT_TRUE(group.barrier());
+  }
+  other.join();
+  EXPECT_FALSE(ok[1]);
+
+  // The others time out if a rank never joins
+  RankGroup group;
+  ASSERT_TRUE(group.open("test-timeout", 2, 0, 1, std::chrono::milliseconds{50}));
+  EXPECT_FALSE(group.barrier());
+}
+
+TEST(ranks, invalid) {
+  RankGroup group;
+  EXPECT_FALSE(group.open("", 2, 0, 1));
+  EXPECT_FALSE(group.open("a/b", 2, 0, 1));
+  EXPECT_FALSE(group.open("test-invalid", 2, 2, 1));
+  EXPECT_FALSE(group.open("test-invalid", 0, 0, 1));
+
+  ASSERT_TRUE(group.open("test-invalid", 1, 0, 2));
+  double data[3] = {};
+  EXPECT_FALSE(group.allreduce(data, 3));
+  EXPECT_TRUE(group.allreduce(data, 2));
+  EXPECT_TRUE(group.close());
+}
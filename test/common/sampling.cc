@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <common/sampling.hh>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <map>
+#include <set>
+#include <utility>
+
+namespace sampling = douka::common::sampling;
+
+static double normal_cdf(const double x) { return 0.5 * std::erfc(-x / std::sqrt(2.0)); }
+
+// Every stratum of the width 1/N is taken by a single member in each dimension
+static void expect_stratified(const Eigen::MatrixXd &Z) {
+  const auto N = Z.cols();
+  for (Eigen::Index i = 0; i < Z.rows(); ++i) {
+    std::set<int64_t> strata;
+    for (Eigen::Index j = 0; j < N; ++j) {
+      strata.insert(static_cast<int64_t>(std::floor(normal_cdf(Z(i, j)) * N)));
+    }
+    EXPECT_EQ(static_cast<Eigen::Index>(strata.size()), N) << "dimension " << i;
+  }
+}
+
+// The projection of the dimensions a and b is a (t, m, 2)-net for the N = 2^m members, every
+// box of the area 2^(t-m) taken by 2^t members
+static void expect_net(const Eigen::MatrixXd &Z, const Eigen::Index a, const Eigen::Index b,
+                       const int t) {
+  const auto N = Z.cols();
+  const auto m = static_cast<int>(std::log2(N));
+  for (int bits_a = 0; bits_a <= m - t; ++bits_a) {
+    const int bits_b = m - t - bits_a;
+    std::map<std::pair<int64_t, int64_t>, int64_t> boxes;
+    for (Eigen::Index j = 0; j < N; ++j) {
+      boxes[{static_cast<int64_t>(std::ldexp(normal_cdf(Z(a, j)), bits_a)),
+             static_cast<int64_t>(std::ldexp(normal_cdf(Z(b, j)), bits_b))}]++;
+    }
+    EXPECT_EQ(static_cast<int64_t>(boxes.size()), int64_t{1} << (m - t))
+        << "dimensions " << a << " and " << b;
+    for (const auto &[box, count] : boxes) {
+      EXPECT_EQ(count, int64_t{1} << t) << "dimensions " << a << " and " << b;
+    }
+  }
+}
+
+TEST(common, sampling_normal_quantile) {
+  EXPECT_EQ(sampling::normal_quantile(0.5), 0.0);
+  EXPECT_TRUE(std::isinf(sampling::normal_quantile(0.0)));
+  EXPECT_TRUE(std::isinf(sampling::normal_quantile(1.0)));
+  for (const double x : {-30.0, -8.0, -3.0, -1.0, -0.1, 0.2, 1.5, 2.5, 4.0}) {
+    EXPECT_NEAR(sampling::normal_quantile(normal_cdf(x)), x, 1.0e-9 * std::max(1.0, std::abs(x)));
+  }
+}
+
+TEST(common, sampling_sobol) {
+  const Eigen::Index k = 40, N = 256;
+  const sampling::Sobol sobol{k, 1};
+  Eigen::MatrixXd Z(k, N);
+  sobol.draw(Z, 0);
+  expect_stratified(Z);
+
+  // A point does not depend on the block it is drawn in
+  Eigen::MatrixXd block(k, 37);
+  sobol.draw(block, 100);
+  EXPECT_EQ(block, Z.middleCols(100, 37));
+
+  // The scrambling depends on the seed
+  Eigen::MatrixXd other(k, N);
+  sampling::Sobol{k, 2}.draw(other, 0);
+  EXPECT_NE(other, Z);
+  expect_stratified(other);
+
+  // The pairs of the leading dimensions by the direction numbers of Joe and Kuo
+  expect_net(Z, 0, 1, 0);
+  expect_net(Z, 1, 5, 0);
+  expect_net(Z, 2, 3, 1);
+  expect_net(Z, 3, 9, 1);
+}
+
+TEST(common, sampling_latin_hypercube) {
+  const Eigen::Index k = 5, N = 100;
+  Eigen::MatrixXd Z(k, N);
+  for (Eigen::Index i = 0; i < k; ++i) {
+    sampling::draw_latin_hypercube(Z.row(i), 1, i);
+  }
+  expect_stratified(Z);
+}
+
+TEST(common, sampling_antithetic) {
+  const Eigen::Index k = 4, N = 11;
+  Eigen::MatrixXd Z(k, N);
+  sampling::draw_antithetic(Z.leftCols(6), 1, 0);
+  sampling::draw_antithetic(Z.rightCols(5), 1, 6);
+  for (Eigen::Index j = 0; j + 1 < N; j += 2) {
+    EXPECT_EQ(Z.col(j), -Z.col(j + 1));
+  }
+
+  sampling::match_moments(Z);
+  const Eigen::MatrixXd V = Z * Z.transpose() / (N - 1.0);
+  EXPECT_LT(Z.rowwise().mean().norm(), 1.0e-12);
+  EXPECT_TRUE(V.isIdentity(1.0e-12));
+
+  // Fewer members than dimensions, the variances only
+  Eigen::MatrixXd W(k, 3);
+  sampling::draw_antithetic(W, 1, 0);
+  sampling::match_moments(W);
+  EXPECT_TRUE((W.rowwise().squaredNorm() / 2.0).isOnes(1.0e-12));
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <common/series.hh>
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <fstream>
+
+TEST(common, obs_series) {
+  const auto filename = std::filesystem::temp_directory_path() / "douka-obs.series";
+  {
+    douka::io::ObsSeriesWriter writer;
+    ASSERT_TRUE(writer.open(filename, "test", true));
+    for (int64_t t = 0; t < 100; t += 2) {
+      ASSERT_TRUE(writer.append({"test", t, {t + 0.5, -1.0 * t}}));
+    }
+    // Out of order or another experiment
+    ASSERT_FALSE(writer.append({"test", 10, {1.0}}));
+    ASSERT_FALSE(writer.append({"other", 200, {1.0}}));
+    ASSERT_TRUE(writer.append({"test", 200, {1.0, 2.0, 3.0}}));
+
+    // The series is not readable until it is closed
+    douka::io::Obs obs;
+    ASSERT_FALSE(douka::io::read_obs_series(filename, 0, obs));
+    ASSERT_TRUE(writer.close());
+  }
+
+  douka::io::Obs obs;
+  ASSERT_TRUE(douka::io::read_obs_series(filename, 42, obs));
+  EXPECT_EQ(obs.name, "test");
+  EXPECT_EQ(obs.obs_tim, 42);
+  EXPECT_EQ(obs.y, (std::vector<double>{42.5, -42.0}));
+  ASSERT_TRUE(douka::io::read_obs_series("series:" + filename.native() + "@200", obs));
+  EXPECT_EQ(obs.y, (std::vector<double>{1.0, 2.0, 3.0}));
+
+  ASSERT_FALSE(douka::io::read_obs_series(filename, 41, obs));
+  ASSERT_FALSE(douka::io::read_obs_series(filename, 201, obs));
+  ASSERT_FALSE(douka::io::read_obs_series("series:" + filename.native(), obs));
+  ASSERT_FALSE(douka::io::read_obs_series("series:" + filename.native() + "@x", obs));
+  ASSERT_FALSE(douka::io::read_obs_series("series:@1", obs));
+  ASSERT_FALSE(douka::io::read_obs_series("series", obs));
+
+  douka::io::ObsSeriesWriter writer;
+  ASSERT_FALSE(writer.open(filename, "test"));
+  std::filesystem::remove(filename);
+}
+
+TEST(common, obs_series_discard) {
+  const auto filename = std::filesystem::temp_directory_path() / "douka-obs-discard.series";
+  {
+    douka::io::ObsSeriesWriter writer;
+    ASSERT_TRUE(writer.open(filename, "test", true));
+    ASSERT_TRUE(writer.append({"test", 0, {1.0}}));
+    ASSERT_TRUE(writer.append({"test", 1, {2.0}}));
+  }
+  // The series not closed is not left behind
+  douka::io::Obs obs;
+  ASSERT_FALSE(douka::io::read_obs_series(filename, 0, obs));
+  ASSERT_FALSE(std::filesystem::exists(filename));
+
+  douka::io::ObsSeriesWriter writer;
+  ASSERT_TRUE(writer.open(filename, "test", true));
+  ASSERT_TRUE(writer.append({"test", 0, {1.0}}));
+  writer.discard();
+  ASSERT_FALSE(writer.is_open());
+  ASSERT_FALSE(std::filesystem::exists(filename));
+  ASSERT_TRUE(writer.close());
+}
+
+TEST(common, obs_series_reader) {
+  const auto filename = std::filesystem::temp_directory_path() / "douka-obs-reader.series";
+  {
+    douka::io::ObsSeriesWriter writer;
+    ASSERT_TRUE(writer.open(filename, "test", true));
+    for (int64_t t = 0; t < 10; ++t) {
+      ASSERT_TRUE(writer.append({"test", t, std::vector<double>(t + 1, t)}));
+    }
+    ASSERT_TRUE(writer.close());
+  }
+
+  douka::io::ObsSeriesReader reader;
+  ASSERT_TRUE(reader.open(filename));
+  EXPECT_EQ(reader.size(), 10);
+  EXPECT_EQ(reader.name(), "test");
+
+  douka::io::Obs obs;
+  ASSERT_TRUE(reader.next(obs));
+  EXPECT_EQ(obs.obs_tim, 0);
+  EXPECT_EQ(obs.y, std::vector<double>(1, 0.0));
+  // The skipped observations are not read
+  ASSERT_TRUE(reader.skip(6));
+  ASSERT_TRUE(reader.next(obs));
+  EXPECT_EQ(obs.name, "test");
+  EXPECT_EQ(obs.obs_tim, 7);
+  EXPECT_EQ(obs.y, std::vector<double>(8, 7.0));
+  EXPECT_EQ(reader.position(), 8);
+
+  ASSERT_FALSE(reader.skip(3));
+  ASSERT_TRUE(reader.skip(1));
+  ASSERT_TRUE(reader.next(obs));
+  EXPECT_EQ(obs.obs_tim, 9);
+  ASSERT_FALSE(reader.next(obs));
+
+  ASSERT_FALSE(reader.open(filename.native() + ".missing"));
+  std::filesystem::remove(filename);
+}
+
+TEST(common, obs_series_broken) {
+  const auto filename = std::filesystem::temp_directory_path() / "douka-obs-broken.series";
+  const auto write = [&filename] {
+    douka::io::ObsSeriesWriter writer;
+    return writer.open(filename, "test", true) && writer.append({"test", 0, {1.0, 2.0}}) &&
+           writer.close();
+  };
+  const auto read = [&filename](const std::size_t offset, auto &value) {
+    std::ifstream stream{filename, std::ios::binary};
+    stream.seekg(static_cast<std::streamoff>(offset));
+    stream.read(reinterpret_cast<char *>(&value), sizeof(value));
+  };
+  const auto patch = [&filename](const std::size_t offset, const auto value) {
+    std::fstream stream{filename, std::ios::binary | std::ios::in | std::ios::out};
+    stream.seekp(static_cast<std::streamoff>(offset));
+    stream.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  douka::io::Obs obs;
+
+  // The size of the index wraps around to that of a single entry
+  ASSERT_TRUE(write());
+  patch(offsetof(douka::io::ObsSeriesHeader, count), (uint64_t{1} << 61) + 1);
+  ASSERT_FALSE(douka::io::read_obs_series(filename, 0, obs));
+
+  // The end of the observation wraps around
+  ASSERT_TRUE(write());
+  uint64_t index_offset;
+  read(offsetof(douka::io::ObsSeriesHeader, index_offset), index_offset);
+  patch(index_offset + offsetof(douka::io::ObsSeriesEntry, l), (uint64_t{1} << 61) + 2);
+  ASSERT_FALSE(douka::io::read_obs_series(filename, 0, obs));
+  std::filesystem::remove(filename);
+}
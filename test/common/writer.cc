@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <common/ensemble.hh>
+#include <common/io.hh>
+#include <common/json.hh>
+#include <common/writer.hh>
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+
+namespace {
+std::string read_text(const std::filesystem::path &filename) {
+  std::ifstream stream{filename};
+  std::stringstream ss;
+  ss << stream.rdbuf();
+  return ss.str();
+}
+} // namespace
+
+TEST(common, writer_write) {
+  const auto dir = std::filesystem::temp_directory_path() / "douka-writer-test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  for (const int64_t threads : {1, 3}) {
+    douka::io::AsyncWriter writer{threads};
+    for (int64_t i = 0; i < 64; ++i) {
+      const auto filename = dir / (std::to_string(threads) + "-" + std::to_string(i));
+      ASSERT_TRUE(writer.write(filename, std::string(i * 1000, static_cast<char>('a' + i % 26))));
+    }
+    ASSERT_TRUE(writer.wait());
+    for (int64_t i = 0; i < 64; ++i) {
+      const auto filename = dir / (std::to_string(threads) + "-" + std::to_string(i));
+      ASSERT_EQ(read_text(filename), std::string(i * 1000, static_cast<char>('a' + i % 26)));
+    }
+  }
+
+  // An existing file is kept without force
+  douka::io::AsyncWriter writer;
+  writer.write(dir / "1-1", "x");
+  ASSERT_FALSE(writer.wait());
+  ASSERT_EQ(read_text(dir / "1-1"), std::string(1000, 'b'));
+
+  douka::io::AsyncWriter forced;
+  ASSERT_TRUE(forced.write(dir / "1-1", "x", true));
+  ASSERT_TRUE(forced.wait());
+  ASSERT_EQ(read_text(dir / "1-1"), "x");
+  std::filesystem::remove_all(dir);
+}
+
+TEST(common, writer_same_as_write_json) {
+  const auto dir = std::filesystem::temp_directory_path() / "douka-writer-json";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir / "async");
+  const douka::io::State state{"test", 1, 2, 3, {1.0, -0.5, 1e-300}};
+  ASSERT_TRUE(douka::io::write_json(dir / "sync.json", state));
+  douka::io::set_json_style(douka::io::JsonStyle::pretty);
+  ASSERT_TRUE(douka::io::write_states(dir / "async", {state}, douka::io::Format::json));
+  douka::io::set_json_style(douka::io::JsonStyle::compact);
+  ASSERT_EQ(read_text(dir / "async" / douka::io::state_filename(state)),
+            read_text(dir / "sync.json"));
+  std::filesystem::remove_all(dir);
+}
@@ -3,9 +3,12 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <common/alloc.hh>
 #include <filter/enkf.hh>
 #include <gtest/gtest.h>
 
+#include <thread>
+
 static void expect_states(const std::vector<douka::io::State> &states,
                           const std::vector<douka::io::State> &expect,
                           const double epsilon = 1e-2) {
@@ -72,6 +75,14 @@ TEST(enkf, filter1) {
   };
 
   expect_states(states, expect);
+
+  // The out-of-core update of the states
+  for (auto &state : states) {
+    state.obs_tim = 0;
+  }
+  param.block_rows = 2;
+  ASSERT_TRUE(douka::filter::enkf::filter(states, obs, param));
+  expect_states(states, expect);
 }
 
 TEST(enkf, filter2) {
@@ -90,4 +101,343 @@ TEST(enkf, filter2) {
   };
 
   expect_states(states, expect);
-}
\ No newline at end of file
+}
+TEST(enkf, filter_workspace) {
+  std::vector<douka::io::State> states = {
+      {"test", 0, 1, 0, {1.0, 2.0, 3.0}},
+      {"test", 1, 1, 0, {2.0, 4.0, 6.0}},
+      {"test", 2, 1, 0, {2.1, 4.1, 6.1}},
+  };
+  douka::io::Obs obs = {"test", 1, {2.0, 3.0}};
+  douka::filter::enkf::Param param = {"test", 0, 3, 3, 2, {1.0, 1.0}, {1, 0, 0, 0, 1, 0}};
+
+  Eigen::MatrixXd X{param.k, param.N};
+  for (const auto &state : states) {
+    X.col(state.id) = Eigen::Map<const Eigen::VectorXd>{state.x.data(), param.k};
+  }
+  const auto y = Eigen::Map<const Eigen::VectorXd>{obs.y.data(), param.l};
+  douka::filter::enkf::Workspace ws{param};
+  ws.engine.seed(static_cast<unsigned>(param.seed + obs.obs_tim));
+  ASSERT_TRUE(douka::filter::enkf::filter(ws, X, y));
+
+  ASSERT_TRUE(douka::filter::enkf::filter(states, obs, param));
+  for (const auto &state : states) {
+    for (std::size_t j = 0; j < state.x.size(); ++j) {
+      EXPECT_DOUBLE_EQ(state.x[j], X(j, state.id));
+    }
+  }
+}
+
+// Steady state cycles reuse the buffers of the workspace
+TEST(enkf, filter_workspace_allocations) {
+  if (!douka::common::alloc::enabled()) {
+    GTEST_SKIP() << "built without DOUKA_USE_ALLOC_COUNTER";
+  }
+  douka::filter::enkf::Param param = {"test", 0, 3, 3, 2, {1.0, 1.0}, {1, 0, 0, 0, 1, 0}};
+  Eigen::MatrixXd X{param.k, param.N};
+  X << 1.0, 2.0, 2.1, //
+      2.0, 4.0, 4.1,  //
+      3.0, 6.0, 6.1;
+  const Eigen::Vector2d y{2.0, 3.0};
+  douka::filter::enkf::Workspace ws{param};
+  ASSERT_TRUE(douka::filter::enkf::filter(ws, X, y));
+
+  const auto before = douka::common::alloc::stats();
+  ASSERT_TRUE(douka::filter::enkf::filter(ws, X, y));
+  ASSERT_EQ((douka::common::alloc::stats() - before).count, 0u);
+}
+
+// Allocation budget of the first cycle: the buffers of the workspace and the blocking of the
+// products, a bounded number whatever the ensemble size
+TEST(enkf, filter_alloc_budget) {
+  if (!douka::common::alloc::enabled()) {
+    GTEST_SKIP() << "built without DOUKA_USE_ALLOC_COUNTER";
+  }
+  for (const int64_t N : {8, 128}) {
+    douka::filter::enkf::Param param = {
+        "test", 0, N, 16, 4, std::vector<double>(4, 1.0), {}};
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(param.k, param.N);
+    const Eigen::VectorXd y = Eigen::VectorXd::Random(param.l);
+    const auto before = douka::common::alloc::stats();
+    douka::filter::enkf::Workspace ws{param};
+    ASSERT_TRUE(douka::filter::enkf::filter(ws, X, y));
+    ASSERT_LE((douka::common::alloc::stats() - before).count, 32u);
+  }
+}
+
+TEST(enkf, sparse_to_dense) {
+  std::vector<double> H;
+  ASSERT_TRUE(douka::filter::enkf::sparse_to_dense({0, 2, 3}, {0, 1, 3}, {0.5, 0.5, 1.0}, 4, H));
+  ASSERT_EQ(H, (std::vector<double>{0.5, 0.5, 0.0, 0.0, //
+                                    0.0, 0.0, 0.0, 1.0}));
+
+  ASSERT_FALSE(douka::filter::enkf::sparse_to_dense({0, 2}, {0, 4}, {0.5, 0.5}, 4, H));
+  ASSERT_FALSE(douka::filter::enkf::sparse_to_dense({0, 2, 1, 2}, {0, 1}, {0.5, 0.5}, 4, H));
+  ASSERT_FALSE(douka::filter::enkf::sparse_to_dense({0, 3}, {0, 1}, {0.5, 0.5}, 4, H));
+  ASSERT_FALSE(douka::filter::enkf::sparse_to_dense({0}, {}, {}, 4, H));
+}
+
+TEST(enkf, filter_gain) {
+  const Eigen::Index N = 5, k = 4, l = 3;
+  // clang-format off
+  const std::vector<double> R = {
+    2.0, 0.5, 0.0,
+    0.5, 1.0, 0.2,
+    0.0, 0.2, 1.5};
+  const std::vector<double> H = {
+    1.0, 0.0, 0.0, 0.0,
+    0.0, 0.5, 0.5, 0.0,
+    0.0, 0.0, 0.0, 2.0};
+  // clang-format on
+  const Eigen::MatrixXd X0 = Eigen::MatrixXd::Random(k, N);
+  const Eigen::VectorXd y = Eigen::VectorXd::Random(l);
+
+  // The formulations are algebraically equivalent and draw the same perturbation
+  std::vector<Eigen::MatrixXd> Xs;
+  for (const auto gain : {"state", "observation", "ensemble"}) {
+    douka::filter::enkf::Param param = {"test", 0, N, k, l, R, H, gain};
+    ASSERT_TRUE(param.validate());
+    douka::filter::enkf::Workspace ws{param};
+    ASSERT_EQ(douka::common::compute::gain_names[static_cast<int>(ws.gain)], gain);
+    Eigen::MatrixXd X = X0;
+    ASSERT_TRUE(douka::filter::enkf::filter(ws, X, y));
+    Xs.emplace_back(X);
+  }
+  EXPECT_TRUE(Xs[0].isApprox(Xs[1], 1.0e-10));
+  EXPECT_TRUE(Xs[2].isApprox(Xs[1], 1.0e-10));
+
+  // R^-1 is required by state and ensemble
+  douka::filter::enkf::Param param = {"test", 0, N, k, l, {}, H, "ensemble"};
+  douka::filter::enkf::Workspace ws{param};
+  Eigen::MatrixXd X = X0;
+  ASSERT_FALSE(douka::filter::enkf::filter(ws, X, y));
+
+  param.gain = "unknown";
+  ASSERT_FALSE(param.validate());
+}
+
+TEST(enkf, filter_blocked) {
+  const Eigen::Index N = 6, k = 7, l = 3;
+  // clang-format off
+  const std::vector<double> R = {
+    2.0, 0.5, 0.0,
+    0.5, 1.0, 0.2,
+    0.0, 0.2, 1.5};
+  const std::vector<double> H = {
+    1.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0,
+    0.0, 0.5, 0.5, 0.0, 0.0, 0.0, 0.0,
+    0.0, 0.0, 0.0, 0.0, 0.0, 1.0, 2.0};
+  // clang-format on
+  const Eigen::MatrixXd X0 = Eigen::MatrixXd::Random(k, N);
+  const Eigen::VectorXd y = Eigen::VectorXd::Random(l);
+
+  // The row blocks give the update of the whole ensemble, for any block size
+  for (const auto &H_given : {H, std::vector<double>{}}) {
+    for (const auto gain : {"observation", "ensemble"}) {
+      douka::filter::enkf::Param param = {"test", 0, N, k, l, R, H_given, gain};
+      douka::filter::enkf::Workspace ws{param};
+      Eigen::MatrixXd expect = X0;
+      ASSERT_TRUE(douka::filter::enkf::filter(ws, expect, y));
+
+      for (const int64_t block_rows : {1, 3, 100}) {
+        param.block_rows = block_rows;
+        ASSERT_TRUE(param.validate());
+        douka::filter::enkf::Workspace blocked{param};
+        ASSERT_EQ(blocked.Z.size(), 0);
+        ASSERT_EQ(douka::common::compute::gain_names[static_cast<int>(blocked.gain)], gain);
+
+        // In place, and from the input into another output
+        Eigen::MatrixXd X = X0;
+        ASSERT_TRUE(douka::filter::enkf::filter(blocked, X, y));
+        EXPECT_TRUE(X.isApprox(expect, 1.0e-12)) << gain << " block_rows=" << block_rows;
+
+        Eigen::MatrixXd X_next = Eigen::MatrixXd::Zero(k, N);
+        blocked.engine.seed(static_cast<unsigned>(param.seed));
+        ws.engine.seed(static_cast<unsigned>(param.seed));
+        expect = X0;
+        ASSERT_TRUE(douka::filter::enkf::filter(ws, expect, y));
+        ASSERT_TRUE(douka::filter::enkf::filter(blocked, X0, X_next, y));
+        EXPECT_TRUE(X_next.isApprox(expect, 1.0e-12)) << gain << " block_rows=" << block_rows;
+      }
+    }
+  }
+
+  // The k x k system of the state gain is not blocked
+  douka::filter::enkf::Param param = {"test", 0, N, k, l, R, H, "state", 2};
+  ASSERT_FALSE(param.validate());
+  param.gain = "auto";
+  ASSERT_TRUE(param.validate());
+  douka::filter::enkf::Workspace ws{param};
+  ASSERT_NE(ws.gain, douka::common::compute::Gain::state);
+}
+
+TEST(enkf, filter_ranks) {
+  const Eigen::Index N = 6, k = 7, l = 3;
+  // clang-format off
+  const std::vector<double> R = {
+    2.0, 0.5, 0.0,
+    0.5, 1.0, 0.2,
+    0.0, 0.2, 1.5};
+  const std::vector<double> H = {
+    1.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0,
+    0.0, 0.5, 0.5, 0.0, 0.0, 0.0, 0.0,
+    0.0, 0.0, 0.0, 0.0, 0.0, 1.0, 2.0};
+  // clang-format on
+  const Eigen::MatrixXd X0 = Eigen::MatrixXd::Random(k, N);
+  const Eigen::VectorXd y = Eigen::VectorXd::Random(l);
+
+  // The ranks, threads here, update their own rows to the update of the whole ensemble
+  // in blocks of rows or all of them at once
+  for (const auto &H_given : {H, std::vector<double>{}}) {
+    for (const auto &decomposition : {std::pair<int64_t, int64_t>{1, 2}, {2, 2}, {4, 2},
+                                      {1, 0}, {2, 0}, {3, 0}}) {
+      const auto ranks = decomposition.first, block_rows = decomposition.second;
+      douka::filter::enkf::Param param = {"test", 0, N, k, l, R, H_given, "ensemble", block_rows};
+      douka::filter::enkf::Workspace ws{param};
+      Eigen::MatrixXd expect = X0;
+      ASSERT_TRUE(douka::filter::enkf::filter(ws, expect, y));
+
+      Eigen::MatrixXd X = Eigen::MatrixXd::Zero(k, N);
+      std::vector<int> ok(ranks, 0);
+      std::vector<std::thread> threads;
+      for (int64_t rank = 0; rank < ranks; ++rank) {
+        threads.emplace_back([&, rank]() {
+          douka::common::RankGroup group;
+          douka::filter::enkf::Workspace ws{param, true};
+          // A rank holds no k x N matrix besides its own rows
+          EXPECT_EQ(ws.Z.size(), 0);
+          EXPECT_EQ(ws.x_mean.size(), 0);
+          if (!group.open("test-filter", ranks, rank, l * N)) {
+            return;
+          }
+          const auto slice = group.slice(k);
+          ok[rank] = douka::filter::enkf::filter(ws, X0.middleRows(slice.begin, slice.size),
+                                                 X.middleRows(slice.begin, slice.size), y,
+                                                 slice.begin, group) &&
+                     group.close();
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      for (int64_t rank = 0; rank < ranks; ++rank) {
+        ASSERT_TRUE(ok[rank]) << "rank " << rank << " of " << ranks;
+      }
+      EXPECT_TRUE(X.isApprox(expect, 1.0e-12)) << "ranks=" << ranks << " block_rows=" << block_rows;
+    }
+  }
+
+  // The k x k system of the state gain is not decomposed by rows
+  douka::filter::enkf::Param param = {"test", 0, N, k, l, R, H, "state"};
+  douka::filter::enkf::Workspace ws{param, true};
+  ASSERT_FALSE(ws.costs[static_cast<int>(douka::common::compute::Gain::state)].available);
+  Eigen::MatrixXd X = X0;
+  ASSERT_FALSE(douka::filter::enkf::filter(ws, X0, X, y));
+  param.gain = "auto";
+  douka::filter::enkf::Workspace ws_auto{param, true};
+  ASSERT_NE(ws_auto.gain, douka::common::compute::Gain::state);
+}
+
+TEST(enkf, filter_obs_blocks) {
+  const Eigen::Index N = 6, k = 5, l = 3;
+  // clang-format off
+  const std::vector<double> R = {
+    2.0, 0.0, 0.0,
+    0.0, 1.0, 0.2,
+    0.0, 0.2, 1.5};
+  const std::vector<double> H = {
+    1.0, 0.0, 0.0, 0.0, 0.0,
+    0.0, 0.5, 0.5, 0.0, 0.0,
+    0.0, 0.0, 0.0, 1.0, 2.0};
+  // clang-format on
+  const std::vector<douka::filter::enkf::ObsBlock> blocks = {
+      {1, {2.0}, {1.0, 0.0, 0.0, 0.0, 0.0}},
+      {2, {1.0, 0.2, 0.2, 1.5}, {0.0, 0.5, 0.5, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0, 2.0}},
+  };
+  const Eigen::MatrixXd X0 = Eigen::MatrixXd::Random(k, N);
+  const Eigen::VectorXd y = Eigen::VectorXd::Random(l);
+
+  // The blocks are the block diagonal R and the stacked H, factorized block by block
+  for (const auto gain : {"state", "observation", "ensemble"}) {
+    douka::filter::enkf::Param param = {"test", 0, N, k, l, R, H, gain};
+    douka::filter::enkf::Workspace ws{param};
+    Eigen::MatrixXd expect = X0;
+    ASSERT_TRUE(douka::filter::enkf::filter(ws, expect, y));
+
+    douka::filter::enkf::Param blocked = {"test", 0, N, k, l, {}, {}, gain, 0, blocks};
+    ASSERT_TRUE(blocked.validate());
+    douka::filter::enkf::Workspace ws_blocked{blocked};
+    ASSERT_EQ(ws_blocked.blocks.size(), 2);
+    ASSERT_FALSE(ws_blocked.R_diagonal);
+    Eigen::MatrixXd X = X0;
+    ASSERT_TRUE(douka::filter::enkf::filter(ws_blocked, X, y));
+    EXPECT_TRUE(X.isApprox(expect, 1.0e-12)) << gain;
+  }
+
+  // The serial blocks are the filters of each block in turn, drawing from the same stream
+  for (const auto gain : {"observation", "ensemble"}) {
+    douka::filter::enkf::Param param = {"test", 0, N, k, l, {}, {}, gain, 0, blocks, true};
+    ASSERT_TRUE(param.validate());
+    douka::filter::enkf::Workspace ws{param};
+    Eigen::MatrixXd X = X0;
+    ASSERT_TRUE(douka::filter::enkf::filter(ws, X, y));
+
+    Eigen::MatrixXd expect = X0;
+    douka::filter::enkf::Param first = {"test", 0, N, k, 1, blocks[0].R, blocks[0].H, gain};
+    douka::filter::enkf::Param second = {"test", 0, N, k, 2, blocks[1].R, blocks[1].H, gain};
+    douka::filter::enkf::Workspace ws_first{first}, ws_second{second};
+    ASSERT_TRUE(douka::filter::enkf::filter(ws_first, expect, y.head(1)));
+    ws_second.engine = ws_first.engine;
+    ws_second.dist = ws_first.dist;
+    ASSERT_TRUE(douka::filter::enkf::filter(ws_second, expect, y.tail(2)));
+    EXPECT_TRUE(X.isApprox(expect, 1.0e-12)) << gain;
+  }
+
+  // Blocks without H observe the states of their rows, as a single identity H
+  {
+    douka::filter::enkf::Param param = {"test", 0, N, k, l, {1.0, 2.0, 3.0}, {}, "ensemble"};
+    douka::filter::enkf::Workspace ws{param};
+    Eigen::MatrixXd expect = X0;
+    ASSERT_TRUE(douka::filter::enkf::filter(ws, expect, y));
+
+    param.R.clear();
+    param.blocks = {{2, {1.0, 2.0}, {}}, {1, {3.0}, {}}};
+    ASSERT_TRUE(param.validate());
+    douka::filter::enkf::Workspace ws_blocked{param};
+    ASSERT_TRUE(ws_blocked.H_identity);
+    ASSERT_TRUE(ws_blocked.R_diagonal);
+    Eigen::MatrixXd X = X0;
+    ASSERT_TRUE(douka::filter::enkf::filter(ws_blocked, X, y));
+    EXPECT_TRUE(X.isApprox(expect, 1.0e-12));
+  }
+
+  // The blocks cover the observations and give R and H
+  douka::filter::enkf::Param param = {"test", 0, N, k, l, {}, {}, "auto", 0, blocks};
+  ASSERT_TRUE(param.validate());
+  param.blocks[1].l = 1;
+  ASSERT_FALSE(param.validate());
+  param.blocks = blocks;
+  param.blocks[1].H.clear();
+  ASSERT_FALSE(param.validate());
+  param.blocks = blocks;
+  param.blocks[0].H.clear();
+  ASSERT_FALSE(param.validate());
+  param.blocks = blocks;
+  param.blocks[0].R = {1.0, 2.0};
+  ASSERT_FALSE(param.validate());
+  param.blocks = blocks;
+  param.R = R;
+  ASSERT_FALSE(param.validate());
+  param.R.clear();
+
+  // The serial blocks update the whole ensemble after each block
+  param.serial = true;
+  ASSERT_TRUE(param.validate());
+  douka::filter::enkf::Workspace ws{param};
+  ASSERT_NE(ws.gain, douka::common::compute::Gain::state);
+  param.gain = "state";
+  ASSERT_FALSE(param.validate());
+  param.gain = "auto";
+  param.block_rows = 2;
+  ASSERT_FALSE(param.validate());
+}
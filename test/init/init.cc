@@ -4,8 +4,15 @@
  */
 
 #include <command/init.hh>
+#include <common/compute.hh>
+#include <common/parallel.hh>
+#include <common/series.hh>
 #include <gtest/gtest.h>
 
+#include <filesystem>
+#include <set>
+#include <thread>
+
 void expect_ne(const std::vector<double> lhs, const std::vector<double> rhs) {
   ASSERT_EQ(lhs.size(), rhs.size());
   for (std::size_t i = 0; i < lhs.size(); ++i) {
@@ -68,4 +75,161 @@ TEST(init, validate) {
   ASSERT_EQ(states.size(), param.N);
   expect_near(states, param.x0, 3 * sigma);
   expect_ne(states[0].x, states[1].x);
-}
\ No newline at end of file
+}
+TEST(init, validate_full_V0) {
+  douka::command::init::Param param = {
+      "test", 0, 2, 2, {1.0, 2.0}, {1.0, 0.5, 0.5, 1.0}};
+
+  ASSERT_TRUE(douka::command::init::validate(param));
+}
+
+TEST(init, reproducible) {
+  douka::command::init::Param param = {"test", 3, 200, 3, {1.0, 2.0, 3.0}, {1.0, 2.0, 3.0}};
+
+  // A member depends on (seed, id) only, not on the number of threads or members
+  std::vector<douka::io::State> serial, parallel, few;
+  douka::common::set_compute_threads(1);
+  ASSERT_TRUE(douka::command::init::init(serial, param));
+  douka::common::set_compute_threads(3);
+  ASSERT_TRUE(douka::command::init::init(parallel, param));
+  param.N = 5;
+  ASSERT_TRUE(douka::command::init::init(few, param));
+  douka::common::set_compute_threads(std::thread::hardware_concurrency());
+
+  ASSERT_EQ(serial.size(), parallel.size());
+  for (std::size_t i = 0; i < serial.size(); ++i) {
+    EXPECT_EQ(serial[i].id, static_cast<int64_t>(i));
+    EXPECT_EQ(serial[i].x, parallel[i].x);
+  }
+  for (std::size_t i = 0; i < few.size(); ++i) {
+    EXPECT_EQ(serial[i].x, few[i].x);
+  }
+}
+
+TEST(init, full_V0) {
+  const std::vector<double> V0 = {4.0, 1.0, 0.5, 1.0, 2.0, 0.0, 0.5, 0.0, 1.0};
+  douka::command::init::Param param = {"test", 0, 20000, 3, {1.0, 2.0, 3.0}, V0};
+
+  douka::io::Ensemble ensemble;
+  ASSERT_TRUE(douka::command::init::init(ensemble, param));
+
+  const Eigen::Map<const Eigen::MatrixXd> X{ensemble.X.data(), 3, 20000};
+  const Eigen::VectorXd mean = X.rowwise().mean();
+  const Eigen::MatrixXd V = douka::common::compute::cov(X);
+  for (Eigen::Index i = 0; i < 3; ++i) {
+    EXPECT_NEAR(mean[i], param.x0[i], 0.05);
+    for (Eigen::Index j = 0; j < 3; ++j) {
+      EXPECT_NEAR(V(i, j), V0[i * 3 + j], 0.1);
+    }
+  }
+}
+
+TEST(init, invalid_V0) {
+  // Not positive definite
+  douka::command::init::Param param = {"test", 0, 2, 2, {1.0, 2.0}, {1.0, 2.0, 2.0, 1.0}};
+
+  std::vector<douka::io::State> states;
+  ASSERT_FALSE(douka::command::init::init(states, param));
+}
+
+// Errors of the sample mean and covariance from x0 and V0 averaged over a few seeds
+static std::pair<double, double> moment_errors(const std::string &sampling, const uint64_t N) {
+  const std::vector<double> V0 = {2.0, 0.5, 0.0, 0.5, 1.0, 0.0, 0.0, 0.0, 3.0};
+  douka::command::init::Param param = {"test", 0, N, 3, {1.0, 2.0, 3.0}, V0, sampling};
+  const Eigen::Map<const Eigen::Vector3d> x0{param.x0.data()};
+  const Eigen::Map<const Eigen::Matrix3d> V{V0.data()};
+
+  double mean_error = 0.0, cov_error = 0.0;
+  const int seeds = 8;
+  for (int seed = 0; seed < seeds; ++seed) {
+    param.seed = seed;
+    douka::io::Ensemble ensemble;
+    EXPECT_TRUE(douka::command::init::init(ensemble, param));
+    const Eigen::Map<const Eigen::MatrixXd> X{ensemble.X.data(), 3, static_cast<Eigen::Index>(N)};
+    mean_error += (X.rowwise().mean() - x0).norm() / seeds;
+    cov_error += (douka::common::compute::cov(X) - V).norm() / seeds;
+  }
+  return {mean_error, cov_error};
+}
+
+TEST(init, sampling_moments) {
+  for (const uint64_t N : {64, 1024}) {
+    const auto random = moment_errors("random", N);
+    const auto sobol = moment_errors("sobol", N);
+    const auto lhs = moment_errors("lhs", N);
+    const auto antithetic = moment_errors("antithetic", N);
+
+    // The stratified samplings converge faster than O(N^-1/2) in the mean
+    EXPECT_LT(sobol.first, random.first / 4) << "N=" << N;
+    EXPECT_LT(lhs.first, random.first / 4) << "N=" << N;
+    EXPECT_LT(sobol.second, random.second) << "N=" << N;
+    EXPECT_LT(lhs.second, random.second) << "N=" << N;
+    // The antithetic members are matched to the exact moments
+    EXPECT_LT(antithetic.first, 1.0e-12) << "N=" << N;
+    EXPECT_LT(antithetic.second, 1.0e-12) << "N=" << N;
+  }
+  EXPECT_LT(moment_errors("sobol", 1024).first, moment_errors("sobol", 64).first / 16);
+}
+
+TEST(init, invalid_sampling) {
+  douka::command::init::Param param = {
+      "test", 0, 2, 3, {1.0, 2.0, 3.0}, {1.0, 1.0, 1.0}, "quasi"};
+
+  ASSERT_FALSE(douka::command::init::validate(param));
+}
+
+TEST(init, climatology) {
+  // State t of the trajectory is [t, -t]
+  const int64_t n = 1000;
+  const auto filename = std::filesystem::temp_directory_path() / "douka-init-trajectory.series";
+  {
+    douka::io::ObsSeriesWriter writer;
+    ASSERT_TRUE(writer.open(filename, "test", true));
+    for (int64_t t = 0; t < n; ++t) {
+      ASSERT_TRUE(writer.append({"test", t, {1.0 * t, -1.0 * t}}));
+    }
+    ASSERT_TRUE(writer.close());
+  }
+
+  douka::command::init::Param param = {"test", 1, 50, 2, {}, {}, "random", filename.native()};
+  ASSERT_TRUE(douka::command::init::validate(param));
+
+  // Each state is taken with the probability N/n
+  double mean = 0.0;
+  const int seeds = 20;
+  for (int seed = 0; seed < seeds; ++seed) {
+    param.seed = seed;
+    std::vector<douka::io::State> states;
+    ASSERT_TRUE(douka::command::init::init(states, param));
+    ASSERT_EQ(states.size(), param.N);
+
+    std::set<double> sampled;
+    for (const auto &state : states) {
+      ASSERT_EQ(state.x.size(), 2);
+      EXPECT_EQ(state.x[1], -state.x[0]);
+      EXPECT_GE(state.x[0], 0.0);
+      EXPECT_LT(state.x[0], n);
+      sampled.insert(state.x[0]);
+      mean += state.x[0] / (seeds * param.N);
+    }
+    EXPECT_EQ(sampled.size(), param.N);
+  }
+  EXPECT_NEAR(mean, (n - 1) / 2.0, 30.0);
+
+  // The same seed gives the same members
+  std::vector<douka::io::State> first, second;
+  ASSERT_TRUE(douka::command::init::init(first, param));
+  ASSERT_TRUE(douka::command::init::init(second, param));
+  for (std::size_t i = 0; i < first.size(); ++i) {
+    EXPECT_EQ(first[i].x, second[i].x);
+  }
+
+  // Shorter than N or of another state size
+  std::vector<douka::io::State> states;
+  param.N = n + 1;
+  ASSERT_FALSE(douka::command::init::init(states, param));
+  param.N = 10;
+  param.k = 3;
+  ASSERT_FALSE(douka::command::init::init(states, param));
+  std::filesystem::remove(filename);
+}
@@ -98,4 +98,25 @@ TEST(obsgen, obsgen) {
     y2 += 1.0;
     t++;
   }
-}
\ No newline at end of file
+}
+TEST(obsgen, obsgen_stream) {
+  auto plugin = std::make_shared<SamplePlugin>();
+  douka::command::obsgen::Param param = {"test", 0, 10, 3, 2, {1.0, 2.0, 3.0}, {}};
+
+  // The observations are passed in the order of obs_tim as soon as they are generated
+  int64_t t = 0;
+  ASSERT_TRUE(douka::command::obsgen::obsgen(param, plugin, [&](douka::io::Obs &&obs) {
+    EXPECT_EQ(obs.obs_tim, t);
+    EXPECT_DOUBLE_EQ(obs.y.at(0), param.x0[0] + t);
+    t++;
+    return true;
+  }));
+  ASSERT_EQ(t, param.t + 1);
+
+  // A failed write stops the generation
+  t = 0;
+  ASSERT_FALSE(douka::command::obsgen::obsgen(param, plugin, [&](douka::io::Obs &&) {
+    return ++t < 3;
+  }));
+  ASSERT_EQ(t, 3);
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2025 Materials Modelling Lab, The University of Tokyo
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "douka/plugin_interface.hh"
+#include <iostream>
+
+// Fails partway through the time steps
+class SampleFailingPlugin : public douka::PluginInterface {
+public:
+  bool predict([[maybe_unused]] std::vector<double> &state,
+               [[maybe_unused]] const std::vector<double> &noise) override {
+    if (this->sys_tim == 3) {
+      std::clog << "failed at sys_tim " << this->sys_tim << std::endl;
+      return false;
+    }
+    return true;
+  }
+};
+
+#include "douka/plugin_register_macro.hh"
+DOUKA_PLUGIN_REGISTER(SampleFailingPlugin)
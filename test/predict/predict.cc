@@ -4,6 +4,7 @@
  */
 
 #include <command/predict.hh>
+#include <common/alloc.hh>
 #include <gtest/gtest.h>
 
 class SamplePlugin : public douka::PluginInterface {
@@ -66,4 +67,28 @@ TEST(predict, predict1) {
       {std::pow(plugin->sigma, 2.0), std::pow(plugin->sigma, 2.0), std::pow(plugin->sigma, 2.0)}};
 
   ASSERT_TRUE(douka::command::predict::predict(state, param, plugin));
-}
\ No newline at end of file
+}
+
+class IdentityPlugin : public douka::PluginInterface {
+public:
+  bool predict([[maybe_unused]] std::vector<double> &state,
+               [[maybe_unused]] const std::vector<double> &noise) override {
+    return true;
+  }
+};
+
+// Allocation budget of predict: the noise and Q, independent of the state size
+TEST(predict, alloc_budget) {
+  if (!douka::common::alloc::enabled()) {
+    GTEST_SKIP() << "built without DOUKA_USE_ALLOC_COUNTER";
+  }
+  const auto plugin = std::make_shared<IdentityPlugin>();
+  for (const int64_t k : {4, 256}) {
+    douka::io::State state = {"test", 0, 0, 0, std::vector<double>(k, 1.0)};
+    const douka::command::predict::Param param = {"test", 0, static_cast<uint64_t>(k),
+                                                  std::vector<double>(k, 1.0)};
+    const auto before = douka::common::alloc::stats();
+    ASSERT_TRUE(douka::command::predict::predict(state, param, plugin));
+    ASSERT_LE((douka::common::alloc::stats() - before).count, 8u);
+  }
+}